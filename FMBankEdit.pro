@@ -103,6 +103,7 @@ SOURCES += \
     src/operator_editor.cpp \
     src/bank_comparison.cpp \
     src/common.cpp \
+    src/common_gui.cpp \
     src/controlls.cpp \
     src/proxystyle.cpp \
     src/FileFormats/ffmt_base.cpp \
@@ -131,13 +132,26 @@ SOURCES += \
     src/formats_sup.cpp \
     src/importer.cpp \
     src/audio_config.cpp \
+    src/audio_diagnostics.cpp \
+    src/audio_scope.cpp \
     src/register_editor.cpp \
     src/ins_names.cpp \
     src/main.cpp \
     src/opl/generator.cpp \
+    src/opl/generator_offline.cpp \
+    src/opl/notes_manager.cpp \
+    src/opl/patch_bank.cpp \
+    src/audio/wav_writer.cpp \
+    src/audio/audio_stats.cpp \
+    src/audio/spectrum.cpp \
+    src/audio/ao_base.cpp \
+    src/audio/ao_headless.cpp \
     src/opl/generator_realtime.cpp \
     src/opl/realtime/ring_buffer.cpp \
+    src/opl/realtime/semaphore.cpp \
     src/opl/measurer.cpp \
+    src/opl/measurer_cache.cpp \
+    src/opl/envelope_model.cpp \
     src/piano.cpp
 
 HEADERS += \
@@ -173,15 +187,30 @@ HEADERS += \
     src/formats_sup.h \
     src/importer.h \
     src/audio_config.h \
+    src/audio_diagnostics.h \
+    src/audio_scope.h \
     src/register_editor.h \
     src/ins_names.h \
     src/ins_names_data.h \
     src/main.h \
     src/opl/generator.h \
+    src/opl/generator_offline.h \
+    src/opl/notes_manager.h \
+    src/opl/patch_bank.h \
+    src/audio/wav_writer.h \
+    src/audio/audio_stats.h \
+    src/audio/spectrum.h \
+    src/audio/ao_base.h \
+    src/audio/ao_headless.h \
     src/opl/generator_realtime.h \
     src/opl/measurer.h \
+    src/opl/measurer_cache.h \
+    src/opl/envelope_model.h \
     src/opl/realtime/ring_buffer.h \
     src/opl/realtime/ring_buffer.tcc \
+    src/opl/realtime/semaphore.h \
+    src/opl/realtime/audio_tap.h \
+    src/opl/realtime/triple_buffer.h \
     src/piano.h \
     src/version.h
 
@@ -192,6 +221,8 @@ FORMS += \
     src/formats_sup.ui \
     src/importer.ui \
     src/audio_config.ui \
+    src/audio_diagnostics.ui \
+    src/audio_scope.ui \
     src/register_editor.ui
 
 RESOURCES += \
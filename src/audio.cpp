@@ -25,15 +25,31 @@
 #include "importer.h"
 #include "ui_importer.h"
 
+#include "main.h"
+
 #include <QtDebug>
+#include <QMessageBox>
 
 void BankEditor::initAudio()
 {
     qDebug() << "Init audioOut...";
-    m_audioOut = new AudioOutDefault(m_audioLatency * 1e-3, m_audioDevice.toStdString(), m_audioDriver.toStdString(), this);
+    //The audio output given in the command line is used for this session only
+    Application *app = Application::instance();
+    QString audioDriver = app->audioDriverOverride().isEmpty() ? m_audioDriver : app->audioDriverOverride();
+    QString audioDevice = app->audioDriverOverride().isEmpty() ? m_audioDevice : app->audioDeviceOverride();
+    //The chip family can change later, then the chips resample again
+    unsigned preferredRate = m_audioNativeRate ? opn2_getNativeRate(m_currentChipFamily) : 0;
+    bool lowLatency = m_audioLowLatency || app->lowLatencyOverride();
+    m_audioOut = AudioOutBase::create(m_audioLatency * 1e-3, audioDevice.toStdString(), audioDriver.toStdString(),
+                                      preferredRate, lowLatency, this);
+    if(!m_audioOut->errorText().empty())
+    {
+        QMessageBox::warning(this, tr("Error"),
+                             tr("%1\nThe sound is disabled.").arg(QString::fromStdString(m_audioOut->errorText())));
+    }
     qDebug() << "Init Generator...";
     std::shared_ptr<Generator> generator(
-        new Generator(uint32_t(m_audioOut->sampleRate()), m_currentChip));
+        new Generator(uint32_t(m_audioOut->sampleRate()), m_currentChip, m_chipsCount));
     qDebug() << "Init Rt-Generator...";
     RealtimeGenerator *rtgenerator = new RealtimeGenerator(generator, this);
     qDebug() << "Seting pointer of RT Generator...";
@@ -87,6 +103,12 @@ void BankEditor::initAudio()
 #endif
     connect(ui->volumeModel,  SIGNAL(currentIndexChanged(int)), m_generator,  SLOT(ctl_changeVolumeModel(int)));
 
+    //Bank images for the multi-timbral MIDI playback
+    m_bankSyncTimer.setSingleShot(true);
+    m_bankSyncTimer.setInterval(100);
+    connect(&m_bankSyncTimer, SIGNAL(timeout()), this, SLOT(syncGeneratorBank()));
+    syncGeneratorBank();
+
     //Generator's debug info
     connect(m_generator, SIGNAL(debugInfo(QString)), ui->debugBox, SLOT(setText(QString)));
     //Key pressed on piano bar
@@ -110,6 +132,8 @@ void BankEditor::initAudio()
     qDebug() << "Trying to start audio... (with dereferencing of RtGenerator!)";
     //Start generator!
     m_audioOut->start(*rtgenerator);
+    if(lowLatency)
+        QTimer::singleShot(1000, this, SLOT(checkLowLatencyStatus()));
 
 #ifdef ENABLE_MIDI
     qDebug() << "Trying to init MIDI-IN...";
@@ -117,6 +141,55 @@ void BankEditor::initAudio()
 #endif
 }
 
+void BankEditor::checkLowLatencyStatus()
+{
+    AudioOutBase::LowLatencyStatus status = m_audioOut->lowLatencyStatus();
+    if(status.scheduling != AudioOutBase::PRIVILEGE_DENIED &&
+       status.memoryLock != AudioOutBase::PRIVILEGE_DENIED)
+        return;
+
+    qWarning("%s", status.toText().c_str());
+    statusBar()->showMessage(tr("Low-latency audio mode is not fully available, "
+                                "see Settings - Audio diagnostics for details."), 10000);
+}
+
+void BankEditor::scheduleBankSync()
+{
+    m_bankSyncTimer.start();
+}
+
+void BankEditor::syncGeneratorBank()
+{
+    if(!m_generator)
+        return;
+    m_generator->ctl_changeBank(m_bank);
+}
+
+void BankEditor::syncGeneratorInstrument()
+{
+    if(!m_generator || !m_curInst)
+        return;
+
+    // the pending upload carries the edit, and the indices may have changed
+    if(m_bankSyncTimer.isActive())
+        return;
+
+    const int melodicCount = m_bank.countMelodic();
+    const int percussionCount = m_bank.countDrums();
+    if(m_curInst >= m_bank.Ins_Melodic && m_curInst < m_bank.Ins_Melodic + melodicCount)
+    {
+        int index = static_cast<int>(m_curInst - m_bank.Ins_Melodic);
+        m_generator->ctl_changeBankInstrument(index, *m_curInst, false);
+    }
+    else if(m_curInst >= m_bank.Ins_Percussion && m_curInst < m_bank.Ins_Percussion + percussionCount)
+    {
+        int index = melodicCount + static_cast<int>(m_curInst - m_bank.Ins_Percussion);
+        m_generator->ctl_changeBankInstrument(index, *m_curInst, true);
+    }
+    else
+        scheduleBankSync();
+}
+
 static int keyToNote(int k)
 {
     int note = -1;
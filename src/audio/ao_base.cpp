@@ -0,0 +1,191 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ao_base.h"
+#include "ao_headless.h"
+#ifdef ENABLE_AUDIO_TESTING
+#include "ao_rtaudio.h"
+#endif
+#include <cerrno>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define AO_HAS_PTHREAD_SCHEDULING
+#if defined(_POSIX_MEMLOCK) && (_POSIX_MEMLOCK > 0)
+#define AO_HAS_MLOCKALL
+#endif
+#endif
+
+const char *const AudioOutBase::nullDriverName = "null";
+const char *const AudioOutBase::fastDriverName = "fast";
+const char *const AudioOutBase::wavDriverName = "wav";
+
+AudioOutBase::AudioOutBase(bool low_latency, QObject *parent)
+    : QObject(parent),
+      m_lowLatency(low_latency),
+      m_scheduling(low_latency ? PRIVILEGE_PENDING : PRIVILEGE_NOT_REQUESTED),
+      m_memoryLock(low_latency ? PRIVILEGE_PENDING : PRIVILEGE_NOT_REQUESTED)
+{
+}
+
+AudioOutBase *AudioOutBase::create(double latency, const std::string &device_name, const std::string &driver_name, unsigned preferred_rate, bool low_latency, QObject *parent)
+{
+    if(driver_name == nullDriverName)
+        return new AudioOutHeadless(AudioOutHeadless::MODE_TIMED, latency, preferred_rate, low_latency, std::string(), parent);
+    if(driver_name == fastDriverName)
+        return new AudioOutHeadless(AudioOutHeadless::MODE_FAST, latency, preferred_rate, low_latency, std::string(), parent);
+    if(driver_name == wavDriverName)
+        return new AudioOutHeadless(AudioOutHeadless::MODE_TIMED, latency, preferred_rate, low_latency,
+                                    device_name.empty() ? std::string("output.wav") : device_name,
+                                    parent);
+#ifdef ENABLE_AUDIO_TESTING
+    AudioOutRt *rtOut = new AudioOutRt(latency, device_name, driver_name, preferred_rate, low_latency, parent);
+    if(rtOut->errorText().empty())
+        return rtOut;
+    // Keep running without sound, the caller reports the error
+    std::string errorText = rtOut->errorText();
+    delete rtOut;
+    AudioOutBase *nullOut = new AudioOutHeadless(AudioOutHeadless::MODE_TIMED, latency, preferred_rate, low_latency, std::string(), parent);
+    nullOut->m_errorText = errorText;
+    return nullOut;
+#else
+    return new AudioOutHeadless(AudioOutHeadless::MODE_TIMED, latency, preferred_rate, low_latency, std::string(), parent);
+#endif
+}
+
+std::vector<std::string> AudioOutBase::listDrivers()
+{
+    std::vector<std::string> drivers;
+#ifdef ENABLE_AUDIO_TESTING
+    drivers = AudioOutRt::listDrivers();
+#endif
+    drivers.push_back(nullDriverName);
+    drivers.push_back(fastDriverName);
+    drivers.push_back(wavDriverName);
+    return drivers;
+}
+
+AudioOutBase::LowLatencyStatus AudioOutBase::lowLatencyStatus() const
+{
+    LowLatencyStatus status;
+    status.scheduling = static_cast<Privilege>(m_scheduling.load(std::memory_order_acquire));
+    status.memoryLock = static_cast<Privilege>(m_memoryLock.load(std::memory_order_acquire));
+    if(status.memoryLock == PRIVILEGE_DENIED)
+        status.memoryLockError = m_memoryLockError;
+    return status;
+}
+
+std::string AudioOutBase::LowLatencyStatus::toText() const
+{
+    static const char *const names[] =
+    {
+        "not requested", "pending", "granted", "denied", "unsupported"
+    };
+
+    std::string text;
+    text += "Real-time scheduling: ";
+    text += names[scheduling];
+    text += "\nMemory locking:       ";
+    text += names[memoryLock];
+    text += '\n';
+
+    if(scheduling == PRIVILEGE_DENIED)
+        text += "\nThe audio thread runs with normal priority. Allow the user to use"
+                "\nreal-time priorities, for example with \"@audio - rtprio 95\" in"
+                "\n/etc/security/limits.conf, and membership in the audio group.\n";
+    if(memoryLock == PRIVILEGE_DENIED)
+    {
+        text += "\nThe memory can be paged out: " + memoryLockError;
+        text += "\nRaise the limit of locked memory, for example with"
+                "\n\"@audio - memlock unlimited\" in /etc/security/limits.conf.\n";
+    }
+
+    return text;
+}
+
+void AudioOutBase::prepareLowLatency()
+{
+    m_audioThreadEntered = false;
+    if(!m_lowLatency || m_memoryLock.load() != PRIVILEGE_PENDING)
+        return;
+
+#if defined(AO_HAS_MLOCKALL)
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        m_memoryLock.store(PRIVILEGE_GRANTED, std::memory_order_release);
+    else
+    {
+        m_memoryLockError = std::strerror(errno);
+        m_memoryLock.store(PRIVILEGE_DENIED, std::memory_order_release);
+    }
+#else
+    m_memoryLock.store(PRIVILEGE_UNSUPPORTED, std::memory_order_release);
+#endif
+}
+
+void AudioOutBase::enterAudioThread()
+{
+    m_audioThreadEntered = true;
+    if(!m_lowLatency)
+        return;
+
+    // fault the pages of the stack in now, rather than in the middle of rendering
+    const size_t stackPrefault = 64 * 1024;
+    volatile uint8_t stack[stackPrefault];
+    for(size_t i = 0; i < stackPrefault; i += 256)
+        stack[i] = 0;
+    (void)stack[0];
+
+#if defined(AO_HAS_PTHREAD_SCHEDULING)
+    int policy;
+    sched_param param;
+    if(pthread_getschedparam(pthread_self(), &policy, &param) == 0)
+    {
+        bool realtime = (policy == SCHED_FIFO || policy == SCHED_RR);
+        m_scheduling.store(realtime ? PRIVILEGE_GRANTED : PRIVILEGE_DENIED, std::memory_order_release);
+    }
+    else
+        m_scheduling.store(PRIVILEGE_UNSUPPORTED, std::memory_order_release);
+#else
+    // the drivers raise the priority by own means here
+    m_scheduling.store(PRIVILEGE_UNSUPPORTED, std::memory_order_release);
+#endif
+}
+
+void AudioOutBase::requestRealtimeScheduling()
+{
+    if(!m_lowLatency)
+        return;
+
+#if defined(AO_HAS_PTHREAD_SCHEDULING)
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    int minPriority = sched_get_priority_min(SCHED_FIFO);
+    int maxPriority = sched_get_priority_max(SCHED_FIFO);
+    param.sched_priority = realtimePriority;
+    if(param.sched_priority > maxPriority)
+        param.sched_priority = maxPriority;
+    if(param.sched_priority < minPriority)
+        param.sched_priority = minPriority;
+    // the failure is reported by enterAudioThread()
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
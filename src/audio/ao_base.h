@@ -0,0 +1,145 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AO_BASE_H
+#define AO_BASE_H
+
+#include <QObject>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "audio_stats.h"
+
+class IRealtimeProcess;
+
+/**
+ * @brief Audio output which pulls the frames from the realtime generator
+ */
+class AudioOutBase : public QObject
+{
+public:
+    explicit AudioOutBase(bool low_latency = false, QObject *parent = nullptr);
+    virtual ~AudioOutBase() {}
+
+    virtual unsigned sampleRate() const = 0;
+    virtual void start(IRealtimeProcess &rt) = 0;
+    virtual void stop() = 0;
+    virtual std::vector<std::string> listCompatibleDevices() = 0;
+
+    /**
+     * @brief Reason why the requested output could not be opened
+     * @return Empty string if the output was opened, else the output made by
+     *         create() renders in time without sound
+     */
+    const std::string &errorText() const
+        { return m_errorText; }
+
+    //! Timing statistics of the audio callback
+    AudioCallbackStats &stats()
+        { return m_stats; }
+
+    //! State of the privileges requested by the low-latency mode
+    enum Privilege
+    {
+        PRIVILEGE_NOT_REQUESTED,
+        //! Not known yet, the audio thread did not run
+        PRIVILEGE_PENDING,
+        PRIVILEGE_GRANTED,
+        PRIVILEGE_DENIED,
+        //! Not available on this platform or driver
+        PRIVILEGE_UNSUPPORTED
+    };
+
+    struct LowLatencyStatus
+    {
+        //! Real-time scheduling of the audio thread
+        Privilege scheduling = PRIVILEGE_NOT_REQUESTED;
+        //! Locking of the process memory against paging
+        Privilege memoryLock = PRIVILEGE_NOT_REQUESTED;
+        //! Reason of the failed memory locking
+        std::string memoryLockError;
+
+        std::string toText() const;
+    };
+
+    bool isLowLatency() const
+        { return m_lowLatency; }
+    LowLatencyStatus lowLatencyStatus() const;
+
+    /**
+     * @brief Create the output for the driver
+     * @param latency Desired latency in seconds
+     * @param device_name Name of device, or the path of the file for the "wav" driver
+     * @param driver_name Name of driver, one of listDrivers(), default if empty
+     * @param preferred_rate Native rate of the chip to try first, or 0 for the device default.
+     * A sound card is asked for it only when it lists it or an integer ratio of it
+     * @param low_latency Run the audio thread with real-time priority and lock the memory
+     * @param parent Parent object
+     * @return The audio output
+     */
+    static AudioOutBase *create(double latency,
+                                const std::string &device_name = std::string(),
+                                const std::string &driver_name = std::string(),
+                                unsigned preferred_rate = 0,
+                                bool low_latency = false,
+                                QObject *parent = nullptr);
+    //! Names of all drivers, the sound card drivers followed by the headless ones
+    static std::vector<std::string> listDrivers();
+
+    //! Driver rendering in time without output, for the machines without sound card
+    static const char *const nullDriverName;
+    //! Driver rendering as fast as possible, for measuring of throughput
+    static const char *const fastDriverName;
+    //! Driver rendering in time into a WAV file
+    static const char *const wavDriverName;
+
+protected:
+    //! Priority of the audio thread in the low-latency mode
+    enum { realtimePriority = 80 };
+
+    /**
+     * @brief Prepare the process for the low-latency mode, called before starting
+     * Locks the memory of the process, if the mode is enabled.
+     */
+    void prepareLowLatency();
+    /**
+     * @brief Called by the audio thread once, before it renders the first buffer
+     * Touches the pages of the stack, and checks the scheduling of the thread.
+     */
+    void enterAudioThread();
+    /**
+     * @brief Request real-time scheduling for the current thread
+     * For the outputs which create the audio thread by themselves.
+     */
+    void requestRealtimeScheduling();
+
+    AudioCallbackStats m_stats;
+    //! Reason of the failed opening, set by the constructor
+    std::string m_errorText;
+    //! Whether the audio thread has been prepared already, used by audio thread only
+    bool m_audioThreadEntered = false;
+
+private:
+    bool m_lowLatency;
+    std::atomic<int> m_scheduling;
+    std::atomic<int> m_memoryLock;
+    //! Reason of the failed memory locking, written before the stream starts
+    std::string m_memoryLockError;
+};
+
+#endif // AO_BASE_H
@@ -0,0 +1,128 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ao_headless.h"
+#include "../opl/generator_realtime.h"
+#include <QDebug>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+AudioOutHeadless::AudioOutHeadless(Mode mode, double latency, unsigned sample_rate, bool low_latency, const std::string &wav_path, QObject *parent)
+    : AudioOutBase(low_latency, parent), m_mode(mode), m_wavPath(wav_path), m_running(false)
+{
+    if(sample_rate != 0)
+        m_sampleRate = sample_rate;
+    m_bufferSize = (unsigned)std::ceil(latency * m_sampleRate);
+    if(m_bufferSize == 0)
+        m_bufferSize = 1;
+    qDebug() << "Headless audio output, rate" << m_sampleRate << "buffer size" << m_bufferSize;
+}
+
+AudioOutHeadless::~AudioOutHeadless()
+{
+    stop();
+}
+
+unsigned AudioOutHeadless::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+void AudioOutHeadless::start(IRealtimeProcess &rt)
+{
+    if(m_running)
+        return;
+
+    if(!m_wavPath.empty() && !m_wav.open(m_wavPath, m_sampleRate))
+        qWarning() << "Can't create the WAV file" << m_wavPath.c_str() << ", the output is discarded";
+
+    prepareLowLatency();
+    m_rt = &rt;
+    m_running = true;
+    m_thread = std::thread(&AudioOutHeadless::run, this);
+}
+
+void AudioOutHeadless::stop()
+{
+    if(!m_running)
+        return;
+
+    m_running = false;
+    m_thread.join();
+
+    if(m_wav.isOpen())
+    {
+        qDebug() << "Written" << (qulonglong)m_wav.framesWritten() << "frames into" << m_wavPath.c_str();
+        m_wav.close();
+    }
+}
+
+std::vector<std::string> AudioOutHeadless::listCompatibleDevices()
+{
+    return std::vector<std::string>();
+}
+
+void AudioOutHeadless::run()
+{
+    typedef std::chrono::steady_clock clock;
+
+    requestRealtimeScheduling();
+    enterAudioThread();
+
+    IRealtimeProcess &rt = *m_rt;
+    const unsigned nframes = m_bufferSize;
+    std::vector<int16_t> buffer(2 * nframes);
+
+    const std::chrono::nanoseconds period((uint64_t)nframes * 1000000000 / m_sampleRate);
+    const clock::time_point startTime = clock::now();
+    clock::time_point deadline = startTime;
+    uint64_t framesDone = 0;
+    bool late = false;
+
+    while(m_running.load(std::memory_order_relaxed))
+    {
+        uint64_t renderStart = AudioCallbackStats::clock();
+        rt.rt_generate(buffer.data(), nframes);
+        m_stats.record(AudioCallbackStats::clock() - renderStart, nframes, m_sampleRate, late);
+        framesDone += nframes;
+
+        if(m_wav.isOpen())
+            m_wav.write(buffer.data(), nframes);
+
+        if(m_mode == MODE_FAST)
+            continue;
+
+        // a sound card would have run out of data, start a new schedule
+        deadline += period;
+        clock::time_point now = clock::now();
+        late = now > deadline;
+        if(late)
+            deadline = now;
+        else
+            std::this_thread::sleep_until(deadline);
+    }
+
+    double elapsed = std::chrono::duration<double>(clock::now() - startTime).count();
+    if(elapsed > 0)
+    {
+        double seconds = (double)framesDone / m_sampleRate;
+        qDebug() << "Headless audio rendered" << seconds << "s in" << elapsed
+                 << "s, x" << (seconds / elapsed) << "of realtime";
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AO_HEADLESS_H
+#define AO_HEADLESS_H
+
+#include "ao_base.h"
+#include "wav_writer.h"
+#include <atomic>
+#include <thread>
+
+/**
+ * @brief Audio output without a sound card
+ *
+ * The frames are pulled by an own thread, either in time with the sample
+ * rate or as fast as possible. Optionally, they are written into a WAV file.
+ */
+class AudioOutHeadless : public AudioOutBase
+{
+public:
+    enum Mode
+    {
+        //! Pull a buffer once per its period, like a sound card does
+        MODE_TIMED,
+        //! Pull buffers without waiting
+        MODE_FAST
+    };
+
+    enum { defaultSampleRate = 44100 };
+
+    explicit AudioOutHeadless(Mode mode, double latency, unsigned sample_rate = 0,
+                              bool low_latency = false,
+                              const std::string &wav_path = std::string(),
+                              QObject *parent = nullptr);
+    ~AudioOutHeadless();
+
+    unsigned sampleRate() const override;
+    void start(IRealtimeProcess &rt) override;
+    void stop() override;
+    std::vector<std::string> listCompatibleDevices() override;
+
+private:
+    void run();
+
+    Mode m_mode;
+    unsigned m_sampleRate = defaultSampleRate;
+    unsigned m_bufferSize = 0;
+    std::string m_wavPath;
+    WavWriter m_wav;
+    IRealtimeProcess *m_rt = nullptr;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
+
+#endif // AO_HEADLESS_H
@@ -16,15 +16,38 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QApplication>
-#include <QMessageBox>
+#include <QCoreApplication>
 #include <QDebug>
 #include <cmath>
 #include "ao_rtaudio.h"
 #include "../opl/generator_realtime.h"
 
-AudioOutRt::AudioOutRt(double latency, const std::string &device_name, const std::string &driver_name, QObject *parent)
-    : QObject(parent)
+/**
+ * @brief Find the rate listed by the device which matches the native rate
+ * of the chip, or an integer ratio of it, within the tolerance of 0.1%
+ * @return The listed rate, or 0 if the device lists none
+ */
+static unsigned findNativeRatioRate(const std::vector<unsigned> &rates, unsigned nativeRate)
+{
+    enum { max_ratio = 4 };
+    for(unsigned ratio = 1; ratio <= max_ratio; ++ratio)
+    {
+        const unsigned targets[2] = {nativeRate * ratio, nativeRate / ratio};
+        for(unsigned target : targets)
+        {
+            for(unsigned rate : rates)
+            {
+                unsigned diff = (rate > target) ? (rate - target) : (target - rate);
+                if(diff * 1000 <= target)
+                    return rate;
+            }
+        }
+    }
+    return 0;
+}
+
+AudioOutRt::AudioOutRt(double latency, const std::string &device_name, const std::string &driver_name, unsigned preferred_rate, bool low_latency, QObject *parent)
+    : AudioOutBase(low_latency, parent)
 {
     RtAudio *audioOut = nullptr;
 
@@ -52,9 +75,7 @@ AudioOutRt::AudioOutRt(double latency, const std::string &device_name, const std
 
     unsigned num_audio_devices = audioOut->getDeviceCount();
     if (num_audio_devices == 0) {
-        QMessageBox::warning(
-            nullptr, tr("Error"), tr("No audio devices are present for output."));
-        qApp->exit(1);
+        m_errorText = "No audio devices are present for output.";
         return;
     }
 
@@ -90,31 +111,74 @@ AudioOutRt::AudioOutRt(double latency, const std::string &device_name, const std
     RtAudio::StreamOptions streamOpts;
     streamOpts.flags = RTAUDIO_ALSA_USE_DEFAULT;
     streamOpts.streamName = QCoreApplication::applicationName().toStdString();
+    if(low_latency)
+    {
+        streamOpts.flags |= RTAUDIO_SCHEDULE_REALTIME;
+        streamOpts.priority = realtimePriority;
+    }
 
-    unsigned bufferSize = std::ceil(latency * sampleRate);
     qDebug() << "Desired latency" << latency;
-    qDebug() << "Buffer size" << bufferSize;
 
-    audioOut->openStream(
-        &streamParam, nullptr, RTAUDIO_SINT16, sampleRate, &bufferSize,
-        &process, this, &streamOpts, &errorCallback);
+    // Only a listed rate is requested, otherwise the chips resample
+    unsigned nativeRate = 0;
+    if(preferred_rate != 0)
+        nativeRate = findNativeRatioRate(deviceInfo.sampleRates, preferred_rate);
+    if(nativeRate == 0 && preferred_rate != 0)
+        qDebug() << "The device lists no rate matching" << preferred_rate;
+
+    // Try the native rate first, the drivers are free to reject it
+    if(nativeRate != 0 && nativeRate != sampleRate)
+    {
+        unsigned bufferSize = std::ceil(latency * nativeRate);
+        try {
+            audioOut->openStream(
+                &streamParam, nullptr, RTAUDIO_SINT16, nativeRate, &bufferSize,
+                &process, this, &streamOpts, &errorCallback);
+            qDebug() << "Opened the stream at the native rate" << nativeRate;
+            qDebug() << "Buffer size" << bufferSize;
+        }
+        catch (RtAudioError &error) {
+            qWarning() << "Native rate" << nativeRate << "is not supported:" << error.what();
+        }
+    }
+
+    if(!audioOut->isStreamOpen())
+    {
+        unsigned bufferSize = std::ceil(latency * sampleRate);
+        qDebug() << "Buffer size" << bufferSize;
+        try {
+            audioOut->openStream(
+                &streamParam, nullptr, RTAUDIO_SINT16, sampleRate, &bufferSize,
+                &process, this, &streamOpts, &errorCallback);
+        }
+        catch (RtAudioError &error) {
+            m_errorText = "Failed to open the audio device: " + error.getMessage();
+            return;
+        }
+    }
+    m_sampleRate = audioOut->getStreamSampleRate();
 }
 
 unsigned AudioOutRt::sampleRate() const
 {
-    return m_audioOut->getStreamSampleRate();
+    return m_sampleRate;
 }
 
 void AudioOutRt::start(IRealtimeProcess &rt)
 {
+    if(!m_audioOut->isStreamOpen())
+        return;
     qDebug() << "Trying to start stream...";
     m_rt = &rt;
+    prepareLowLatency();
     m_audioOut->startStream();
     qDebug() << "Stream started!";
 }
 
 void AudioOutRt::stop()
 {
+    if(!m_audioOut->isStreamRunning())
+        return;
     m_audioOut->stopStream();
     qDebug() << "Stream stopped!";
 }
@@ -150,11 +214,17 @@ std::vector<std::string> AudioOutRt::listDrivers()
     return drivers;
 }
 
-int AudioOutRt::process(void *outputbuffer, void *, unsigned nframes, double, RtAudioStreamStatus, void *userdata)
+int AudioOutRt::process(void *outputbuffer, void *, unsigned nframes, double, RtAudioStreamStatus status, void *userdata)
 {
     AudioOutRt *self = (AudioOutRt *)userdata;
     IRealtimeProcess &rt = *self->m_rt;
+    if(!self->m_audioThreadEntered)
+        self->enterAudioThread();
+    uint64_t startTime = AudioCallbackStats::clock();
     rt.rt_generate((int16_t *)outputbuffer, nframes);
+    uint64_t renderTime = AudioCallbackStats::clock() - startTime;
+    self->m_stats.record(renderTime, nframes, self->m_sampleRate,
+                         (status & RTAUDIO_OUTPUT_UNDERFLOW) != 0);
     return 0;
 }
 
@@ -16,23 +16,23 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QObject>
 #include <RtAudio.h>
 #include <memory>
+#include "ao_base.h"
 
-class IRealtimeProcess;
-
-class AudioOutRt : public QObject
+class AudioOutRt : public AudioOutBase
 {
 public:
     explicit AudioOutRt(double latency,
                         const std::string &device_name = std::string(),
                         const std::string &driver_name = std::string(),
+                        unsigned preferred_rate = 0,
+                        bool low_latency = false,
                         QObject *parent = nullptr);
-    unsigned sampleRate() const;
-    void start(IRealtimeProcess &rt);
-    void stop();
-    std::vector<std::string> listCompatibleDevices();
+    unsigned sampleRate() const override;
+    void start(IRealtimeProcess &rt) override;
+    void stop() override;
+    std::vector<std::string> listCompatibleDevices() override;
     static std::vector<std::string> listDrivers();
 private:
     static int process(void *outputbuffer, void *, unsigned nframes, double, RtAudioStreamStatus, void *userdata);
@@ -40,4 +40,5 @@ private:
     static bool isCompatibleDevice(const RtAudio::DeviceInfo &info);
     IRealtimeProcess *m_rt = nullptr;
     std::unique_ptr<RtAudio> m_audioOut;
+    unsigned m_sampleRate = 0;
 };
@@ -7,6 +7,7 @@ HEADERS += \
     $$PWD/external/rtaudio/RtAudio.h
 
 INCLUDEPATH += $$PWD/external/rtaudio
+DEFINES += ENABLE_AUDIO_TESTING
 
 linux {
     DEFINES += __LINUX_ALSA__
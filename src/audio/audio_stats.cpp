@@ -0,0 +1,174 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio_stats.h"
+#include <chrono>
+#include <cstdio>
+
+AudioCallbackStats::AudioCallbackStats()
+    : m_resetRequest(false),
+      m_callbacks(0),
+      m_underflows(0),
+      m_totalRenderNs(0),
+      m_totalPeriodNs(0),
+      m_frames(0),
+      m_periodUs(0),
+      m_lastUs(0),
+      m_worstUs(0),
+      m_worstLoad(0)
+{
+    for(std::atomic<uint64_t> &bin : m_bins)
+        bin.store(0);
+}
+
+uint64_t AudioCallbackStats::clock()
+{
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void AudioCallbackStats::record(uint64_t renderNs, unsigned frames, unsigned rate, bool underflow)
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+
+    if(m_resetRequest.exchange(false))
+    {
+        m_callbacks.store(0, relaxed);
+        m_underflows.store(0, relaxed);
+        m_totalRenderNs.store(0, relaxed);
+        m_totalPeriodNs.store(0, relaxed);
+        m_worstUs.store(0, relaxed);
+        m_worstLoad.store(0, relaxed);
+        for(std::atomic<uint64_t> &bin : m_bins)
+            bin.store(0, relaxed);
+    }
+
+    if(rate == 0 || frames == 0)
+        return;
+
+    // only this thread writes, so plain load and store are enough
+    uint64_t periodNs = (uint64_t)frames * 1000000000 / rate;
+    uint32_t renderUs = (uint32_t)(renderNs / 1000);
+    uint32_t load = (uint32_t)(renderNs * 100 / periodNs);
+
+    m_callbacks.store(m_callbacks.load(relaxed) + 1, relaxed);
+    if(underflow)
+        m_underflows.store(m_underflows.load(relaxed) + 1, relaxed);
+    m_totalRenderNs.store(m_totalRenderNs.load(relaxed) + renderNs, relaxed);
+    m_totalPeriodNs.store(m_totalPeriodNs.load(relaxed) + periodNs, relaxed);
+    m_frames.store(frames, relaxed);
+    m_periodUs.store((uint32_t)(periodNs / 1000), relaxed);
+    m_lastUs.store(renderUs, relaxed);
+    if(renderUs > m_worstUs.load(relaxed))
+        m_worstUs.store(renderUs, relaxed);
+    if(load > m_worstLoad.load(relaxed))
+        m_worstLoad.store(load, relaxed);
+
+    unsigned bin = load / BIN_WIDTH;
+    if(bin >= BINS_COUNT)
+        bin = BINS_COUNT - 1;
+    m_bins[bin].store(m_bins[bin].load(relaxed) + 1, relaxed);
+}
+
+void AudioCallbackStats::snapshot(Snapshot &s) const
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+    s.callbacks = m_callbacks.load(relaxed);
+    s.underflows = m_underflows.load(relaxed);
+    s.frames = m_frames.load(relaxed);
+    s.periodUs = m_periodUs.load(relaxed);
+    s.lastUs = m_lastUs.load(relaxed);
+    s.worstUs = m_worstUs.load(relaxed);
+    s.worstLoad = m_worstLoad.load(relaxed);
+    uint64_t render = m_totalRenderNs.load(relaxed);
+    uint64_t period = m_totalPeriodNs.load(relaxed);
+    s.averageLoad = (period > 0) ? (100.0 * (double)render / (double)period) : 0.0;
+    for(unsigned i = 0; i < BINS_COUNT; ++i)
+        s.bins[i] = m_bins[i].load(relaxed);
+}
+
+std::string AudioCallbackStats::Snapshot::toText() const
+{
+    char line[256];
+    std::string text;
+
+    std::snprintf(line, sizeof(line),
+                  "Callbacks:    %llu\n"
+                  "Underflows:   %llu\n"
+                  "Buffer:       %u frames, %u us\n"
+                  "Render time:  last %u us, worst %u us\n"
+                  "Load:         average %.1f%%, worst %u%%\n\n",
+                  (unsigned long long)callbacks, (unsigned long long)underflows,
+                  frames, periodUs, lastUs, worstUs, averageLoad, worstLoad);
+    text += line;
+
+    uint64_t highest = 0;
+    for(unsigned i = 0; i < BINS_COUNT; ++i)
+        highest = (bins[i] > highest) ? bins[i] : highest;
+
+    // skip the empty tail of the histogram
+    unsigned last = 0;
+    for(unsigned i = 0; i < BINS_COUNT; ++i)
+        if(bins[i] > 0)
+            last = i;
+
+    for(unsigned i = 0; i <= last; ++i)
+    {
+        unsigned bar = highest ? (unsigned)(bins[i] * 40 / highest) : 0;
+        if(i + 1 < BINS_COUNT)
+            std::snprintf(line, sizeof(line), "%3u-%3u%% %10llu",
+                          i * BIN_WIDTH, (i + 1) * BIN_WIDTH, (unsigned long long)bins[i]);
+        else
+            std::snprintf(line, sizeof(line), "   >%3u%% %10llu",
+                          i * BIN_WIDTH, (unsigned long long)bins[i]);
+        text += line;
+        if(bar > 0)
+        {
+            text += ' ';
+            text.append(bar, '#');
+        }
+        text += '\n';
+    }
+
+    return text;
+}
+
+std::string AudioCallbackStats::Snapshot::toCsv() const
+{
+    char line[128];
+    std::string text = "load_from_percent,load_to_percent,callbacks\n";
+
+    for(unsigned i = 0; i < BINS_COUNT; ++i)
+    {
+        if(i + 1 < BINS_COUNT)
+            std::snprintf(line, sizeof(line), "%u,%u,%llu\n",
+                          i * BIN_WIDTH, (i + 1) * BIN_WIDTH, (unsigned long long)bins[i]);
+        else
+            std::snprintf(line, sizeof(line), "%u,,%llu\n",
+                          i * BIN_WIDTH, (unsigned long long)bins[i]);
+        text += line;
+    }
+
+    std::snprintf(line, sizeof(line),
+                  "\ncallbacks,%llu\nunderflows,%llu\nframes,%u\nperiod_us,%u\n"
+                  "worst_us,%u\nworst_load_percent,%u\naverage_load_percent,%.2f\n",
+                  (unsigned long long)callbacks, (unsigned long long)underflows,
+                  frames, periodUs, worstUs, worstLoad, averageLoad);
+    text += line;
+    return text;
+}
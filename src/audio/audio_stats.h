@@ -0,0 +1,100 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_STATS_H
+#define AUDIO_STATS_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * @brief Timing statistics of the audio callback
+ *
+ * Written by the audio thread only, without locks and allocations.
+ * The load is the time spent rendering relatively to the period of the
+ * buffer, it's collected into a histogram of 5% wide bins.
+ */
+class AudioCallbackStats
+{
+public:
+    enum
+    {
+        //! Width of the histogram bin in percents of the buffer period
+        BIN_WIDTH = 5,
+        //! Count of bins, the last one collects all loads above 200%
+        BINS_COUNT = 200 / BIN_WIDTH + 1
+    };
+
+    struct Snapshot
+    {
+        uint64_t callbacks = 0;
+        uint64_t underflows = 0;
+        //! Last buffer size and its period
+        uint32_t frames = 0;
+        uint32_t periodUs = 0;
+        //! Render time of the last callback and the longest one
+        uint32_t lastUs = 0;
+        uint32_t worstUs = 0;
+        //! Longest render time relatively to the period, in percents
+        uint32_t worstLoad = 0;
+        //! Average render time relatively to the period, in percents
+        double   averageLoad = 0.0;
+        uint64_t bins[BINS_COUNT] = {};
+
+        //! Human readable report
+        std::string toText() const;
+        //! Histogram in comma separated values, one line per bin
+        std::string toCsv() const;
+    };
+
+    AudioCallbackStats();
+
+    /**
+     * @brief Record the callback, called by the audio thread
+     * @param renderNs Time spent rendering in nanoseconds
+     * @param frames Count of frames rendered
+     * @param rate Sample rate
+     * @param underflow Whether the driver reported an underflow before this callback
+     */
+    void record(uint64_t renderNs, unsigned frames, unsigned rate, bool underflow);
+
+    //! Take the current values, may be called from any thread
+    void snapshot(Snapshot &s) const;
+    //! Ask the audio thread to clear everything on its next callback
+    void reset()
+        { m_resetRequest.store(true); }
+
+    //! Monotonic time in nanoseconds for measuring the callback
+    static uint64_t clock();
+
+private:
+    std::atomic<bool>     m_resetRequest;
+    std::atomic<uint64_t> m_callbacks;
+    std::atomic<uint64_t> m_underflows;
+    std::atomic<uint64_t> m_totalRenderNs;
+    std::atomic<uint64_t> m_totalPeriodNs;
+    std::atomic<uint32_t> m_frames;
+    std::atomic<uint32_t> m_periodUs;
+    std::atomic<uint32_t> m_lastUs;
+    std::atomic<uint32_t> m_worstUs;
+    std::atomic<uint32_t> m_worstLoad;
+    std::atomic<uint64_t> m_bins[BINS_COUNT];
+};
+
+#endif // AUDIO_STATS_H
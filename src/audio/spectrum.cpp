@@ -0,0 +1,81 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectrum.h"
+#include <cmath>
+
+SpectrumAnalyzer::SpectrumAnalyzer(size_t size)
+    : m_size(size),
+      m_window(size),
+      m_twiddle(size / 2),
+      m_reversed(size),
+      m_data(size)
+{
+    const double pi = 3.14159265358979323846;
+
+    for(size_t i = 0; i < size; ++i)
+        m_window[i] = (float)(0.5 - 0.5 * std::cos(2 * pi * i / size));
+
+    for(size_t i = 0; i < size / 2; ++i)
+        m_twiddle[i] = std::polar(1.0f, (float)(-2 * pi * i / size));
+
+    unsigned bits = 0;
+    while((size_t(1) << bits) < size)
+        ++bits;
+    for(size_t i = 0; i < size; ++i)
+    {
+        size_t r = 0;
+        for(unsigned b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        m_reversed[i] = r;
+    }
+}
+
+void SpectrumAnalyzer::compute(const float *input, float *output)
+{
+    for(size_t i = 0; i < m_size; ++i)
+        m_data[m_reversed[i]] = std::complex<float>(input[i] * m_window[i], 0.0f);
+
+    transform();
+
+    // the full scale sine gives the amplitude of size/4 with the Hann window
+    const float scale = 4.0f / m_size;
+    for(size_t i = 0, n = binsCount(); i < n; ++i)
+    {
+        float magnitude = std::abs(m_data[i]) * scale;
+        output[i] = 20.0f * std::log10(magnitude + 1e-9f);
+    }
+}
+
+void SpectrumAnalyzer::transform()
+{
+    std::complex<float> *data = m_data.data();
+    for(size_t half = 1; half < m_size; half *= 2)
+    {
+        const size_t step = m_size / (2 * half);
+        for(size_t block = 0; block < m_size; block += 2 * half)
+        {
+            for(size_t i = 0; i < half; ++i)
+            {
+                std::complex<float> odd = data[block + i + half] * m_twiddle[i * step];
+                data[block + i + half] = data[block + i] - odd;
+                data[block + i] += odd;
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <complex>
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief Magnitude spectrum of a block of samples
+ *
+ * Applies the Hann window and a radix-2 FFT of the size given, which must
+ * be a power of 2.
+ */
+class SpectrumAnalyzer
+{
+public:
+    explicit SpectrumAnalyzer(size_t size = 2048);
+
+    size_t size() const
+        { return m_size; }
+    //! Count of the frequency bins, from 0 to the half of the sample rate
+    size_t binsCount() const
+        { return m_size / 2 + 1; }
+
+    /**
+     * @brief Compute the spectrum
+     * @param input size() samples, normalized to -1..1
+     * @param output binsCount() levels in decibels relatively to the full scale sine
+     */
+    void compute(const float *input, float *output);
+
+private:
+    void transform();
+
+    size_t m_size;
+    std::vector<float> m_window;
+    std::vector<std::complex<float>> m_twiddle;
+    std::vector<size_t> m_reversed;
+    std::vector<std::complex<float>> m_data;
+};
+
+#endif // SPECTRUM_H
@@ -0,0 +1,132 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "wav_writer.h"
+
+static void putLE16(uint8_t *p, uint16_t v)
+{
+    p[0] = uint8_t(v & 0xFF);
+    p[1] = uint8_t((v >> 8) & 0xFF);
+}
+
+static void putLE32(uint8_t *p, uint32_t v)
+{
+    p[0] = uint8_t(v & 0xFF);
+    p[1] = uint8_t((v >> 8) & 0xFF);
+    p[2] = uint8_t((v >> 16) & 0xFF);
+    p[3] = uint8_t((v >> 24) & 0xFF);
+}
+
+WavWriter::WavWriter()
+{}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+bool WavWriter::open(const std::string &path, uint32_t sampleRate, uint16_t channels)
+{
+    close();
+
+    m_file = std::fopen(path.c_str(), "wb");
+    if(!m_file)
+        return false;
+
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_frames = 0;
+    m_failed = false;
+
+    if(!writeHeader(0))
+    {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool WavWriter::write(const int16_t *frames, size_t nframes)
+{
+    if(!m_file || m_failed)
+        return false;
+
+    const size_t count = nframes * m_channels;
+    size_t done = 0;
+    uint8_t buffer[4096];
+
+    // Always store as little-endian, independently from the host
+    while(done < count)
+    {
+        size_t chunk = count - done;
+        if(chunk > sizeof(buffer) / 2)
+            chunk = sizeof(buffer) / 2;
+        for(size_t i = 0; i < chunk; ++i)
+            putLE16(&buffer[2 * i], uint16_t(frames[done + i]));
+        if(std::fwrite(buffer, 2, chunk, m_file) != chunk)
+        {
+            m_failed = true;
+            return false;
+        }
+        done += chunk;
+    }
+
+    m_frames += nframes;
+    return true;
+}
+
+bool WavWriter::close()
+{
+    if(!m_file)
+        return true;
+
+    bool ok = !m_failed;
+    uint64_t dataSize = m_frames * m_channels * 2;
+    if(dataSize > 0xFFFFFFFFu - 36)
+        dataSize = 0xFFFFFFFFu - 36;
+
+    if(ok)
+        ok = (std::fseek(m_file, 0, SEEK_SET) == 0) && writeHeader(uint32_t(dataSize));
+    ok = (std::fclose(m_file) == 0) && ok;
+    m_file = nullptr;
+    return ok;
+}
+
+bool WavWriter::writeHeader(uint32_t dataSize)
+{
+    uint8_t header[44];
+    const uint16_t blockAlign = uint16_t(m_channels * 2);
+
+    header[0] = 'R'; header[1] = 'I'; header[2] = 'F'; header[3] = 'F';
+    putLE32(&header[4], 36 + dataSize);
+    header[8] = 'W'; header[9] = 'A'; header[10] = 'V'; header[11] = 'E';
+    header[12] = 'f'; header[13] = 'm'; header[14] = 't'; header[15] = ' ';
+    putLE32(&header[16], 16);
+    putLE16(&header[20], 1); // PCM
+    putLE16(&header[22], m_channels);
+    putLE32(&header[24], m_sampleRate);
+    putLE32(&header[28], m_sampleRate * blockAlign);
+    putLE16(&header[32], blockAlign);
+    putLE16(&header[34], 16);
+    header[36] = 'd'; header[37] = 'a'; header[38] = 't'; header[39] = 'a';
+    putLE32(&header[40], dataSize);
+
+    return std::fwrite(header, 1, sizeof(header), m_file) == sizeof(header);
+}
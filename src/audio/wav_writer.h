@@ -0,0 +1,74 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <cstdio>
+#include <string>
+#include <stdint.h>
+
+/**
+ * @brief Streaming writer of 16-bit PCM WAVE files
+ */
+class WavWriter
+{
+public:
+    WavWriter();
+    ~WavWriter();
+
+    /**
+     * @brief Create the file and write a provisional header
+     * @param path Path to the output file
+     * @param sampleRate Sample rate in Hertz
+     * @param channels Count of interleaved channels
+     * @return true on success
+     */
+    bool open(const std::string &path, uint32_t sampleRate, uint16_t channels = 2);
+    /**
+     * @brief Append interleaved frames to the file
+     * @param frames Interleaved samples
+     * @param nframes Count of frames
+     * @return true on success
+     */
+    bool write(const int16_t *frames, size_t nframes);
+    /**
+     * @brief Finalize the header and close the file
+     * @return true on success
+     */
+    bool close();
+
+    bool isOpen() const
+        { return m_file != nullptr; }
+    uint64_t framesWritten() const
+        { return m_frames; }
+
+private:
+    WavWriter(const WavWriter &);
+    WavWriter &operator=(const WavWriter &);
+
+    bool writeHeader(uint32_t dataSize);
+
+    std::FILE *m_file = nullptr;
+    uint32_t m_sampleRate = 0;
+    uint16_t m_channels = 0;
+    uint64_t m_frames = 0;
+    bool m_failed = false;
+};
+
+#endif // WAV_WRITER_H
@@ -20,8 +20,9 @@
 #include "ui_audio_config.h"
 #include "bank_editor.h"
 #include <QMenu>
+#include <QFileDialog>
 
-AudioConfigDialog::AudioConfigDialog(AudioOutRt *audioOut, QWidget *parent)
+AudioConfigDialog::AudioConfigDialog(AudioOutBase *audioOut, QWidget *parent)
     : QDialog(parent), m_audioOut(audioOut), m_ui(new Ui::AudioConfigDialog)
 {
     m_ui->setupUi(this);
@@ -73,6 +74,36 @@ void AudioConfigDialog::setDriverName(const QString &driverName)
     m_ui->ctlDriverNameEdit->setText(driverName);
 }
 
+unsigned AudioConfigDialog::chipsCount() const
+{
+    return static_cast<unsigned>(m_ui->ctlChipsCount->value());
+}
+
+void AudioConfigDialog::setChipsCount(unsigned count)
+{
+    m_ui->ctlChipsCount->setValue(static_cast<int>(count));
+}
+
+bool AudioConfigDialog::nativeRate() const
+{
+    return m_ui->ctlNativeRate->isChecked();
+}
+
+void AudioConfigDialog::setNativeRate(bool native)
+{
+    m_ui->ctlNativeRate->setChecked(native);
+}
+
+bool AudioConfigDialog::lowLatency() const
+{
+    return m_ui->ctlLowLatency->isChecked();
+}
+
+void AudioConfigDialog::setLowLatency(bool lowLatency)
+{
+    m_ui->ctlLowLatency->setChecked(lowLatency);
+}
+
 void AudioConfigDialog::on_ctlLatency_valueChanged(int value)
 {
     m_ui->ctlLatencyEdit->setText(QString::number(value));
@@ -84,8 +115,23 @@ void AudioConfigDialog::on_ctlLatencyEdit_editingFinished()
     m_ui->ctlLatencyEdit->setText(QString::number(m_ui->ctlLatency->value()));
 }
 
+bool AudioConfigDialog::isFileDriver() const
+{
+    return m_ui->ctlDriverNameEdit->text() == QLatin1String(AudioOutBase::wavDriverName);
+}
+
 void AudioConfigDialog::on_btnChooseDevice_clicked()
 {
+    if(isFileDriver())
+    {
+        QString file = QFileDialog::getSaveFileName(this, tr("Write the output into WAV file"),
+                                                    m_ui->ctlDeviceNameEdit->text(),
+                                                    tr("WAV files (*.wav)"));
+        if(!file.isEmpty())
+            m_ui->ctlDeviceNameEdit->setText(file);
+        return;
+    }
+
     QToolButton *button = m_ui->btnChooseDevice;
     QMenu menu;
     QAction *action;
@@ -116,7 +162,7 @@ void AudioConfigDialog::on_btnChooseDriver_clicked()
     QMenu menu;
     QAction *action;
 
-    std::vector<std::string> drivers = m_audioOut->listDrivers();
+    std::vector<std::string> drivers = AudioOutBase::listDrivers();
 
     action = menu.addAction(tr("Default driver"));
 
@@ -132,5 +178,7 @@ void AudioConfigDialog::on_btnChooseDriver_clicked()
     if (choice) {
         QString driver = choice->data().toString();
         m_ui->ctlDriverNameEdit->setText(driver);
+        // devices of the previous driver make no sense anymore
+        m_ui->ctlDeviceNameEdit->clear();
     }
 }
@@ -22,14 +22,14 @@
 #include <QDialog>
 #include <memory>
 namespace Ui { class AudioConfigDialog; }
-class AudioOutRt;
+class AudioOutBase;
 
 class AudioConfigDialog : public QDialog
 {
     Q_OBJECT
 
 public:
-    explicit AudioConfigDialog(AudioOutRt *audioOut, QWidget *parent = nullptr);
+    explicit AudioConfigDialog(AudioOutBase *audioOut, QWidget *parent = nullptr);
     ~AudioConfigDialog();
 
     double latency() const;
@@ -40,8 +40,20 @@ public:
 
     QString driverName() const;
     void setDriverName(const QString &driverName);
+
+    unsigned chipsCount() const;
+    void setChipsCount(unsigned count);
+
+    bool nativeRate() const;
+    void setNativeRate(bool native);
+
+    bool lowLatency() const;
+    void setLowLatency(bool lowLatency);
 private:
-    AudioOutRt *m_audioOut = nullptr;
+    //! Whether the chosen driver writes into a file instead of a device
+    bool isFileDriver() const;
+
+    AudioOutBase *m_audioOut = nullptr;
     std::unique_ptr<Ui::AudioConfigDialog> m_ui;
 
 private slots:
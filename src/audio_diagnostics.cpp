@@ -0,0 +1,87 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio_diagnostics.h"
+#include "ui_audio_diagnostics.h"
+#include "audio/ao_base.h"
+#include <QFileDialog>
+#include <QFile>
+#include <QMessageBox>
+#include <QFontDatabase>
+
+AudioDiagnosticsDialog::AudioDiagnosticsDialog(AudioOutBase *audioOut, QWidget *parent)
+    : QDialog(parent), m_audioOut(audioOut), m_ui(new Ui::AudioDiagnosticsDialog)
+{
+    m_ui->setupUi(this);
+    m_ui->report->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    m_ui->btnReset->setEnabled(m_audioOut != nullptr);
+    m_ui->btnSaveCsv->setEnabled(m_audioOut != nullptr);
+
+    connect(&m_refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    m_refreshTimer.start(250);
+    refresh();
+}
+
+AudioDiagnosticsDialog::~AudioDiagnosticsDialog()
+{
+}
+
+void AudioDiagnosticsDialog::refresh()
+{
+    if(!m_audioOut)
+    {
+        m_ui->report->setPlainText(tr("Audio output is not running."));
+        return;
+    }
+
+    AudioCallbackStats::Snapshot s;
+    m_audioOut->stats().snapshot(s);
+    std::string text = s.toText();
+    if(m_audioOut->isLowLatency())
+        text = m_audioOut->lowLatencyStatus().toText() + "\n" + text;
+    m_ui->report->setPlainText(QString::fromStdString(text));
+}
+
+void AudioDiagnosticsDialog::on_btnReset_clicked()
+{
+    if(m_audioOut)
+        m_audioOut->stats().reset();
+}
+
+void AudioDiagnosticsDialog::on_btnSaveCsv_clicked()
+{
+    if(!m_audioOut)
+        return;
+
+    QString fileToSave = QFileDialog::getSaveFileName(this, tr("Save audio timing statistics"),
+                                                      QString(), tr("CSV files (*.csv)"));
+    if(fileToSave.isEmpty())
+        return;
+
+    AudioCallbackStats::Snapshot s;
+    m_audioOut->stats().snapshot(s);
+    std::string csv = s.toCsv();
+
+    QFile file(fileToSave);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text) ||
+       file.write(csv.data(), (qint64)csv.size()) != (qint64)csv.size())
+    {
+        QMessageBox::warning(this, tr("Can't save file"),
+                             tr("Can't save the file %1: %2").arg(fileToSave).arg(file.errorString()));
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_DIAGNOSTICS_H
+#define AUDIO_DIAGNOSTICS_H
+
+#include <QDialog>
+#include <QTimer>
+#include <memory>
+namespace Ui { class AudioDiagnosticsDialog; }
+class AudioOutBase;
+
+/**
+ * @brief Shows the timing of the audio callback while the dialog is open
+ */
+class AudioDiagnosticsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit AudioDiagnosticsDialog(AudioOutBase *audioOut, QWidget *parent = nullptr);
+    ~AudioDiagnosticsDialog();
+
+private:
+    AudioOutBase *m_audioOut = nullptr;
+    std::unique_ptr<Ui::AudioDiagnosticsDialog> m_ui;
+    QTimer m_refreshTimer;
+
+private slots:
+    void refresh();
+    void on_btnReset_clicked();
+    void on_btnSaveCsv_clicked();
+};
+
+#endif // AUDIO_DIAGNOSTICS_H
@@ -0,0 +1,213 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio_scope.h"
+#include "ui_audio_scope.h"
+#include "opl/realtime/audio_tap.h"
+#include <QPainter>
+#include <cmath>
+
+//! Frames shown by the oscilloscope, about 23 ms at 44100 Hz
+static const size_t waveformFrames = 1024;
+//! Size of the FFT, it's also the count of frames analyzed
+static const size_t spectrumFrames = 2048;
+//! Lowest frequency and level shown by the spectrum
+static const double spectrumMinFreq = 20.0;
+static const float  spectrumMinLevel = -96.0f;
+
+AudioScope::AudioScope(QWidget *parent)
+    : QFrame(parent),
+      m_frames(2 * spectrumFrames),
+      m_samples(spectrumFrames),
+      m_spectrum(spectrumFrames)
+{
+    m_levels.resize(m_spectrum.binsCount());
+    m_timer.setInterval(33);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(pull()));
+    setMinimumSize(320, 160);
+}
+
+AudioScope::~AudioScope()
+{}
+
+void AudioScope::setTap(const Audio_Tap *tap, unsigned sampleRate)
+{
+    m_tap = tap;
+    m_sampleRate = sampleRate ? sampleRate : 44100;
+}
+
+void AudioScope::setMode(int mode)
+{
+    m_mode = mode;
+    update();
+}
+
+void AudioScope::setChannels(int channels)
+{
+    m_channels = channels;
+    update();
+}
+
+void AudioScope::showEvent(QShowEvent *evt)
+{
+    m_timer.start();
+    QFrame::showEvent(evt);
+}
+
+void AudioScope::hideEvent(QHideEvent *evt)
+{
+    m_timer.stop();
+    QFrame::hideEvent(evt);
+}
+
+void AudioScope::pull()
+{
+    if(!m_tap)
+        return;
+    size_t wanted = (m_mode == MODE_SPECTRUM) ? spectrumFrames : waveformFrames;
+    m_framesCount = m_tap->read_latest(m_frames.data(), wanted);
+    update();
+}
+
+void AudioScope::extractChannel(int channel, float *output, size_t count) const
+{
+    const int16_t *frames = m_frames.data();
+    const size_t available = m_framesCount;
+    const size_t missing = (count > available) ? (count - available) : 0;
+
+    // the missing frames are at the beginning, the latest ones are kept at the end
+    for(size_t i = 0; i < missing; ++i)
+        output[i] = 0.0f;
+    for(size_t i = missing; i < count; ++i)
+    {
+        const int16_t *frame = &frames[2 * (i - missing)];
+        float sample;
+        if(channel == CHANNELS_LEFT)
+            sample = frame[0];
+        else if(channel == CHANNELS_RIGHT)
+            sample = frame[1];
+        else
+            sample = 0.5f * ((float)frame[0] + (float)frame[1]);
+        output[i] = sample * (1.0f / 32768.0f);
+    }
+}
+
+void AudioScope::paintEvent(QPaintEvent *evt)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+
+    QPen grid(QColor(60, 60, 60));
+    painter.setPen(grid);
+    painter.drawLine(0, height() / 2, width(), height() / 2);
+
+    const QColor colors[2] = {QColor(80, 255, 80), QColor(255, 200, 40)};
+    int channels[2] = {m_channels, -1};
+    if(m_channels == CHANNELS_BOTH)
+    {
+        channels[0] = CHANNELS_LEFT;
+        channels[1] = CHANNELS_RIGHT;
+    }
+
+    const size_t count = (m_mode == MODE_SPECTRUM) ? spectrumFrames : waveformFrames;
+    for(unsigned c = 0; c < 2 && channels[c] != -1; ++c)
+    {
+        extractChannel(channels[c], m_samples.data(), count);
+        if(m_mode == MODE_SPECTRUM)
+            paintSpectrum(painter, m_samples.data(), colors[c]);
+        else
+            paintWaveform(painter, m_samples.data(), count, colors[c]);
+    }
+
+    QFrame::paintEvent(evt);
+}
+
+void AudioScope::paintWaveform(QPainter &painter, const float *samples, size_t count, const QColor &color)
+{
+    const int w = width();
+    const int h = height();
+    painter.setPen(color);
+
+    // decimate to one vertical line per pixel column, from minimum to maximum
+    for(int x = 0; x < w; ++x)
+    {
+        size_t begin = (size_t)x * count / (size_t)w;
+        size_t end = (size_t)(x + 1) * count / (size_t)w;
+        if(end <= begin)
+            end = begin + 1;
+        if(end > count)
+            end = count;
+        float low = samples[begin], high = samples[begin];
+        for(size_t i = begin + 1; i < end; ++i)
+        {
+            low = std::min(low, samples[i]);
+            high = std::max(high, samples[i]);
+        }
+        int y1 = (int)((1.0f - high) * 0.5f * (h - 1));
+        int y2 = (int)((1.0f - low) * 0.5f * (h - 1));
+        painter.drawLine(x, y1, x, y2);
+    }
+}
+
+void AudioScope::paintSpectrum(QPainter &painter, const float *samples, const QColor &color)
+{
+    const int w = width();
+    const int h = height();
+    const size_t bins = m_spectrum.binsCount();
+    const double nyquist = m_sampleRate / 2.0;
+    const double logMin = std::log(spectrumMinFreq);
+    const double logRange = std::log(nyquist) - logMin;
+
+    m_spectrum.compute(samples, m_levels.data());
+    painter.setPen(color);
+
+    // logarithmic frequency axis, the loudest bin of each pixel column is shown
+    QPoint previous;
+    for(int x = 0; x < w; ++x)
+    {
+        double f1 = std::exp(logMin + logRange * x / w);
+        double f2 = std::exp(logMin + logRange * (x + 1) / w);
+        size_t begin = (size_t)(f1 / nyquist * (bins - 1));
+        size_t end = (size_t)(f2 / nyquist * (bins - 1)) + 1;
+        if(end > bins)
+            end = bins;
+        float level = spectrumMinLevel;
+        for(size_t i = begin; i < end; ++i)
+            level = std::max(level, m_levels[i]);
+        if(level > 0.0f)
+            level = 0.0f;
+        int y = (int)(level / spectrumMinLevel * (h - 1));
+        QPoint point(x, y);
+        if(x > 0)
+            painter.drawLine(previous, point);
+        previous = point;
+    }
+}
+
+AudioScopeDialog::AudioScopeDialog(const Audio_Tap *tap, unsigned sampleRate, QWidget *parent)
+    : QDialog(parent), m_ui(new Ui::AudioScopeDialog)
+{
+    m_ui->setupUi(this);
+    m_ui->scope->setTap(tap, sampleRate);
+    connect(m_ui->ctlMode, SIGNAL(currentIndexChanged(int)), m_ui->scope, SLOT(setMode(int)));
+    connect(m_ui->ctlChannels, SIGNAL(currentIndexChanged(int)), m_ui->scope, SLOT(setChannels(int)));
+}
+
+AudioScopeDialog::~AudioScopeDialog()
+{
+}
@@ -0,0 +1,108 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_SCOPE_H
+#define AUDIO_SCOPE_H
+
+#include <QDialog>
+#include <QFrame>
+#include <QTimer>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include "audio/spectrum.h"
+
+namespace Ui { class AudioScopeDialog; }
+class Audio_Tap;
+
+/**
+ * @brief Oscilloscope and spectrum of the live output
+ *
+ * Pulls the latest frames from the audio tap at the display rate,
+ * the audio thread is never waited for.
+ */
+class AudioScope : public QFrame
+{
+    Q_OBJECT
+
+public:
+    enum Mode
+    {
+        MODE_WAVEFORM = 0,
+        MODE_SPECTRUM
+    };
+    enum Channels
+    {
+        CHANNELS_MIX = 0,
+        CHANNELS_LEFT,
+        CHANNELS_RIGHT,
+        CHANNELS_BOTH
+    };
+
+    explicit AudioScope(QWidget *parent = nullptr);
+    ~AudioScope();
+
+    void setTap(const Audio_Tap *tap, unsigned sampleRate);
+
+public slots:
+    void setMode(int mode);
+    void setChannels(int channels);
+
+protected:
+    void paintEvent(QPaintEvent *evt) override;
+    void showEvent(QShowEvent *evt) override;
+    void hideEvent(QHideEvent *evt) override;
+
+private slots:
+    void pull();
+
+private:
+    //! Take the channel of the frames, or the mix of both, normalized to -1..1
+    void extractChannel(int channel, float *output, size_t count) const;
+    void paintWaveform(QPainter &painter, const float *samples, size_t count, const QColor &color);
+    void paintSpectrum(QPainter &painter, const float *samples, const QColor &color);
+
+    const Audio_Tap *m_tap = nullptr;
+    unsigned m_sampleRate = 44100;
+    int m_mode = MODE_WAVEFORM;
+    int m_channels = CHANNELS_MIX;
+    QTimer m_timer;
+    //! Latest interleaved stereo frames
+    std::vector<int16_t> m_frames;
+    size_t m_framesCount = 0;
+    std::vector<float> m_samples;
+    std::vector<float> m_levels;
+    SpectrumAnalyzer m_spectrum;
+};
+
+/**
+ * @brief Window with the scope of the live output
+ */
+class AudioScopeDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit AudioScopeDialog(const Audio_Tap *tap, unsigned sampleRate, QWidget *parent = nullptr);
+    ~AudioScopeDialog();
+
+private:
+    std::unique_ptr<Ui::AudioScopeDialog> m_ui;
+};
+
+#endif // AUDIO_SCOPE_H
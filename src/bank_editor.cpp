@@ -33,6 +33,8 @@
 #include "operator_editor.h"
 #include "bank_comparison.h"
 #include "audio_config.h"
+#include "audio_diagnostics.h"
+#include "audio_scope.h"
 #include "ins_names.h"
 #include "main.h"
 #if defined(ENABLE_PLOTS)
@@ -234,12 +236,20 @@ void BankEditor::loadSettings()
     m_audioLatency = setup.value("audio-latency", audioDefaultLatency).toDouble();
     m_audioDevice = setup.value("audio-device", QString()).toString();
     m_audioDriver = setup.value("audio-driver", QString()).toString();
+    m_chipsCount = setup.value("chips-count", chipsDefaultCount).toUInt();
+    m_audioNativeRate = setup.value("audio-native-rate", false).toBool();
+    m_audioLowLatency = setup.value("audio-low-latency", false).toBool();
 
     if (m_audioLatency < audioMinimumLatency)
         m_audioLatency = audioMinimumLatency;
     else if (m_audioLatency > audioMaximumLatency)
         m_audioLatency = audioMaximumLatency;
 
+    if (m_chipsCount < 1)
+        m_chipsCount = 1;
+    else if (m_chipsCount > chipsMaximumCount)
+        m_chipsCount = chipsMaximumCount;
+
     ui->actionEmulatorNuked->setChecked(false);
     ui->actionEmulatorMame->setChecked(false);
     ui->actionEmulatorGens->setChecked(false);
@@ -308,6 +318,9 @@ void BankEditor::saveSettings()
     setup.setValue("audio-latency", m_audioLatency);
     setup.setValue("audio-device", m_audioDevice);
     setup.setValue("audio-driver", m_audioDriver);
+    setup.setValue("chips-count", m_chipsCount);
+    setup.setValue("audio-native-rate", m_audioNativeRate);
+    setup.setValue("audio-low-latency", m_audioLowLatency);
     setup.setValue("text-conversion-format", QString::fromStdString(m_textconvFormat->name()));
 
     int preferredMidiStandard = 3;
@@ -1208,6 +1221,7 @@ void BankEditor::sendPatch()
     if(!m_curInst) return;
     if(!m_generator) return;
     m_generator->ctl_changePatch(*m_curInst, ui->percussion->isChecked());
+    syncGeneratorInstrument();
 }
 
 void BankEditor::setDrumMode(bool dmode)
@@ -1236,6 +1250,7 @@ bool BankEditor::isDrumsMode() const
 
 void BankEditor::reloadBanks()
 {
+    scheduleBankSync();
     ui->bank_no->clear();
     int countOfBanks = 1;
     bool isDrum = isDrumsMode();
@@ -1342,14 +1357,36 @@ void BankEditor::on_actionAudioConfig_triggered()
     dlg.setLatency(m_audioLatency);
     dlg.setDeviceName(m_audioDevice);
     dlg.setDriverName(m_audioDriver);
+    dlg.setChipsCount(m_chipsCount);
+    dlg.setNativeRate(m_audioNativeRate);
+    dlg.setLowLatency(m_audioLowLatency);
     if(dlg.exec() == QDialog::Accepted)
     {
         m_audioLatency = dlg.latency();
         m_audioDevice = dlg.deviceName();
         m_audioDriver = dlg.driverName();
+        m_chipsCount = dlg.chipsCount();
+        m_audioNativeRate = dlg.nativeRate();
+        m_audioLowLatency = dlg.lowLatency();
     }
 }
 
+void BankEditor::on_actionAudioDiagnostics_triggered()
+{
+    AudioDiagnosticsDialog dlg(m_audioOut, this);
+    dlg.exec();
+}
+
+void BankEditor::on_actionAudioScope_triggered()
+{
+    if(!m_generator || !m_audioOut)
+        return;
+    //Not modal, to watch the output while playing
+    AudioScopeDialog *dlg = new AudioScopeDialog(m_generator->audioTap(), m_audioOut->sampleRate(), this);
+    dlg->setAttribute(Qt::WA_DeleteOnClose);
+    dlg->show();
+}
+
 void BankEditor::onActionLanguageTriggered()
 {
     QAction *act = static_cast<QAction *>(sender());
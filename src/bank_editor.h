@@ -27,7 +27,7 @@
 #include "opl/generator.h"
 #include "opl/generator_realtime.h"
 #include "opl/measurer.h"
-#include "audio/ao_rtaudio.h"
+#include "audio/ao_base.h"
 #include "midi/midi_rtmidi.h"
 
 #include "FileFormats/ffmt_base.h"
@@ -76,6 +76,12 @@ private:
     QString m_audioDevice;
     //! Name of the audio driver
     QString m_audioDriver;
+    //! Count of emulated chips
+    unsigned m_chipsCount;
+    //! Open the audio device at the native rate of the chip
+    bool m_audioNativeRate;
+    //! Real-time priority of the audio thread, and locked memory
+    bool m_audioLowLatency;
 
 public:
     //! Audio latency constants (ms)
@@ -85,6 +91,12 @@ public:
         audioDefaultLatency = 20,
         audioMaximumLatency = 100,
     };
+    //! Count of emulated chips constants
+    enum
+    {
+        chipsDefaultCount = 1,
+        chipsMaximumCount = MAX_OPN_CHIPS,
+    };
 
 private:
     //! Currently loaded FM bank
@@ -110,6 +122,8 @@ private:
 
     //! OPL chip emulator frontent
     IRealtimeControl *m_generator = nullptr;
+    //! Delays the upload of the bank images into generator while bank is edited
+    QTimer           m_bankSyncTimer;
 
     //! Sound length measurer
     Measurer        *m_measurer;
@@ -121,8 +135,7 @@ private:
     InstFormats     m_recentInstFormat;
 
     /* ********** Audio output stuff ********** */
-    typedef AudioOutRt AudioOutDefault;
-    AudioOutDefault *m_audioOut = nullptr;
+    AudioOutBase    *m_audioOut = nullptr;
 
     /* ********** MIDI input stuff ********** */
     #ifdef ENABLE_MIDI
@@ -268,6 +281,16 @@ public:
      */
     void sendPatch();
 
+    /**
+     * @brief Request the upload of the whole bank to the generator for the MIDI playback
+     */
+    void scheduleBankSync();
+
+    /**
+     * @brief Upload the current instrument into the bank of the generator for the MIDI playback
+     */
+    void syncGeneratorInstrument();
+
     /**
      * @brief Disable/Enable melodic specific GUI controlls which are useless while editing of percussion instrument
      * @param dmode if true, most of melodic specific controlls (such as piano, note selector and chords) are will be disabled
@@ -330,6 +353,16 @@ private slots:
      */
     void toggleEmulator();
 
+    /**
+     * @brief Upload the whole bank to the generator for the MIDI playback
+     */
+    void syncGeneratorBank();
+
+    /**
+     * @brief Tell if the privileges of the low-latency audio mode were denied
+     */
+    void checkLowLatencyStatus();
+
     /**
      * @brief Clear all buffers and begin a new bank
      */
@@ -468,6 +501,14 @@ private slots:
      * @brief Opens the audio configuration dialog
      */
     void on_actionAudioConfig_triggered();
+    /**
+     * @brief Opens the audio callback timing statistics
+     */
+    void on_actionAudioDiagnostics_triggered();
+    /**
+     * @brief Opens the oscilloscope and spectrum of the output
+     */
+    void on_actionAudioScope_triggered();
     /**
      * @brief Changes the current language
      */
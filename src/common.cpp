@@ -21,10 +21,6 @@
 
 #include "common.h"
 
-#if defined(IS_QT_4) || defined(QT_GUI_LIB)
-#include <QMessageBox>
-#endif
-
 qint64 readLE(QFile &file, uint16_t &out)
 {
     uint8_t bytes[2] = {0, 0};
@@ -181,23 +177,3 @@ bool hasExt(const QString &file, const char *ext)
     return file.endsWith(ext, Qt::CaseInsensitive);
 }
 
-
-#if defined(IS_QT_4) || defined(QT_GUI_LIB)
-void ErrMessageO(QWidget *parent, QString errStr, bool isBank)
-{
-    QString ftype = isBank ? QObject::tr("bank") : QObject::tr("instrument");
-    QMessageBox::warning(parent,
-                         QObject::tr("Can't open %1 file!").arg(ftype),
-                         QObject::tr("Can't open %1 file because %2.").arg(ftype).arg(errStr),
-                         QMessageBox::Ok);
-}
-
-void ErrMessageS(QWidget *parent, QString errStr, bool isBank)
-{
-    QString ftype = isBank ? QObject::tr("bank") : QObject::tr("instrument");
-    QMessageBox::warning(parent,
-                         QObject::tr("Can't save %1 file!").arg(ftype),
-                         QObject::tr("Can't save %1 file because %2.").arg(ftype).arg(errStr),
-                         QMessageBox::Ok);
-}
-#endif
@@ -0,0 +1,38 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include <QMessageBox>
+
+void ErrMessageO(QWidget *parent, QString errStr, bool isBank)
+{
+    QString ftype = isBank ? QObject::tr("bank") : QObject::tr("instrument");
+    QMessageBox::warning(parent,
+                         QObject::tr("Can't open %1 file!").arg(ftype),
+                         QObject::tr("Can't open %1 file because %2.").arg(ftype).arg(errStr),
+                         QMessageBox::Ok);
+}
+
+void ErrMessageS(QWidget *parent, QString errStr, bool isBank)
+{
+    QString ftype = isBank ? QObject::tr("bank") : QObject::tr("instrument");
+    QMessageBox::warning(parent,
+                         QObject::tr("Can't save %1 file!").arg(ftype),
+                         QObject::tr("Can't save %1 file because %2.").arg(ftype).arg(errStr),
+                         QMessageBox::Ok);
+}
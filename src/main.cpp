@@ -33,12 +33,13 @@ int main(int argc, char *argv[])
     a.setStyle(new BankEditor_ProxyStyle(a.style()));
 #endif
 
+    QString fileToOpen = a.parseArguments();
+
     BankEditor w;
     w.show();
 
-    QStringList args = a.arguments();
-    if(args.size()>1)
-        w.openOrImportFile(args[1]);
+    if(!fileToOpen.isEmpty())
+        w.openOrImportFile(fileToOpen);
 
     return a.exec();
 }
@@ -64,6 +65,29 @@ void Application::translate(const QString &language)
     m_appTranslator.load("opn2bankeditor_" + language, appTranslationDir);
 }
 
+QString Application::parseArguments()
+{
+    QStringList args = arguments();
+    QString fileToOpen;
+
+    for(int i = 1; i < args.size(); ++i)
+    {
+        const QString &arg = args[i];
+        if(arg == "--audio-driver" && i + 1 < args.size())
+            m_audioDriverOverride = args[++i];
+        else if(arg == "--audio-device" && i + 1 < args.size())
+            m_audioDeviceOverride = args[++i];
+        else if(arg == "--low-latency")
+            m_lowLatencyOverride = true;
+        else if(arg.startsWith("--"))
+            qWarning() << "Unknown argument" << arg;
+        else if(fileToOpen.isEmpty())
+            fileToOpen = arg;
+    }
+
+    return fileToOpen;
+}
+
 QString Application::getQtTranslationDir() const
 {
 #if defined(Q_OS_WIN)
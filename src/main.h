@@ -32,10 +32,28 @@ public:
     QString getQtTranslationDir() const;
     QString getAppTranslationDir() const;
 
+    /**
+     * @brief Parse the command line options
+     * @return Path of the file to open, or empty
+     */
+    QString parseArguments();
+    //! Audio driver given by the command line, overrides the configured one
+    const QString &audioDriverOverride() const
+        { return m_audioDriverOverride; }
+    //! Audio device given by the command line
+    const QString &audioDeviceOverride() const
+        { return m_audioDeviceOverride; }
+    //! Low-latency audio mode requested by the command line
+    bool lowLatencyOverride() const
+        { return m_lowLatencyOverride; }
+
 public slots:
     void translate(const QString &language = QString());
 
 private:
     QTranslator m_qtTranslator;
     QTranslator m_appTranslator;
+    QString m_audioDriverOverride;
+    QString m_audioDeviceOverride;
+    bool m_lowLatencyOverride = false;
 };
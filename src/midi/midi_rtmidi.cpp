@@ -128,8 +128,16 @@ RtMidiIn *MidiInRt::lazyInstance()
 void MidiInRt::onReceive(double timeStamp, std::vector<unsigned char> *message, void *userData)
 {
     MidiInRt *self = static_cast<MidiInRt *>(userData);
-    (void)timeStamp;
-    self->m_rt.midi_event(message->data(), message->size());
+
+    // messages delivered in a burst keep their spacing by the delta times,
+    // the reception clock corrects the drift between the two timelines
+    uint64_t now = IRealtimeMIDI::midi_clock();
+    uint64_t time = self->m_lastEventTime + (uint64_t)(timeStamp * 1e9);
+    if(self->m_lastEventTime == 0 || time > now || now - time > maxEventDelay)
+        time = now;
+    self->m_lastEventTime = time;
+
+    self->m_rt.midi_event(message->data(), (unsigned)message->size(), time);
 }
 
 void MidiInRt::onError(RtMidiError::Type type, const std::string &errorText, void *userData)
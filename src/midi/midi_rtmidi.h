@@ -23,6 +23,7 @@
 #include <QObject>
 #include <QVector>
 #include <RtMidi.h>
+#include <stdint.h>
 
 class IRealtimeMIDI;
 
@@ -51,6 +52,10 @@ private:
     bool m_errorSignaled = false;
     RtMidiError::Type m_errorCode = RtMidiError::UNSPECIFIED;
     QString m_errorText;
+    //! Time given to the last received message, on the MIDI clock
+    uint64_t m_lastEventTime = 0;
+    //! Largest lag of the message time behind its reception, in nanoseconds
+    static const uint64_t maxEventDelay = 20000000;
     RtMidiIn *lazyInstance();
     static void onReceive(double timeStamp, std::vector<unsigned char> *message, void *userData);
     static void onError(RtMidiError::Type type, const std::string &errorText, void *userData);
@@ -2839,6 +2839,87 @@ void ym2612_write_pan(void *chip, int c, unsigned char v)
 	F2612->CH[c].pan_volume_r = panlawtable[0x7F - (v & 0x7F)];
 }
 
+INLINE void advance_eg_step(FM_OPN *OPN, FM_CH *cch)
+{
+	int c;
+
+	OPN->eg_cnt++;
+	if (OPN->eg_cnt == 4096)
+		OPN->eg_cnt = 1;
+
+	/* the slots which are off don't change */
+	for (c = 0; c < 6; c++)
+	{
+		FM_SLOT *SLOT = cch[c].SLOT;
+		if (SLOT[0].state | SLOT[1].state | SLOT[2].state | SLOT[3].state)
+			advance_eg_channel(OPN, &SLOT[SLOT1]);
+	}
+}
+
+void ym2612_generate_envelopes(void *chip, int frames)
+{
+	YM2612 *F2612 = (YM2612 *)chip;
+	FM_OPN *OPN   = &F2612->OPN;
+	FM_CH  *cch = F2612->CH;
+	UINT64 timer;
+	int i, c, ssg = 0;
+
+	/* refresh the rates after the key-on */
+	ym2612_pre_generate(chip);
+
+	for (c = 0; c < 6; c++)
+	{
+		for (i = 0; i < 4; i++)
+			ssg |= cch[c].SLOT[i].ssg & 0x08;
+	}
+
+	if (!ssg)
+	{
+		/* the levels change only on the steps of the generator, they are taken at once */
+		timer = (UINT64)OPN->eg_timer + (UINT64)OPN->eg_timer_add * (UINT32)frames;
+		while (timer >= OPN->eg_timer_overflow)
+		{
+			timer -= OPN->eg_timer_overflow;
+			advance_eg_step(OPN, cch);
+		}
+		OPN->eg_timer = (UINT32)timer;
+		return;
+	}
+
+	for (i = 0; i < frames; i++)
+	{
+		/* same order as in ym2612_generate_one_native(), without the FM */
+		update_ssg_eg_channel(&cch[0].SLOT[SLOT1]);
+		update_ssg_eg_channel(&cch[1].SLOT[SLOT1]);
+		update_ssg_eg_channel(&cch[2].SLOT[SLOT1]);
+		update_ssg_eg_channel(&cch[3].SLOT[SLOT1]);
+		update_ssg_eg_channel(&cch[4].SLOT[SLOT1]);
+		update_ssg_eg_channel(&cch[5].SLOT[SLOT1]);
+
+		OPN->eg_timer += OPN->eg_timer_add;
+		while (OPN->eg_timer >= OPN->eg_timer_overflow)
+		{
+			OPN->eg_timer -= OPN->eg_timer_overflow;
+			advance_eg_step(OPN, cch);
+		}
+	}
+}
+
+void ym2612_read_envelope(void *chip, int c, int s, int *state, int *volume)
+{
+	YM2612 *F2612 = (YM2612 *)chip;
+	FM_SLOT *SLOT;
+	assert((c >= 0) && (c < 6));
+	assert((s >= 0) && (s < 4));
+	/* SLOT[] is indexed in order of registers, same as OPN_SLOT() */
+	SLOT = &F2612->CH[c].SLOT[s];
+	*state = SLOT->state;
+	*volume = SLOT->volume;
+	/* the output of the SSG-EG is inverted */
+	if ((SLOT->ssg&0x08) && (SLOT->ssgn ^ (SLOT->ssg&0x04)) && (SLOT->state > EG_REL))
+		*volume = (0x200 - SLOT->volume) & MAX_ATT_INDEX;
+}
+
 UINT8 ym2612_read(void *chip,int a)
 {
 	YM2612 *F2612 = (YM2612 *)chip;
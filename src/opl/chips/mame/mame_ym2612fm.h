@@ -150,6 +150,21 @@ void ym2612_generate_one_native(void *chip, FMSAMPLE buffer[2]);
 
 int ym2612_write(void *chip, int a, unsigned char v);
 void ym2612_write_pan(void *chip, int c, unsigned char v);
+/**
+ * @brief Run the envelope generators only, the FM output is not computed
+ * @param chip Chip instance
+ * @param frames Count of the samples to run
+ */
+void ym2612_generate_envelopes(void *chip, int frames);
+/**
+ * @brief Read the envelope generator state of the operator
+ * @param chip Chip instance
+ * @param c Channel 0..5
+ * @param s Operator in order of registers (0x30, 0x34, 0x38, 0x3C)
+ * @param state Envelope phase (EG_ATT, EG_DEC, EG_SUS, EG_REL or EG_OFF)
+ * @param volume Attenuation 0..1023, after the SSG-EG inversion
+ */
+void ym2612_read_envelope(void *chip, int c, int s, int *state, int *volume);
 unsigned char ym2612_read(void *chip, int a);
 int ym2612_timer_over(void *chip, int c );
 void ym2612_postload(void *chip);
@@ -62,6 +62,38 @@ void MameOPN2::writePan(uint16_t chan, uint8_t data)
     ym2612_write_pan(chip, (int)chan, data);
 }
 
+bool MameOPN2::readEnvelope(unsigned channel, unsigned op, uint8_t &phase, uint16_t &level) const
+{
+    int state, volume;
+    ym2612_read_envelope(chip, (int)(channel % 6), (int)(op & 3), &state, &volume);
+    level = (uint16_t)((volume < 0) ? 0 : (volume > 1023) ? 1023 : volume);
+    switch(state)
+    {
+    case 4: // EG_ATT
+        phase = ENVELOPE_ATTACK;
+        break;
+    case 3: // EG_DEC
+        phase = ENVELOPE_DECAY;
+        break;
+    case 2: // EG_SUS
+        phase = ENVELOPE_SUSTAIN;
+        break;
+    case 1: // EG_REL
+        phase = ENVELOPE_RELEASE;
+        break;
+    default:
+        phase = ENVELOPE_OFF;
+        break;
+    }
+    return true;
+}
+
+bool MameOPN2::generateEnvelopes(size_t frames)
+{
+    ym2612_generate_envelopes(chip, (int)frames);
+    return true;
+}
+
 void MameOPN2::nativePreGenerate()
 {
     void *chip = this->chip;
@@ -75,6 +107,11 @@ void MameOPN2::nativeGenerate(int16_t *frame)
 }
 
 const char *MameOPN2::emulatorName()
+{
+    return name();
+}
+
+const char *MameOPN2::name()
 {
     return "MAME YM2612";
 }
@@ -1244,9 +1244,8 @@ void OPN2_SetChipType(Bit32u type)
     chip_type = type;
 }
 
-void OPN2_Clock(ym3438_t *chip, Bit16s *buffer)
+static void OPN2_ClockTimers(ym3438_t *chip)
 {
-    Bit32u slot = chip->cycles;
     chip->lfo_inc = chip->mode_test_21[1];
     chip->pg_read >>= 1;
     chip->eg_read[1] >>= 1;
@@ -1312,28 +1311,11 @@ void OPN2_Clock(ym3438_t *chip, Bit16s *buffer)
         chip->eg_shift = chip->eg_cycle;
         chip->eg_cycle_stop = 0;
     }
+}
 
-    OPN2_DoIO(chip);
-
-    OPN2_DoTimerA(chip);
-    OPN2_DoTimerB(chip);
-    OPN2_KeyOn(chip);
-
-    OPN2_ChOutput(chip);
-    OPN2_ChGenerate(chip);
-
-    OPN2_FMPrepare(chip);
-    OPN2_FMGenerate(chip);
-
-    OPN2_PhaseGenerate(chip);
-    OPN2_PhaseCalcIncrement(chip);
-
-    OPN2_EnvelopeADSR(chip);
-    OPN2_EnvelopeGenerate(chip);
-    OPN2_EnvelopeSSGEG(chip);
-    OPN2_EnvelopePrepare(chip);
-
-    /* Prepare fnum & block */
+static void OPN2_PrepareFnum(ym3438_t *chip)
+{
+    Bit32u slot = chip->cycles;
     if (chip->mode_ch3)
     {
         /* Channel 3 special mode */
@@ -1368,6 +1350,34 @@ void OPN2_Clock(ym3438_t *chip, Bit16s *buffer)
         chip->pg_block = chip->block[(chip->channel + 1) % 6];
         chip->pg_kcode = chip->kcode[(chip->channel + 1) % 6];
     }
+}
+
+void OPN2_Clock(ym3438_t *chip, Bit16s *buffer)
+{
+    OPN2_ClockTimers(chip);
+
+    OPN2_DoIO(chip);
+
+    OPN2_DoTimerA(chip);
+    OPN2_DoTimerB(chip);
+    OPN2_KeyOn(chip);
+
+    OPN2_ChOutput(chip);
+    OPN2_ChGenerate(chip);
+
+    OPN2_FMPrepare(chip);
+    OPN2_FMGenerate(chip);
+
+    OPN2_PhaseGenerate(chip);
+    OPN2_PhaseCalcIncrement(chip);
+
+    OPN2_EnvelopeADSR(chip);
+    OPN2_EnvelopeGenerate(chip);
+    OPN2_EnvelopeSSGEG(chip);
+    OPN2_EnvelopePrepare(chip);
+
+    /* Prepare fnum & block */
+    OPN2_PrepareFnum(chip);
 
     OPN2_UpdateLFO(chip);
     OPN2_DoRegWrite(chip);
@@ -1381,6 +1391,33 @@ void OPN2_Clock(ym3438_t *chip, Bit16s *buffer)
         chip->status_time--;
 }
 
+/* EXTRA, clock without the phase and the FM stages, to follow the envelopes only */
+void OPN2_ClockEnvelope(ym3438_t *chip)
+{
+    OPN2_ClockTimers(chip);
+
+    OPN2_DoIO(chip);
+
+    OPN2_DoTimerA(chip);
+    OPN2_DoTimerB(chip);
+    OPN2_KeyOn(chip);
+
+    OPN2_EnvelopeADSR(chip);
+    OPN2_EnvelopeGenerate(chip);
+    OPN2_EnvelopeSSGEG(chip);
+    OPN2_EnvelopePrepare(chip);
+
+    OPN2_PrepareFnum(chip);
+
+    OPN2_UpdateLFO(chip);
+    OPN2_DoRegWrite(chip);
+    chip->cycles = (chip->cycles + 1) % 24;
+    chip->channel = chip->cycles % 6;
+
+    if (chip->status_time)
+        chip->status_time--;
+}
+
 void OPN2_Write(ym3438_t *chip, Bit32u port, Bit8u data)
 {
     port &= 3;
@@ -1574,6 +1611,30 @@ void OPN2_Generate(ym3438_t *chip, Bit16s *buf)
     }
 }
 
+/* EXTRA, runs a sample of the envelope generators, without the output */
+void OPN2_GenerateEnvelope(ym3438_t *chip)
+{
+    Bit32u i;
+
+    for (i = 0; i < 24; i++)
+    {
+        OPN2_ClockEnvelope(chip);
+
+        while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
+        {
+            if (!(chip->writebuf[chip->writebuf_cur].port & 0x04))
+            {
+                break;
+            }
+            chip->writebuf[chip->writebuf_cur].port &= 0x03;
+            OPN2_Write(chip, chip->writebuf[chip->writebuf_cur].port,
+                       chip->writebuf[chip->writebuf_cur].data);
+            chip->writebuf_cur = (chip->writebuf_cur + 1) % OPN_WRITEBUF_SIZE;
+        }
+        chip->writebuf_samplecnt++;
+    }
+}
+
 void OPN2_GenerateResampled(ym3438_t *chip, Bit16s *buf)
 {
     Bit16s buffer[2];
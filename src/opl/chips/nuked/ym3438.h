@@ -228,6 +228,8 @@ typedef struct
 void OPN2_Reset(ym3438_t *chip, Bit32u rate, Bit32u clock);
 void OPN2_SetChipType(Bit32u type);
 void OPN2_Clock(ym3438_t *chip, Bit16s *buffer);
+/* EXTRA, clock of the envelope generators only */
+void OPN2_ClockEnvelope(ym3438_t *chip);
 void OPN2_Write(ym3438_t *chip, Bit32u port, Bit8u data);
 void OPN2_SetTestPin(ym3438_t *chip, Bit32u value);
 Bit32u OPN2_ReadTestPin(ym3438_t *chip);
@@ -238,6 +240,8 @@ Bit8u OPN2_Read(ym3438_t *chip, Bit32u port);
 void OPN2_WritePan(ym3438_t *chip, Bit32u channel, Bit8u data);
 void OPN2_WriteBuffered(ym3438_t *chip, Bit32u port, Bit8u data);
 void OPN2_Generate(ym3438_t *chip, Bit16s *buf);
+/* EXTRA, runs the envelope generators for a sample, the output is not computed */
+void OPN2_GenerateEnvelope(ym3438_t *chip);
 void OPN2_GenerateResampled(ym3438_t *chip, Bit16s *buf);
 void OPN2_GenerateStream(ym3438_t *chip, Bit16s *output, Bit32u numsamples);
 void OPN2_GenerateStreamMix(ym3438_t *chip, Bit16s *output, Bit32u numsamples);
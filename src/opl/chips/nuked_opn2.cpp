@@ -64,6 +64,41 @@ void NukedOPN2::writePan(uint16_t chan, uint8_t data)
     OPN2_WritePan(chip_r, (Bit32u)chan, data);
 }
 
+bool NukedOPN2::readEnvelope(unsigned channel, unsigned op, uint8_t &phase, uint16_t &level) const
+{
+    const ym3438_t *chip_r = reinterpret_cast<const ym3438_t*>(chip);
+    // slots are ordered by operator register, then by channel
+    unsigned slot = (channel % 6) + 6 * (op & 3);
+    level = chip_r->eg_level[slot] & 0x3FF;
+    // the output of the SSG-EG is inverted
+    if(chip_r->eg_ssg_inv[slot])
+        level = (512 - level) & 0x3FF;
+    switch(chip_r->eg_state[slot])
+    {
+    case 0: // attack
+        phase = ENVELOPE_ATTACK;
+        break;
+    case 1: // decay
+        phase = ENVELOPE_DECAY;
+        break;
+    case 2: // sustain
+        phase = ENVELOPE_SUSTAIN;
+        break;
+    default: // release
+        phase = (level == 0x3FF) ? ENVELOPE_OFF : ENVELOPE_RELEASE;
+        break;
+    }
+    return true;
+}
+
+bool NukedOPN2::generateEnvelopes(size_t frames)
+{
+    ym3438_t *chip_r = reinterpret_cast<ym3438_t*>(chip);
+    for(size_t i = 0; i < frames; ++i)
+        OPN2_GenerateEnvelope(chip_r);
+    return true;
+}
+
 void NukedOPN2::nativeGenerate(int16_t *frame)
 {
     ym3438_t *chip_r = reinterpret_cast<ym3438_t*>(chip);
@@ -71,6 +106,11 @@ void NukedOPN2::nativeGenerate(int16_t *frame)
 }
 
 const char *NukedOPN2::emulatorName()
+{
+    return name();
+}
+
+const char *NukedOPN2::name()
 {
     return "Nuked OPN2";
 }
@@ -35,10 +35,14 @@ public:
     void reset() override;
     void writeReg(uint32_t port, uint16_t addr, uint8_t data) override;
     void writePan(uint16_t chan, uint8_t data) override;
+    bool readEnvelope(unsigned channel, unsigned op, uint8_t &phase, uint16_t &level) const override;
+    bool generateEnvelopes(size_t frames) override;
     void nativePreGenerate() override {}
     void nativePostGenerate() override {}
     void nativeGenerate(int16_t *frame) override;
     const char *emulatorName() override;
+    //! Name of the emulator, without an instance
+    static const char *name();
     // amplitude scale factors to use in resampling
     enum { resamplerPreAmplify = 11, resamplerPostAttenuate = 2 };
 };
@@ -51,6 +51,8 @@ public:
 
     virtual OPNFamily family() const = 0;
     uint32_t clockRate() const;
+    //! Output rate given to setRate()
+    uint32_t rate() const { return m_rate; }
     virtual uint32_t nativeClockRate() const = 0;
 
     uint32_t chipId() const { return m_id; }
@@ -72,6 +74,33 @@ public:
     // extended
     virtual void writePan(uint16_t addr, uint8_t data) { (void)addr; (void)data; }
 
+    //! Phase of the operator envelope
+    enum EnvelopePhase
+    {
+        ENVELOPE_OFF = 0,
+        ENVELOPE_ATTACK,
+        ENVELOPE_DECAY,
+        ENVELOPE_SUSTAIN,
+        ENVELOPE_RELEASE
+    };
+    /**
+     * @brief Read the envelope generator state of the operator
+     * @param channel Channel of the chip, 0..5
+     * @param op Operator in order of registers (0x30, 0x34, 0x38, 0x3C)
+     * @param phase Phase of the envelope, one of EnvelopePhase
+     * @param level Attenuation from 0 (loudest) to 1023 (silent), after the SSG-EG inversion
+     * @return false if the emulator can't report the envelope
+     */
+    virtual bool readEnvelope(unsigned channel, unsigned op, uint8_t &phase, uint16_t &level) const
+        { (void)channel; (void)op; (void)phase; (void)level; return false; }
+    /**
+     * @brief Run the envelope generators alone, without the synthesis
+     * @param frames Count of the samples at the native rate
+     * @return false if the emulator can't run the envelopes alone
+     */
+    virtual bool generateEnvelopes(size_t frames)
+        { (void)frames; return false; }
+
     virtual void nativePreGenerate() = 0;
     virtual void nativePostGenerate() = 0;
     virtual void nativeGenerate(int16_t *frame) = 0;
@@ -115,6 +144,8 @@ public:
     void generateAndMix32(int32_t *output, size_t frames) override;
 private:
     bool m_runningAtPcmRate;
+    //! The output rate equals to the native one, the resampler is skipped
+    bool m_passThrough;
 #if defined(OPNMIDI_AUDIO_TICK_HANDLER)
     void *m_audioTickHandlerInstance;
 #endif
@@ -41,7 +41,8 @@ inline uint32_t OPNChipBase::clockRate() const
 template <class T>
 OPNChipBaseT<T>::OPNChipBaseT(OPNFamily f)
     : OPNChipBase(f),
-      m_runningAtPcmRate(false)
+      m_runningAtPcmRate(false),
+      m_passThrough(false)
 #if defined(OPNMIDI_AUDIO_TICK_HANDLER)
     ,
       m_audioTickHandlerInstance(NULL)
@@ -208,6 +209,7 @@ void OPNChipBaseT<T>::nativeTick(int16_t *frame)
 template <class T>
 void OPNChipBaseT<T>::setupResampler(uint32_t rate)
 {
+    m_passThrough = opn2_isNativeRate(rate, m_family);
 #if defined(OPNMIDI_ENABLE_HQ_RESAMPLER)
     double ratio = rate * (1.0 / opn2_getNativeRate(m_family));
     m_resampler->setup(ratio, 2, 48);
@@ -235,7 +237,7 @@ void OPNChipBaseT<T>::resetResampler()
 template <class T>
 void OPNChipBaseT<T>::resampledGenerate(int32_t *output)
 {
-    if(UNLIKELY(m_runningAtPcmRate))
+    if(UNLIKELY(m_runningAtPcmRate || m_passThrough))
     {
         int16_t in[2];
         static_cast<T *>(this)->nativeTick(in);
@@ -271,7 +273,7 @@ void OPNChipBaseT<T>::resampledGenerate(int32_t *output)
 template <class T>
 void OPNChipBaseT<T>::resampledGenerate(int32_t *output)
 {
-    if(UNLIKELY(m_runningAtPcmRate))
+    if(UNLIKELY(m_runningAtPcmRate || m_passThrough))
     {
         int16_t in[2];
         static_cast<T *>(this)->nativeTick(in);
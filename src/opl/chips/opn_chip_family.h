@@ -81,4 +81,17 @@ inline uint32_t opn2_getNativeClockRate(OPNFamily f)
     }
 }
 
+/**
+ * @brief Whether the output rate is close enough to the native rate of the
+ * chip to pass the samples through without resampling
+ *
+ * The tolerance of 0.1% detunes by less than 2 cents.
+ */
+inline bool opn2_isNativeRate(uint32_t rate, OPNFamily f)
+{
+    uint32_t nativeRate = opn2_getNativeRate(f);
+    uint32_t diff = (rate > nativeRate) ? (rate - nativeRate) : (nativeRate - rate);
+    return diff * 1000 <= nativeRate;
+}
+
 #endif // OPN_CHIP_FAMILY_H
@@ -0,0 +1,157 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "envelope_model.h"
+#include <algorithm>
+#include <cmath>
+
+//! Rates of this and higher are the instant attack
+static const unsigned instant_attack_rate = 62;
+
+EnvelopeModel::EnvelopeModel() :
+    m_attackEnd(0),
+    m_sustainLevel(0),
+    m_decay1Slope(0),
+    m_decay2Slope(0),
+    m_releaseSlope(0)
+{}
+
+unsigned EnvelopeModel::keyCode(unsigned block, unsigned fnum)
+{
+    // the high F-number bits round the note into the quarters of the octave
+    static const uint8_t fnumKey[16] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 3, 3, 3, 3, 3, 3};
+    return ((block & 7) << 2) | fnumKey[(fnum >> 7) & 0x0F];
+}
+
+double EnvelopeModel::rateSlope(unsigned rate)
+{
+    if(rate < 2)
+        return 0.0;
+    if(rate > 63)
+        rate = 63;
+    if(rate < 48)
+    {
+        // the lowest rates have own patterns, measured on the real chip
+        static const uint8_t lowSteps[8] = {0, 0, 6, 7, 4, 5, 6, 6};
+        // 4 to 7 steps of 8 updates, an update every 2^shift clocks
+        const unsigned shift = 11 - (rate >> 2);
+        const unsigned steps = (rate < 8) ? lowSteps[rate] : (4 + (rate & 3));
+        return steps / 8.0 / double(1u << shift);
+    }
+    if(rate >= 60)
+        return 8.0;
+    // updates every clock, by 1 to 8 steps
+    return (1.0 + (rate & 3) / 4.0) * double(1u << ((rate >> 2) - 12));
+}
+
+static unsigned effectiveRate(unsigned rate, unsigned ksr)
+{
+    if(rate == 0)
+        return 0;
+    return std::min(63u, 2 * rate + ksr);
+}
+
+void EnvelopeModel::setup(const FmBank::Operator &op, unsigned keyCode, double clockRate)
+{
+    const unsigned ksr = keyCode >> (3 - (op.ratescale & 3));
+    const unsigned attackRate = effectiveRate(op.attack, ksr);
+
+    m_sustainLevel = (op.sustain >= 15) ? 992.0 : (op.sustain * 32.0);
+    m_decay1Slope = rateSlope(effectiveRate(op.decay1, ksr)) * clockRate;
+    m_decay2Slope = rateSlope(effectiveRate(op.decay2, ksr)) * clockRate;
+    m_releaseSlope = rateSlope(effectiveRate(2 * op.release + 1, ksr)) * clockRate;
+
+    m_attackTimes.clear();
+    m_attackLevels.clear();
+
+    if(attackRate >= instant_attack_rate)
+    {
+        m_attackEnd = 0.0;
+        return;
+    }
+    if(attackRate < 2)
+    {
+        m_attackEnd = -1.0;
+        return;
+    }
+
+    // every update moves the attenuation by a sixteenth of its distance to 0
+    double updateTime;
+    double increment;
+    if(attackRate < 48)
+    {
+        // the updates by 1 step, rateSlope() is their count per clock
+        updateTime = 1.0 / rateSlope(attackRate) / clockRate;
+        increment = 1.0;
+    }
+    else
+    {
+        updateTime = 1.0 / clockRate;
+        increment = rateSlope(attackRate);
+    }
+
+    int level = max_attenuation;
+    double time = 0.0;
+    while(level > 0)
+    {
+        level += (int)std::floor(-(level + 1) * increment / 16.0);
+        if(level < 0)
+            level = 0;
+        time += updateTime;
+        m_attackTimes.push_back(time);
+        m_attackLevels.push_back(level);
+    }
+    m_attackEnd = time;
+}
+
+double EnvelopeModel::attenuation(double time) const
+{
+    if(m_attackEnd < 0.0)
+        return max_attenuation;
+
+    if(time < m_attackEnd)
+    {
+        std::vector<double>::const_iterator it =
+            std::upper_bound(m_attackTimes.begin(), m_attackTimes.end(), time);
+        if(it == m_attackTimes.begin())
+            return max_attenuation;
+        return m_attackLevels[size_t(it - m_attackTimes.begin()) - 1];
+    }
+
+    double elapsed = time - m_attackEnd;
+    double level;
+    const double decay1Time = (m_decay1Slope > 0.0) ? (m_sustainLevel / m_decay1Slope) : -1.0;
+    if(m_sustainLevel <= 0.0)
+        level = elapsed * m_decay2Slope;
+    else if(decay1Time < 0.0)
+        level = 0.0;
+    else if(elapsed < decay1Time)
+        level = elapsed * m_decay1Slope;
+    else
+        level = m_sustainLevel + (elapsed - decay1Time) * m_decay2Slope;
+
+    return std::min(level, double(max_attenuation));
+}
+
+double EnvelopeModel::attenuation(double time, double keyOffTime) const
+{
+    if(time < keyOffTime)
+        return attenuation(time);
+    double level = attenuation(keyOffTime) + (time - keyOffTime) * m_releaseSlope;
+    return std::min(level, double(max_attenuation));
+}
@@ -0,0 +1,85 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENVELOPE_MODEL_H
+#define ENVELOPE_MODEL_H
+
+#include <vector>
+#include <stdint.h>
+#include "../bank.h"
+
+/**
+ * @brief Analytic model of the OPN2 envelope generator of one operator
+ *
+ * Predicts the attenuation of the operator from its rates, without running
+ * an emulator. The attack follows the exponential steps of the chip, the
+ * decays and the release are linear in the attenuation. The SSG-EG is not
+ * modeled.
+ */
+class EnvelopeModel
+{
+public:
+    //! Attenuation of the silent envelope, in steps of 0.09375 dB
+    enum { max_attenuation = 1023 };
+
+    EnvelopeModel();
+
+    /**
+     * @brief Set up the envelope of the operator
+     * @param op Operator of the instrument
+     * @param keyCode Key code of the played note, see keyCode()
+     * @param clockRate Rate of the envelope generator clock, Hz
+     */
+    void setup(const FmBank::Operator &op, unsigned keyCode, double clockRate);
+
+    /**
+     * @brief Attenuation of the envelope while the key is held
+     * @param time Seconds after the key-on
+     * @return Attenuation, from 0 to max_attenuation
+     */
+    double attenuation(double time) const;
+
+    /**
+     * @brief Attenuation of the envelope after the key was released
+     * @param time Seconds after the key-on
+     * @param keyOffTime Seconds from the key-on to the key-off
+     * @return Attenuation, from 0 to max_attenuation
+     */
+    double attenuation(double time, double keyOffTime) const;
+
+    //! Key code of the block and the F-number, it scales the rates
+    static unsigned keyCode(unsigned block, unsigned fnum);
+
+    //! Attenuation steps per clock of the envelope generator at the rate 0..63
+    static double rateSlope(unsigned rate);
+
+private:
+    //! Times of the attack steps and the attenuations after them
+    std::vector<double> m_attackTimes;
+    std::vector<double> m_attackLevels;
+    //! Time of the attack end, negative if the attack never ends
+    double m_attackEnd;
+    //! Attenuation of the sustain level
+    double m_sustainLevel;
+    //! Slopes of the phases, attenuation steps per second
+    double m_decay1Slope;
+    double m_decay2Slope;
+    double m_releaseSlope;
+};
+
+#endif // ENVELOPE_MODEL_H
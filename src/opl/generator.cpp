@@ -17,7 +17,9 @@
  */
 
 #include "generator.h"
+#include "patch_bank.h"
 #include <qendian.h>
+#include <algorithm>
 #include <cmath>
 
 #include "chips/gens_opn2.h"
@@ -28,7 +30,68 @@
 #include "chips/mame_opna.h"
 #include "chips/pmdwin_opna.h"
 
-#define USED_CHANNELS_4OP       6
+/***************************************************************
+ *                  Channel to chip mapping                    *
+ ***************************************************************/
+
+//! Index of the chip which owns the absolute channel
+static inline uint32_t chanChip(uint32_t c)
+{
+    return c / NUM_OF_CHANNELS;
+}
+
+//! Register port of the channel on its chip
+static inline uint8_t chanPort(uint32_t c)
+{
+    return ((c % NUM_OF_CHANNELS) <= 2) ? 0 : 1;
+}
+
+//! Register offset of the channel in its port
+static inline uint8_t chanReg(uint32_t c)
+{
+    return (c % NUM_OF_CHANNELS) % 3;
+}
+
+//! Channel number for the key-on register 0x28
+static inline uint8_t chanKey(uint32_t c)
+{
+    uint8_t cc = static_cast<uint8_t>(c % NUM_OF_CHANNELS);
+    return (cc <= 2) ? cc : (cc + 1);
+}
+
+/*
+ * Yeah, Operator 2 and 3 are seems swapped
+ * which we can see in the algorithm 4
+ */
+static const uint8_t s_alg_carrier_mask[8] =
+{
+    //Carrier bits: 0x01 - OP1 (30), 0x02 - OP3 (34), 0x04 - OP2 (38), 0x08 - OP4 (3C)
+    0x08,//Algorithm #0:  W = 1 * 2 * 3 * 4
+    0x08,//Algorithm #1:  W = (1 + 2) * 3 * 4
+    0x08,//Algorithm #2:  W = (1 + (2 * 3)) * 4
+    0x08,//Algorithm #3:  W = ((1 * 2) + 3) * 4
+    0x0C,//Algorithm #4:  W = (1 * 2) + (3 * 4)
+    0x0E,//Algorithm #5:  W = (1 * (2 + 3 + 4)
+    0x0E,//Algorithm #6:  W = (1 * 2) + 3 + 4
+    0x0F,//Algorithm #7:  W = 1 + 2 + 3 + 4
+};
+
+/**
+ * @brief Approximate speed of the envelope generator
+ * @param rate Effective rate from 0 to 63
+ * @return Attenuation speed in decibels per second
+ */
+static double envelopeSpeed(unsigned rate)
+{
+    if(rate < 2)
+        return 0.0;
+    if(rate > 63)
+        rate = 63;
+    // EG is clocked every 3 samples of 53267 Hz, each step is 96/1024 dB
+    const double egClock = 53267.0 / 3.0;
+    const double stepsPerClock = (1.0 + (rate & 3) * 0.25) * std::ldexp(1.0, int(rate >> 2) - 11);
+    return stepsPerClock * (96.0 / 1024.0) * egClock;
+}
 
 /***************************************************************
  *                    Volume model tables                      *
@@ -64,15 +127,215 @@ static const uint_fast32_t W9X_volume_mapping_table[32] =
     3,  3,  2,  2,  1,  1,  0,  0
 };
 
+/**
+ * @brief Precompiled volume models
+ *
+ * Every volume model depends on the note velocity and on the product of
+ * channel volume and expression. All 4647 distinct values of that product
+ * are compacted into a class index, and the resulting level is stored
+ * for every pair of velocity and product class.
+ */
+struct VolumeTables
+{
+    enum
+    {
+        MODELS = Generator::VOLUME_9X + 1,
+        PRODUCT_CLASSES = 4647
+    };
+
+    //! Product class for the (volume * 128 + expression) pair
+    uint16_t productIndex[128 * 128];
+    //! Value of the product for every class
+    uint16_t productValue[PRODUCT_CLASSES];
+    //! Level for (velocity * PRODUCT_CLASSES + class), for every model
+    std::vector<uint8_t> level[MODELS];
+    //! Modulator level scale for the brightness value
+    uint8_t brightness[128];
+
+    VolumeTables();
+
+    static uint_fast32_t computeLevel(int model, uint_fast32_t velocity, uint_fast32_t product);
+};
+
+uint_fast32_t VolumeTables::computeLevel(int model, uint_fast32_t velocity, uint_fast32_t product)
+{
+    uint_fast32_t volume = 0;
+
+    switch(model)
+    {
+    default:
+    case Generator::VOLUME_Generic:
+    {
+        volume = velocity * 127 * product;
+
+        const double c1 = 11.541560327111707;
+        const double c2 = 1.601379199767093e+02;
+        const uint_fast32_t minVolume = 1108075; // 8725 * 127
+
+        // The formula below: SOLVE(V=127^4 * 2^( (A-63.49999) / 8), A)
+        if(volume > minVolume)
+        {
+            double lv = std::log(static_cast<double>(volume));
+            volume = static_cast<uint_fast32_t>(lv * c1 - c2) * 2;
+        }
+        else
+            volume = 0;
+    }
+    break;
+
+    case Generator::VOLUME_CMF:
+    {
+        volume = velocity * product;
+        volume = ((volume * 127) / 4096766);
+
+        if(volume > 0)
+            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
+    }
+    break;
+
+    case Generator::VOLUME_DMX:
+    {
+        volume = (product * 127) / 16129;
+        volume = (s_dmx_volume_model[volume] + 1) << 1;
+        volume = (s_dmx_volume_model[velocity] * volume) >> 9;
+
+        if(volume > 0)
+            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
+    }
+    break;
+
+    case Generator::VOLUME_APOGEE:
+    {
+        volume = (product * 127 / 16129);
+        volume = ((64 * (velocity + 0x80)) * volume) >> 15;
+        if(volume > 0)
+            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
+    }
+    break;
+
+    case Generator::VOLUME_9X:
+    {
+        volume = 63 - W9X_volume_mapping_table[((velocity * product * 127 / 2048383) >> 2)];
+        if(volume > 0)
+            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
+    }
+    break;
+    }
+
+    if(volume > 127)
+        volume = 127;
+
+    return volume;
+}
 
-QString GeneratorDebugInfo::toStr()
+VolumeTables::VolumeTables()
 {
-    return QString("Channels:\n"
-                   "4-op: %1")
-        .arg(this->chan4op);
+    // Enumerate the distinct products in ascending order
+    std::vector<int> classOf(127 * 127 + 1, -1);
+    for(unsigned v = 0; v < 128; ++v)
+    {
+        for(unsigned e = 0; e < 128; ++e)
+            classOf[v * e] = 0;
+    }
+
+    unsigned classes = 0;
+    for(unsigned p = 0; p < classOf.size(); ++p)
+    {
+        if(classOf[p] < 0)
+            continue;
+        productValue[classes] = static_cast<uint16_t>(p);
+        classOf[p] = static_cast<int>(classes++);
+    }
+    Q_ASSERT(classes == PRODUCT_CLASSES);
+
+    for(unsigned v = 0; v < 128; ++v)
+    {
+        for(unsigned e = 0; e < 128; ++e)
+            productIndex[v * 128 + e] = static_cast<uint16_t>(classOf[v * e]);
+    }
+
+    for(int model = 0; model < MODELS; ++model)
+    {
+        std::vector<uint8_t> &table = level[model];
+        table.resize(128 * PRODUCT_CLASSES);
+        for(unsigned vel = 0; vel < 128; ++vel)
+        {
+            for(unsigned c = 0; c < PRODUCT_CLASSES; ++c)
+                table[vel * PRODUCT_CLASSES + c] = static_cast<uint8_t>(computeLevel(model, vel, productValue[c]));
+        }
+    }
+
+    for(unsigned b = 0; b < 128; ++b)
+        brightness[b] = static_cast<uint8_t>(std::round(127.0 * std::sqrt(static_cast<double>(b) * (1.0 / 127.0))));
+}
+
+//! Shared tables, built once on the first use
+static const VolumeTables &volumeTables()
+{
+    static const VolumeTables tables;
+    return tables;
 }
 
-Generator::Generator(uint32_t sampleRate, OPN_Chips initialChip)
+
+QString GeneratorDebugInfo::toStr() const
+{
+    static const char keyStates[] = {'-', 'R', 'K', 'H'};
+    static const char egPhases[] = {'-', 'A', 'D', 'S', 'R'};
+
+    QString text = QString("Channels:\n"
+                           "4-op: %1\n"
+                           "Writes: %2/s, cached: %3/s\n")
+        .arg(this->chan4op)
+        .arg(this->regWritesRate)
+        .arg(this->regElidedRate);
+
+    if(midiDropped > 0)
+        text += QString("MIDI dropped: %1\n").arg(midiDropped);
+
+    // idle channels are skipped to keep the map short with many chips
+    for(uint32_t i = 0; i < voicesCount; ++i)
+    {
+        const GeneratorVoiceInfo &v = voices[i];
+        if(v.key == GeneratorVoiceInfo::KEY_IDLE)
+            continue;
+
+        QString line = QString("%1 %2 ")
+            .arg(i, 2)
+            .arg(QChar(keyStates[v.key & 3]));
+
+        // released channels don't keep the key
+        if(v.note < 0)
+            line += QString("  - p%1 ").arg(v.part + 1, -3);
+        else
+            line += QString("%1 p%2 ")
+                .arg(v.note, 3)
+                .arg(v.part + 1, -3);
+
+        if(v.patch == GeneratorVoiceInfo::PATCH_EDITOR)
+            line += QString("edit ");
+        else if(v.patch == GeneratorVoiceInfo::PATCH_NONE)
+            line += QString("  -  ");
+        else
+            line += QString("%1 ").arg(v.patch, 4);
+
+        if(envelopes)
+        {
+            for(unsigned op = 0; op < 4; ++op)
+                line += QString(" %1%2")
+                    .arg(QChar(egPhases[v.egPhase[op] < 5 ? v.egPhase[op] : 0]))
+                    .arg(v.egLevel[op], 4);
+        }
+
+        if(v.key == GeneratorVoiceInfo::KEY_RELEASED)
+            line += QString(" +%1ms").arg(v.releaseAge);
+
+        text += line + QChar('\n');
+    }
+
+    return text;
+}
+
+Generator::Generator(uint32_t sampleRate, OPN_Chips initialChip, unsigned chipsCount)
 {
     m_rate = sampleRate;
     note = 60;
@@ -91,11 +354,12 @@ Generator::Generator(uint32_t sampleRate, OPN_Chips initialChip)
         60,
     };
 
-    memset(m_ins, 0, sizeof(uint16_t) * NUM_OF_CHANNELS);
-    memset(m_pit, 0, sizeof(uint8_t) * NUM_OF_CHANNELS);
-    memset(m_pan_lfo, 0, sizeof(uint8_t) * NUM_OF_CHANNELS);
+    m_volumeTable = volumeTables().level[VOLUME_Generic].data();
+    m_switchBuffer.resize(2 * MAX_OPLGEN_BUFFER_SIZE);
 
-    switchChip(initialChip);
+    m_chipId = initialChip;
+    setChipsCount(chipsCount);
+    midiReset();
 
     //Send the null patch to initialize the OPL stuff
     changePatch(FmBank::emptyInst(), false);
@@ -108,122 +372,266 @@ Generator::~Generator()
 void Generator::initChip()
 {
     //Init chip //7670454
-    chip->setRate(m_rate, chip->nativeClockRate());
-    WriteReg(0, 0x22, lfo_reg);   //LFO off
-    WriteReg(0, 0x27, 0x0 );   //Channel 3 mode normal
+    for(std::unique_ptr<OPNChipBase> &chip : m_chips)
+        chip->setRate(m_rate, chip->nativeClockRate());
+    WriteRegAll(0, 0x22, lfo_reg);   //LFO off
+    WriteRegAll(0, 0x27, 0x0 );   //Channel 3 mode normal
 
     //Shut up all channels
-    WriteReg(0, 0x28, 0x00 );   //Note Off 0 channel
-    WriteReg(0, 0x28, 0x01 );   //Note Off 1 channel
-    WriteReg(0, 0x28, 0x02 );   //Note Off 2 channel
-    WriteReg(0, 0x28, 0x04 );   //Note Off 3 channel
-    WriteReg(0, 0x28, 0x05 );   //Note Off 4 channel
-    WriteReg(0, 0x28, 0x06 );   //Note Off 5 channel
+    WriteRegAll(0, 0x28, 0x00 );   //Note Off 0 channel
+    WriteRegAll(0, 0x28, 0x01 );   //Note Off 1 channel
+    WriteRegAll(0, 0x28, 0x02 );   //Note Off 2 channel
+    WriteRegAll(0, 0x28, 0x04 );   //Note Off 3 channel
+    WriteRegAll(0, 0x28, 0x05 );   //Note Off 4 channel
+    WriteRegAll(0, 0x28, 0x06 );   //Note Off 5 channel
 
     //Disable DAC
-    WriteReg(0, 0x2B, 0x0 );   //DAC off
+    WriteRegAll(0, 0x2B, 0x0 );   //DAC off
 
-    for(uint16_t chn = 0; chn < 6; chn++)
+    uint32_t channels = NUM_OF_CHANNELS * chipsCount();
+    for(uint32_t chn = 0; chn < channels; chn++)
     {
-        uint8_t ch   = chn % 3;
-        uint8_t port = (chn <= 2) ? 0 : 1;
-        WriteReg(port, 0x30 + ch, 0x71);   //Detune/Frequency Multiple operator 1
-        WriteReg(port, 0x34 + ch, 0x0D);   //Detune/Frequency Multiple operator 2
-        WriteReg(port, 0x38 + ch, 0x33);   //Detune/Frequency Multiple operator 3
-        WriteReg(port, 0x3C + ch, 0x01);   //Detune/Frequency Multiple operator 4
-
-        WriteReg(port, 0x40 + ch, 0x23);   //Total Level operator 1
-        WriteReg(port, 0x44 + ch, 0x2D);   //Total Level operator 2
-        WriteReg(port, 0x48 + ch, 0x26);   //Total Level operator 3
-        WriteReg(port, 0x4C + ch, 0x00);   //Total Level operator 4
-
-        WriteReg(port, 0x50 + ch, 0x5F);   //RS/AR operator 1
-        WriteReg(port, 0x54 + ch, 0x99);   //RS/AR operator 2
-        WriteReg(port, 0x58 + ch, 0x5F);   //RS/AR operator 3
-        WriteReg(port, 0x5C + ch, 0x94);   //RS/AR operator 4
-
-        WriteReg(port, 0x60 + ch, 0x05);   //AM/D1R operator 1
-        WriteReg(port, 0x64 + ch, 0x05);   //AM/D1R operator 2
-        WriteReg(port, 0x68 + ch, 0x05);   //AM/D1R operator 3
-        WriteReg(port, 0x6C + ch, 0x07);   //AM/D1R operator 4
-
-        WriteReg(port, 0x70 + ch, 0x02);   //D2R operator 1
-        WriteReg(port, 0x74 + ch, 0x02);   //D2R operator 2
-        WriteReg(port, 0x78 + ch, 0x02);   //D2R operator 3
-        WriteReg(port, 0x7C + ch, 0x02);   //D2R operator 4
-
-        WriteReg(port, 0x80 + ch, 0x11);   //D1L/RR Operator 1
-        WriteReg(port, 0x84 + ch, 0x11);   //D1L/RR Operator 2
-        WriteReg(port, 0x88 + ch, 0x11);   //D1L/RR Operator 3
-        WriteReg(port, 0x8C + ch, 0xA6);   //D1L/RR Operator 4
-
-        WriteReg(port, 0x90 + ch, 0x00);   //Proprietary shit
-        WriteReg(port, 0x94 + ch, 0x00);   //Proprietary shit
-        WriteReg(port, 0x98 + ch, 0x00);   //Proprietary shit
-        WriteReg(port, 0x9C + ch, 0x00);   //Proprietary shit
-
-        WriteReg(port, 0xB0 + ch, 0x32);   //Feedback/Algorithm
-
-        m_pan_lfo[ch] = 0xC0;
-        WriteReg(port, 0xB4 + ch, m_pan_lfo[ch]);   //Panorame (toggle on both speakers)
-
-        WriteReg(port, 0x28, 0x00 + ch);   //Key off to channel
-
-        WriteReg(port, 0xA4 + ch, 0x68);   //Set frequency and octave
-        WriteReg(port, 0xA0 + ch, 0xFF);
+        uint32_t chip = chanChip(chn);
+        uint8_t  ch   = chanReg(chn);
+        uint8_t  port = chanPort(chn);
+        WriteReg(chip, port, 0x30 + ch, 0x71);   //Detune/Frequency Multiple operator 1
+        WriteReg(chip, port, 0x34 + ch, 0x0D);   //Detune/Frequency Multiple operator 2
+        WriteReg(chip, port, 0x38 + ch, 0x33);   //Detune/Frequency Multiple operator 3
+        WriteReg(chip, port, 0x3C + ch, 0x01);   //Detune/Frequency Multiple operator 4
+
+        WriteReg(chip, port, 0x40 + ch, 0x23);   //Total Level operator 1
+        WriteReg(chip, port, 0x44 + ch, 0x2D);   //Total Level operator 2
+        WriteReg(chip, port, 0x48 + ch, 0x26);   //Total Level operator 3
+        WriteReg(chip, port, 0x4C + ch, 0x00);   //Total Level operator 4
+
+        WriteReg(chip, port, 0x50 + ch, 0x5F);   //RS/AR operator 1
+        WriteReg(chip, port, 0x54 + ch, 0x99);   //RS/AR operator 2
+        WriteReg(chip, port, 0x58 + ch, 0x5F);   //RS/AR operator 3
+        WriteReg(chip, port, 0x5C + ch, 0x94);   //RS/AR operator 4
+
+        WriteReg(chip, port, 0x60 + ch, 0x05);   //AM/D1R operator 1
+        WriteReg(chip, port, 0x64 + ch, 0x05);   //AM/D1R operator 2
+        WriteReg(chip, port, 0x68 + ch, 0x05);   //AM/D1R operator 3
+        WriteReg(chip, port, 0x6C + ch, 0x07);   //AM/D1R operator 4
+
+        WriteReg(chip, port, 0x70 + ch, 0x02);   //D2R operator 1
+        WriteReg(chip, port, 0x74 + ch, 0x02);   //D2R operator 2
+        WriteReg(chip, port, 0x78 + ch, 0x02);   //D2R operator 3
+        WriteReg(chip, port, 0x7C + ch, 0x02);   //D2R operator 4
+
+        WriteReg(chip, port, 0x80 + ch, 0x11);   //D1L/RR Operator 1
+        WriteReg(chip, port, 0x84 + ch, 0x11);   //D1L/RR Operator 2
+        WriteReg(chip, port, 0x88 + ch, 0x11);   //D1L/RR Operator 3
+        WriteReg(chip, port, 0x8C + ch, 0xA6);   //D1L/RR Operator 4
+
+        WriteReg(chip, port, 0x90 + ch, 0x00);   //Proprietary shit
+        WriteReg(chip, port, 0x94 + ch, 0x00);   //Proprietary shit
+        WriteReg(chip, port, 0x98 + ch, 0x00);   //Proprietary shit
+        WriteReg(chip, port, 0x9C + ch, 0x00);   //Proprietary shit
+
+        WriteReg(chip, port, 0xB0 + ch, 0x32);   //Feedback/Algorithm
+
+        m_pan_lfo[chn] = 0xC0;
+        WriteReg(chip, port, 0xB4 + ch, m_pan_lfo[chn]);   //Panorame (toggle on both speakers)
+
+        WriteReg(chip, 0, 0x28, chanKey(chn));   //Key off to channel
+
+        WriteReg(chip, port, 0xA4 + ch, 0x68);   //Set frequency and octave
+        WriteReg(chip, port, 0xA0 + ch, 0xFF);
     }
 
     // OPN END
     Silence();
 }
 
-void Generator::switchChip(Generator::OPN_Chips chipId, int family)
+OPNChipBase *Generator::createChip(Generator::OPN_Chips chipId, OPNFamily family)
 {
-    m_chipFamily = static_cast<OPNFamily>(family);
-
     switch(chipId)
     {
     case CHIP_GENS:
-        chip.reset(new GensOPN2(m_chipFamily));
-        break;
+        return new GensOPN2(family);
     default:
     case CHIP_Nuked:
-        chip.reset(new NukedOPN2(m_chipFamily));
-        break;
+        return new NukedOPN2(family);
     case CHIP_MAME:
-        chip.reset(new MameOPN2(m_chipFamily));
-        break;
+        return new MameOPN2(family);
     case CHIP_GX:
-        chip.reset(new GXOPN2(m_chipFamily));
-        break;
+        return new GXOPN2(family);
     case CHIP_NP2:
-        chip.reset(new NP2OPNA<>(m_chipFamily));
-        break;
+        return new NP2OPNA<>(family);
     case CHIP_MAMEOPNA:
-        chip.reset(new MameOPNA(m_chipFamily));
-        break;
+        return new MameOPNA(family);
     case CHIP_PMDWIN:
-        chip.reset(new PMDWinOPNA(m_chipFamily));
-        break;
+        return new PMDWinOPNA(family);
     }
+}
+
+void Generator::switchChip(Generator::OPN_Chips chipId, int family)
+{
+    m_chipId = chipId;
+    m_chipFamily = static_cast<OPNFamily>(family);
+
+    // the immediate switch overrides the seamless one
+    m_nextChips.reset();
+
+    for(std::unique_ptr<OPNChipBase> &chip : m_chips)
+        chip.reset(createChip(chipId, m_chipFamily));
+
+    uint32_t channels = NUM_OF_CHANNELS * chipsCount();
+    m_pan_lfo.assign(channels, 0xC0);
+    m_regCache.assign(REGS_PER_CHIP * chipsCount(), REG_UNKNOWN);
+    m_keyCache.assign(channels, 0);
+    m_noteManager.allocateChannels(static_cast<int>(channels));
+
     initChip();
 }
 
-void Generator::WriteReg(uint8_t port, uint16_t address, uint8_t byte)
+Generator::ChipSet *Generator::createChipSet(OPN_Chips chipId, int family, unsigned count) const
 {
-    chip->writeReg(port, address, byte);
+    ChipSet *set = new ChipSet;
+    set->chipId = chipId;
+    set->family = static_cast<OPNFamily>(family);
+    set->chips.resize(count);
+    for(std::unique_ptr<OPNChipBase> &chip : set->chips)
+    {
+        chip.reset(createChip(chipId, set->family));
+        chip->setRate(m_rate, chip->nativeClockRate());
+    }
+    return set;
+}
+
+bool Generator::beginChipSwitch(ChipSet *set)
+{
+    if(isSwitchingChips() || set->chips.size() != m_chips.size())
+        return false;
+
+    m_nextChips.reset(set);
+    m_switchFrames = 0;
+    m_chipId = set->chipId;
+
+    // frequencies are computed for the clock of the family, so notes can't be kept
+    bool keepNotes = (set->family == m_chipFamily);
+    if(!keepNotes)
+    {
+        m_chipFamily = set->family;
+        m_noteManager.clearNotes();
+        std::fill(m_keyCache.begin(), m_keyCache.end(), 0);
+    }
+
+    for(size_t i = 0, n = set->chips.size(); i < n; ++i)
+        replayRegisters(*set->chips[i], static_cast<uint32_t>(i), keepNotes);
+
+    return true;
+}
+
+void Generator::replayRegisters(OPNChipBase &chip, uint32_t chipId, bool keys)
+{
+    const uint16_t *regs = &m_regCache[chipId * REGS_PER_CHIP];
+
+    for(uint8_t port = 0; port < 2; ++port)
+    {
+        const uint16_t *portRegs = regs + port * 0x100;
+        for(uint16_t addr = 0x20; addr < 0xA0; ++addr)
+        {
+            if(addr != 0x28 && portRegs[addr] != REG_UNKNOWN)
+                chip.writeReg(port, addr, static_cast<uint8_t>(portRegs[addr]));
+        }
+        for(uint16_t addr = 0xB0; addr < 0xB8; ++addr)
+        {
+            if(portRegs[addr] != REG_UNKNOWN)
+                chip.writeReg(port, addr, static_cast<uint8_t>(portRegs[addr]));
+        }
+        // the high byte of the frequency is latched by the write of the low one
+        for(uint16_t addr = 0xA0; addr < 0xB0; ++addr)
+        {
+            if((addr & 0x04) || portRegs[addr] == REG_UNKNOWN)
+                continue;
+            if(portRegs[addr + 4] != REG_UNKNOWN)
+                chip.writeReg(port, addr + 4, static_cast<uint8_t>(portRegs[addr + 4]));
+            chip.writeReg(port, addr, static_cast<uint8_t>(portRegs[addr]));
+        }
+    }
+
+    if(!keys)
+        return;
+
+    for(uint32_t cc = 0; cc < NUM_OF_CHANNELS; ++cc)
+    {
+        uint32_t c = chipId * NUM_OF_CHANNELS + cc;
+        if(m_keyCache[c])
+            chip.writeReg(0, 0x28, m_keyCache[c] | chanKey(c));
+    }
+}
+
+void Generator::setChipsCount(unsigned count)
+{
+    if(count < 1)
+        count = 1;
+    else if(count > MAX_OPN_CHIPS)
+        count = MAX_OPN_CHIPS;
+
+    m_chips.resize(count);
+    switchChip(m_chipId, static_cast<int>(m_chipFamily));
+}
+
+/**
+ * @brief Whether the repeated write into the register has no effect
+ *
+ * Operator registers and the feedback, algorithm, panning and LFO
+ * sensitivity hold plain values. Frequencies are latched by the A0
+ * write and the key register 0x28 is an action, these are always sent.
+ */
+static inline bool isRegCacheable(uint16_t address)
+{
+    address &= 0xFF;
+    return (address >= 0x30 && address <= 0x9F) ||
+           (address >= 0xB0 && address <= 0xB6);
+}
+
+void Generator::WriteReg(uint32_t chipId, uint8_t port, uint16_t address, uint8_t byte)
+{
+    if((address & 0xFF) == 0x28)
+    {
+        // remember operators keyed on, to replay them into the new emulator
+        uint8_t cc = byte & 0x03;
+        if(cc != 0x03)
+        {
+            cc += (byte & 0x04) ? 3 : 0;
+            m_keyCache[chipId * NUM_OF_CHANNELS + cc] = byte & 0xF0;
+        }
+    }
+    else
+    {
+        uint16_t &cached = m_regCache[chipId * REGS_PER_CHIP + (port & 1) * 0x100 + (address & 0xFF)];
+        if(cached == byte && isRegCacheable(address))
+        {
+            m_debug.regElided++;
+            return;
+        }
+        cached = byte;
+    }
+    m_debug.regWrites++;
+    m_chips[chipId]->writeReg(port, address, byte);
+    if(m_nextChips)
+        m_nextChips->chips[chipId]->writeReg(port, address, byte);
+}
+
+void Generator::WriteRegAll(uint8_t port, uint16_t address, uint8_t byte)
+{
+    for(size_t i = 0, n = m_chips.size(); i < n; ++i)
+        WriteReg(static_cast<uint32_t>(i), port, address, byte);
 }
 
 void Generator::NoteOff(uint32_t c)
 {
-    uint8_t cc = static_cast<uint8_t>(c % 6);
-    WriteReg(0, 0x28, (c <= 2) ? cc : cc + 1);
+    WriteReg(chanChip(c), 0, 0x28, chanKey(c));
 }
 
 void Generator::NoteOn(uint32_t c, double hertz) // Hertz range: 0..131071
 {
-    uint8_t  cc     = uint8_t(c % 3);
-    uint8_t  port   = uint8_t((c <= 2) ? 0 : 1);
+    uint32_t chip   = chanChip(c);
+    uint8_t  cc     = chanReg(c);
+    uint8_t  port   = chanPort(c);
     uint32_t octave = 0, ftone = 0;
     uint32_t mul_offset = 0;
 
@@ -254,9 +662,11 @@ void Generator::NoteOn(uint32_t c, double hertz) // Hertz range: 0..131071
     }
     ftone = octave + static_cast<uint32_t>(hertz + 0.5);
 
+    const OPN_PatchSetup *channelPatch = m_noteManager.channel(static_cast<int>(c)).patch;
+    const OPN_PatchSetup &patch = channelPatch ? *channelPatch : m_patch;
     for(size_t op = 0; op < 4; op++)
     {
-        uint32_t reg = m_patch.OPS[op].data[0];
+        uint32_t reg = patch.OPS[op].data[0];
         uint16_t address = 0x30 + (op * 4) + cc;
         if(mul_offset > 0) // Increase frequency multiplication value
         {
@@ -267,17 +677,17 @@ void Generator::NoteOn(uint32_t c, double hertz) // Hertz range: 0..131071
                 mul_offset = 0;
                 mul = 0x0F;
             }
-            WriteReg(port, address, uint8_t(dt | (mul + mul_offset)));
+            WriteReg(chip, port, address, uint8_t(dt | (mul + mul_offset)));
         }
         else
         {
-            WriteReg(port, address, uint8_t(reg));
+            WriteReg(chip, port, address, uint8_t(reg));
         }
     }
 
-    WriteReg(port, 0xA4 + cc, (ftone >> 8) & 0xFF);//Set frequency and octave
-    WriteReg(port, 0xA0 + cc,  ftone & 0xFF);
-    WriteReg(0, 0x28, 0xF0 + uint8_t((c <= 2) ? c : c + 1));
+    WriteReg(chip, port, 0xA4 + cc, (ftone >> 8) & 0xFF);//Set frequency and octave
+    WriteReg(chip, port, 0xA0 + cc,  ftone & 0xFF);
+    WriteReg(chip, 0, 0x28, 0xF0 + chanKey(c));
 }
 
 void Generator::touchNote(uint32_t c,
@@ -286,129 +696,40 @@ void Generator::touchNote(uint32_t c,
                           uint8_t channelExpression,
                           uint32_t brightness)
 {
-    uint8_t cc   =  c % 3;
-    uint8_t port = (c <= 2) ? 0 : 1;
-
-    uint_fast32_t volume = 0;
-
-    uint8_t op_vol[4] =
-    {
-        m_patch.OPS[OPERATOR1].data[1],
-        m_patch.OPS[OPERATOR2].data[1],
-        m_patch.OPS[OPERATOR3].data[1],
-        m_patch.OPS[OPERATOR4].data[1],
-    };
-
-    bool alg_do[8][4] =
-    {
-        /*
-         * Yeah, Operator 2 and 3 are seems swapped
-         * which we can see in the algorithm 4
-         */
-        //OP1   OP3   OP2    OP4
-        //30    34    38     3C
-        {false,false,false,true},//Algorithm #0:  W = 1 * 2 * 3 * 4
-        {false,false,false,true},//Algorithm #1:  W = (1 + 2) * 3 * 4
-        {false,false,false,true},//Algorithm #2:  W = (1 + (2 * 3)) * 4
-        {false,false,false,true},//Algorithm #3:  W = ((1 * 2) + 3) * 4
-        {false,false,true, true},//Algorithm #4:  W = (1 * 2) + (3 * 4)
-        {false,true ,true ,true},//Algorithm #5:  W = (1 * (2 + 3 + 4)
-        {false,true ,true ,true},//Algorithm #6:  W = (1 * 2) + 3 + 4
-        {true ,true ,true ,true},//Algorithm #7:  W = 1 + 2 + 3 + 4
-    };
-
-
-    switch(m_volumeScale)
-    {
-    default:
-    case VOLUME_Generic:
-    {
-        volume = velocity * 127 *
-                 channelVolume * channelExpression;
-
-        /* If the channel has arpeggio, the effective volume of
-             * *this* instrument is actually lower due to timesharing.
-             * To compensate, add extra volume that corresponds to the
-             * time this note is *not* heard.
-             * Empirical tests however show that a full equal-proportion
-             * increment sounds wrong. Therefore, using the square root.
-             */
-        //volume = (int)(volume * std::sqrt( (double) ch[c].users.size() ));
-        const double c1 = 11.541560327111707;
-        const double c2 = 1.601379199767093e+02;
-        const uint_fast32_t minVolume = 1108075; // 8725 * 127
-
-        // The formula below: SOLVE(V=127^4 * 2^( (A-63.49999) / 8), A)
-        if(volume > minVolume)
-        {
-            double lv = std::log(static_cast<double>(volume));
-            volume = static_cast<uint_fast32_t>(lv * c1 - c2) * 2;
-        }
-        else
-            volume = 0;
-    }
-    break;
+    uint32_t chip = chanChip(c);
+    uint8_t  cc   = chanReg(c);
+    uint8_t  port = chanPort(c);
 
-    case VOLUME_CMF:
-    {
-        volume = velocity * channelVolume * channelExpression;
-        //volume = volume * m_masterVolume / (127 * 127 * 127) / 2;
-        volume = ((volume * 127) / 4096766);
-
-        if(volume > 0)
-            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
-    }
-    break;
-
-    case VOLUME_DMX:
-    {
-        volume = (channelVolume * channelExpression * 127) / 16129;
-        volume = (s_dmx_volume_model[volume] + 1) << 1;
-        volume = (s_dmx_volume_model[(velocity < 128) ? velocity : 127] * volume) >> 9;
-
-        if(volume > 0)
-            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
-    }
-    break;
-
-    case VOLUME_APOGEE:
-    {
-        volume = (channelVolume * channelExpression * 127 / 16129);
-        volume = ((64 * (velocity + 0x80)) * volume) >> 15;
-        //volume = ((63 * (vol + 0x80)) * Ch[MidCh].volume) >> 15;
-        if(volume > 0)
-            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
-    }
-    break;
+    const VolumeTables &tables = volumeTables();
+    const OPN_PatchSetup *channelPatch = m_noteManager.channel(static_cast<int>(c)).patch;
+    const OPN_PatchSetup &patch = channelPatch ? *channelPatch : m_patch;
 
-    case VOLUME_9X:
-    {
-        //volume = 63 - W9X_volume_mapping_table[(((vol * Ch[MidCh].volume /** Ch[MidCh].expression*/) * 127 / 16129 /*2048383*/) >> 2)];
-        volume = 63 - W9X_volume_mapping_table[((velocity * channelVolume * channelExpression * 127 / 2048383) >> 2)];
-        //volume = W9X_volume_mapping_table[vol >> 2] + volume;
-        if(volume > 0)
-            volume += 64;//OPN has 0~127 range. As 0...63 is almost full silence, but at 64 to 127 is very closed to OPL3, just add 64.
-    }
-    break;
-    }
+    if(velocity > 127)
+        velocity = 127;
+    if(channelVolume > 127)
+        channelVolume = 127;
+    if(channelExpression > 127)
+        channelExpression = 127;
+    if(brightness > 127)
+        brightness = 127;
 
-    if(volume > 127)
-        volume = 127;
+    uint_fast32_t volume = m_volumeTable[velocity * VolumeTables::PRODUCT_CLASSES +
+                                         tables.productIndex[channelVolume * 128 + channelExpression]];
 
-    uint8_t alg = m_patch.fbalg & 0x07;
+    uint8_t carriers = s_alg_carrier_mask[patch.fbalg & 0x07];
+    uint32_t modScale = tables.brightness[brightness];
 
     for(uint8_t op = 0; op < 4; op++)
     {
-        bool do_op = alg_do[alg][op];
-        uint32_t x = op_vol[op];
-        uint32_t vol_res = do_op ? (127 - (static_cast<uint32_t>(volume) * (127 - (x & 127))) / 127) : x;
-        if(brightness != 127)
-        {
-            brightness = static_cast<uint32_t>(::round(127.0 * ::sqrt((static_cast<double>(brightness)) * (1.0 / 127.0))));
-            if(!do_op)
-                vol_res = (127 - (brightness * (127 - (static_cast<uint32_t>(vol_res) & 127))) / 127);
-        }
-        WriteReg(port, 0x40 + cc + (4 * op), vol_res);
+        uint32_t x = patch.OPS[op].data[1] & 127;
+        uint32_t vol_res;
+        if(carriers & (1 << op))
+            vol_res = 127 - (static_cast<uint32_t>(volume) * (127 - x)) / 127;
+        else if(brightness != 127)
+            vol_res = 127 - (modScale * (127 - x)) / 127;
+        else
+            vol_res = patch.OPS[op].data[1];
+        WriteReg(chip, port, 0x40 + cc + (4 * op), static_cast<uint8_t>(vol_res));
     }
     // Correct formula (ST3, AdPlug):
     //   63-((63-(instrvol))/63)*chanvol
@@ -420,29 +741,53 @@ void Generator::touchNote(uint32_t c,
 
 void Generator::Patch(uint32_t c)
 {
-    uint8_t port = (c <= 2) ? 0 : 1;
-    uint8_t cc   = c % 3;
+    uint32_t chip = chanChip(c);
+    uint8_t  port = chanPort(c);
+    uint8_t  cc   = chanReg(c);
+    const NotesManager::Note &channel = m_noteManager.channel(static_cast<int>(c));
+    const OPN_PatchSetup &patch = channel.patch ? *channel.patch : m_patch;
     for(uint8_t op = 0; op < 4; op++)
     {
-        WriteReg(port, 0x30 + (op * 4) + cc, m_patch.OPS[op].data[0]);
-        WriteReg(port, 0x40 + (op * 4) + cc, m_patch.OPS[op].data[1]);
-        WriteReg(port, 0x50 + (op * 4) + cc, m_patch.OPS[op].data[2]);
-        WriteReg(port, 0x60 + (op * 4) + cc, m_patch.OPS[op].data[3]);
-        WriteReg(port, 0x70 + (op * 4) + cc, m_patch.OPS[op].data[4]);
-        WriteReg(port, 0x80 + (op * 4) + cc, m_patch.OPS[op].data[5]);
-        WriteReg(port, 0x90 + (op * 4) + cc, m_patch.OPS[op].data[6]);
+        WriteReg(chip, port, 0x30 + (op * 4) + cc, patch.OPS[op].data[0]);
+        WriteReg(chip, port, 0x40 + (op * 4) + cc, patch.OPS[op].data[1]);
+        WriteReg(chip, port, 0x50 + (op * 4) + cc, patch.OPS[op].data[2]);
+        WriteReg(chip, port, 0x60 + (op * 4) + cc, patch.OPS[op].data[3]);
+        WriteReg(chip, port, 0x70 + (op * 4) + cc, patch.OPS[op].data[4]);
+        WriteReg(chip, port, 0x80 + (op * 4) + cc, patch.OPS[op].data[5]);
+        WriteReg(chip, port, 0x90 + (op * 4) + cc, patch.OPS[op].data[6]);
     }
-    m_pan_lfo[c] = (m_pan_lfo[c] & 0xC0) | (m_patch.lfosens & 0x3F);
-    WriteReg(port, 0xB0 + cc, m_patch.fbalg);
-    WriteReg(port, 0xB4 + cc, m_pan_lfo[c]);
+    m_pan_lfo[c] = (m_pan_lfo[c] & 0xC0) | (patch.lfosens & 0x3F);
+    WriteReg(chip, port, 0xB0 + cc, patch.fbalg);
+    WriteReg(chip, port, 0xB4 + cc, m_pan_lfo[c]);
+    m_noteManager.setPatch(static_cast<int>(c), channel.patch ? channel.patchKey : m_patchId);
 }
 
 void Generator::Pan(uint32_t c, uint8_t value)
 {
-    uint8_t cc = c % 3;
-    uint8_t port = (c <= 2) ? 0 : 1;
-    m_pan_lfo[c] = (value & 0xC0) | (m_patch.lfosens & 0x3F);
-    WriteReg(port, 0xB4 + cc, m_pan_lfo[c]);
+    uint32_t chip = chanChip(c);
+    uint8_t  port = chanPort(c);
+    uint8_t  cc   = chanReg(c);
+    const OPN_PatchSetup *patch = m_noteManager.channel(static_cast<int>(c)).patch;
+    uint8_t lfosens = patch ? patch->lfosens : m_patch.lfosens;
+    m_pan_lfo[c] = (value & 0xC0) | (lfosens & 0x3F);
+    WriteReg(chip, port, 0xB4 + cc, m_pan_lfo[c]);
+}
+
+double Generator::releaseSpeed(const OPN_PatchSetup &patch) const
+{
+    // The longest release among the carriers defines the tail
+    uint8_t carriers = s_alg_carrier_mask[patch.fbalg & 0x07];
+    double speed = -1.0;
+    for(uint8_t op = 0; op < 4; op++)
+    {
+        if(!(carriers & (1 << op)))
+            continue;
+        unsigned rr = patch.OPS[op].data[5] & 0x0F;
+        double opSpeed = envelopeSpeed(rr * 4 + 2);
+        if(speed < 0.0 || opSpeed < speed)
+            speed = opSpeed;
+    }
+    return speed / m_rate;
 }
 
 void Generator::PlayNoteF(int noteID, uint32_t volume, uint8_t ccvolume, uint8_t ccexpr)
@@ -450,8 +795,16 @@ void Generator::PlayNoteF(int noteID, uint32_t volume, uint8_t ccvolume, uint8_t
     if(!m_isInstrumentLoaded)
         return;//Deny playing notes without instrument loaded
 
+    playNote(PART_EDITOR, noteID, &m_patch, m_patchId, volume, ccvolume, ccexpr);
+}
+
+void Generator::playNote(unsigned part, int noteID,
+                         const OPN_PatchSetup *patch, uint64_t patchKey,
+                         uint32_t volume, uint8_t ccvolume, uint8_t ccexpr)
+{
     bool replace;
-    int ch = m_noteManager.noteOn(noteID, volume, ccvolume, ccexpr, &replace);
+    int ch = m_noteManager.noteOn(noteID, static_cast<uint8_t>(part), patch, patchKey,
+                                  volume, ccvolume, ccexpr, &replace);
 
     if(replace)
     {
@@ -465,15 +818,16 @@ void Generator::PlayNoteF(int noteID, uint32_t volume, uint8_t ccvolume, uint8_t
 
 void Generator::PlayNoteCh(int ch, bool patch)
 {
-    if(!m_isInstrumentLoaded)
+    const NotesManager::Note &channel = m_noteManager.channel(ch);
+    if(!channel.patch)
         return;//Deny playing notes without instrument loaded
 
+    const OPN_PatchSetup &setup = *channel.patch;
     int tone;
-    const NotesManager::Note &channel = m_noteManager.channel(ch);
 
-    if(m_patch.tone)
+    if(setup.tone)
     {
-        tone = m_patch.tone;
+        tone = setup.tone;
         if(tone > 128)
             tone -= 128;
     }
@@ -487,7 +841,7 @@ void Generator::PlayNoteCh(int ch, bool patch)
     double bend = 0.0;
     double phase = 0.0;
 
-    if(patch)
+    if(patch && channel.patchId != channel.patchKey)
     {
         Patch(ch);
         Pan(ch, 0xC0);
@@ -495,7 +849,7 @@ void Generator::PlayNoteCh(int ch, bool patch)
 
     touchNote(ch, channel.volume, channel.ccvolume, channel.ccexpr);
 
-    bend  = m_bend + m_patch.finetune;
+    bend  = m_parts[channel.part].bend + setup.finetune;
     NoteOn(ch, std::exp(0.057762265 * (tone + bend + phase)));
 }
 
@@ -504,7 +858,12 @@ void Generator::StopNoteF(int noteID)
     if(!m_isInstrumentLoaded)
         return;//Deny playing notes without instrument loaded
 
-    int ch = m_noteManager.findNoteOffChannel(noteID);
+    stopNote(PART_EDITOR, noteID);
+}
+
+void Generator::stopNote(unsigned part, int noteID)
+{
+    int ch = m_noteManager.findNoteOffChannel(noteID, static_cast<uint8_t>(part));
     if (ch == -1)
         return;
 
@@ -513,16 +872,17 @@ void Generator::StopNoteF(int noteID)
 
 void Generator::StopNoteCh(int ch)
 {
-    if(!m_isInstrumentLoaded)
+    const NotesManager::Note &channel = m_noteManager.channel(ch);
+    if(!channel.patch)
         return;//Deny playing notes without instrument loaded
 
-    if(m_hold)
+    if(m_parts[channel.part].hold)
     {
         m_noteManager.hold(ch, true);  // stop later after hold is over
         return;
     }
 
-    m_noteManager.channelOff(ch);
+    m_noteManager.channelOff(ch, releaseSpeed(*channel.patch));
 
     NoteOff(ch);
 }
@@ -532,45 +892,26 @@ void Generator::PitchBend(int bend)
     if(!m_isInstrumentLoaded)
         return;//Deny playing notes without instrument loaded
 
-    m_bend = bend * m_bendsense;
-
-    int channels = m_noteManager.channelCount();
-    for(int ch = 0; ch < channels; ++ch)
-    {
-        const NotesManager::Note &channel = m_noteManager.channel(ch);
-        if(channel.note != -1)
-            PlayNoteCh(ch, false);  // updates frequency
-    }
+    pitchBend(PART_EDITOR, bend);
 }
 
-void Generator::PlayDrum(uint8_t drum, int noteID)
+void Generator::pitchBend(unsigned part, int bend)
 {
-    if(!m_isInstrumentLoaded)
-        return;//Deny playing notes without instrument loaded
+    Part &p = m_parts[part];
+    p.bend = bend * p.bendsense;
 
-    int tone = noteID;
-
-    if(m_patch.tone)
+    for(int ch = m_noteManager.firstPlaying(); ch >= 0; ch = m_noteManager.nextPlaying(ch))
     {
-        tone = m_patch.tone;
-        if(tone > 128)
-            tone -= 128;
+        if(m_noteManager.channel(ch).part == part)
+            PlayNoteCh(ch, false);  // updates frequency
     }
-
-    uint32_t adlchannel = 18 + drum;
-    //Patch(adlchannel);
-    Pan(adlchannel, 0xC0);
-    touchNote(adlchannel, 127, 127, 127, 127);
-    double bend = 0.0;
-    double phase = 0.0;
-    bend  = m_bend + m_patch.finetune;
-    NoteOn(adlchannel, std::exp(0.057762265 * (tone + bend + phase)));
 }
 
 void Generator::Silence()
 {
     //Shutup!
-    for(uint32_t c = 0; c < NUM_OF_CHANNELS; ++c)
+    uint32_t channels = static_cast<uint32_t>(m_noteManager.channelCount());
+    for(uint32_t c = 0; c < channels; ++c)
     {
         NoteOff(c);
         touchNote(c, 0, 0, 0);
@@ -579,29 +920,39 @@ void Generator::Silence()
     m_noteManager.clearNotes();
 }
 
+void Generator::silenceChannel(int ch)
+{
+    NoteOff(static_cast<uint32_t>(ch));
+    touchNote(static_cast<uint32_t>(ch), 0, 0, 0);
+    // The tail is cut, so it's already silent
+    m_noteManager.channelOff(ch, NotesManager::silenceLevel);
+}
+
 void Generator::NoteOffAllChans()
 {
-    if(m_hold)
+    noteOffAll(-1);
+}
+
+void Generator::noteOffAll(int part)
+{
+    int next;
+    for(int ch = m_noteManager.firstPlaying(); ch >= 0; ch = next)
     {
-        // mark all channels held for later key-off
-        int channels = m_noteManager.channelCount();
-        for(int ch = 0; ch < channels; ++ch)
+        next = m_noteManager.nextPlaying(ch);
+        const NotesManager::Note &channel = m_noteManager.channel(ch);
+        if(part >= 0 && channel.part != part)
+            continue;
+        if(m_parts[channel.part].hold)
         {
-            const NotesManager::Note &channel = m_noteManager.channel(ch);
-            if(channel.note != -1)
-                m_noteManager.hold(ch, true);
+            // mark channel held for later key-off
+            m_noteManager.hold(ch, true);
+            continue;
         }
-        return;
+        NoteOff(static_cast<uint32_t>(ch));
+        m_noteManager.channelOff(ch, channel.patch ? releaseSpeed(*channel.patch) : 0.0);
     }
-
-    for(uint32_t c = 0; c < NUM_OF_CHANNELS; ++c)
-        NoteOff(c);
-
-    m_noteManager.clearNotes();
 }
 
-
-
 void Generator::PlayNote(uint32_t volume, uint8_t ccvolume, uint8_t ccexpr)
 {
     PlayNoteF(note, volume, ccvolume, ccexpr);
@@ -664,7 +1015,7 @@ void Generator::StopNote()
 
 void Generator::PitchBendSensitivity(int cents)
 {
-    m_bendsense = cents * (1e-2 / 8192);
+    m_parts[PART_EDITOR].bendsense = cents * (1e-2 / 8192);
 }
 
 void Generator::Hold(bool held)
@@ -672,18 +1023,24 @@ void Generator::Hold(bool held)
     if(!m_isInstrumentLoaded)
         return;//Deny playing notes without instrument loaded
 
-    if (m_hold == held)
+    hold(PART_EDITOR, held);
+}
+
+void Generator::hold(unsigned part, bool held)
+{
+    Part &p = m_parts[part];
+    if (p.hold == held)
         return;
-    m_hold = held;
+    p.hold = held;
 
     if (!held)
     {
         // key-off all held notes now
-        int channels = m_noteManager.channelCount();
-        for(int ch = 0; ch < channels; ++ch)
+        int next;
+        for(int ch = m_noteManager.firstHeld(); ch >= 0; ch = next)
         {
-            const NotesManager::Note &channel = m_noteManager.channel(ch);
-            if(channel.note != -1 && channel.held)
+            next = m_noteManager.nextHeld(ch);
+            if(m_noteManager.channel(ch).part == part)
                 StopNoteCh(ch);
         }
     }
@@ -691,34 +1048,190 @@ void Generator::Hold(bool held)
 
 void Generator::changePatch(const FmBank::Instrument &instrument, bool isDrum)
 {
-    //Shutup everything
-    Silence();
-    m_bend = 0.0;
-    m_bendsense = 2.0 / 8192;
-    //m_hold = false;
+    //Shutup everything which plays the edited patch
+    int next;
+    for(int ch = m_noteManager.firstPlaying(); ch >= 0; ch = next)
     {
-        for(int op = 0; op < 4; op++)
+        next = m_noteManager.nextPlaying(ch);
+        if(m_noteManager.channel(ch).patch == &m_patch)
+            silenceChannel(ch);
+    }
+
+    Part &p = m_parts[PART_EDITOR];
+    p.bend = 0.0;
+    p.bendsense = 2.0 / 8192;
+
+    OPN_PatchBank::compile(instrument, isDrum, m_patch);
+
+    // Invalidate the patch uploaded into channels
+    if(++m_patchId == 0)
+        m_patchId = 1;
+
+    m_isInstrumentLoaded = true;//Mark instrument as loaded
+}
+
+void Generator::setPatchBank(OPN_PatchBank *bank)
+{
+    if(m_patchBank == bank)
+        return;
+
+    // Notes of the old bank keep playing, the caller keeps its images alive
+    m_patchBank = bank;
+
+    for(unsigned part = 0; part < MIDI_CHANNELS; ++part)
+        updatePartBank(part);
+}
+
+void Generator::changeBankImage(int index, const OPN_PatchSetup &image, bool playable)
+{
+    if(!m_patchBank || index < 0 || index >= static_cast<int>(m_patchBank->images.size()))
+        return;
+
+    m_patchBank->images[static_cast<size_t>(index)] = image;
+    m_patchBank->playable[static_cast<size_t>(index)] = playable ? 1 : 0;
+
+    // Channels which hold the old image must upload it again
+    const uint64_t key = m_patchBank->key(index);
+    for(int ch = 0; ch < m_noteManager.channelCount(); ++ch)
+    {
+        if(m_noteManager.channel(ch).patchId == key)
+            m_noteManager.setPatch(ch, 0);
+    }
+}
+
+bool Generator::playsPatchBank(const OPN_PatchBank &bank) const
+{
+    const OPN_PatchSetup *first = bank.images.data();
+    const OPN_PatchSetup *last = first + bank.images.size();
+    for(int ch = m_noteManager.firstPlaying(); ch >= 0; ch = m_noteManager.nextPlaying(ch))
+    {
+        const OPN_PatchSetup *patch = m_noteManager.channel(ch).patch;
+        if(patch >= first && patch < last)
+            return true;
+    }
+    return false;
+}
+
+void Generator::releasePatchBank(const OPN_PatchBank &bank)
+{
+    const OPN_PatchSetup *first = bank.images.data();
+    const OPN_PatchSetup *last = first + bank.images.size();
+    int next;
+    for(int ch = m_noteManager.firstPlaying(); ch >= 0; ch = next)
+    {
+        next = m_noteManager.nextPlaying(ch);
+        const NotesManager::Note &channel = m_noteManager.channel(ch);
+        if(channel.patch >= first && channel.patch < last)
         {
-            m_patch.OPS[op].data[0] = instrument.getRegDUMUL(op);
-            m_patch.OPS[op].data[1] = instrument.getRegLevel(op);
-            m_patch.OPS[op].data[2] = instrument.getRegRSAt(op);
-            m_patch.OPS[op].data[3] = instrument.getRegAMD1(op);
-            m_patch.OPS[op].data[4] = instrument.getRegD2(op);
-            m_patch.OPS[op].data[5] = instrument.getRegSysRel(op);
-            m_patch.OPS[op].data[6] = instrument.getRegSsgEg(op);
+            NoteOff(static_cast<uint32_t>(ch));
+            m_noteManager.channelOff(ch, releaseSpeed(*channel.patch));
         }
-        m_patch.fbalg    = instrument.getRegFbAlg();
-        m_patch.lfosens  = instrument.getRegLfoSens();
-        m_patch.finetune = static_cast<int8_t>(instrument.note_offset1);
-        m_patch.tone     = 0;
+    }
+}
 
-        if(isDrum || instrument.is_fixed_note)
-            m_patch.tone = instrument.percNoteNum;
+void Generator::updatePartBank(unsigned part)
+{
+    Part &p = m_parts[part];
+    if(!m_patchBank)
+    {
+        p.bankFirst = -1;
+        return;
     }
+    p.bankFirst = m_patchBank->findBank(p.percussion, p.bankMsb, p.bankLsb);
+}
 
-    m_noteManager.allocateChannels(USED_CHANNELS_4OP);
+void Generator::midiNoteOn(unsigned channel, int note, uint32_t velocity, uint8_t ccvolume, uint8_t ccexpr)
+{
+    const Part &p = m_parts[channel & 0x0F];
+    const OPN_PatchSetup *patch;
+    uint64_t patchKey;
 
-    m_isInstrumentLoaded = true;//Mark instrument as loaded
+    if(p.percussion || p.program >= 0)
+    {
+        if(!m_patchBank || p.bankFirst < 0)
+            return;
+        int index = p.bankFirst + (p.percussion ? (note & 0x7F) : p.program);
+        patch = m_patchBank->image(index);
+        if(!patch)
+            return;
+        patchKey = m_patchBank->key(index);
+    }
+    else
+    {
+        // Until the program change the channel plays the edited patch
+        if(!m_isInstrumentLoaded)
+            return;
+        patch = &m_patch;
+        patchKey = m_patchId;
+    }
+
+    playNote(channel & 0x0F, note, patch, patchKey, velocity, ccvolume, ccexpr);
+}
+
+void Generator::midiNoteOff(unsigned channel, int note)
+{
+    stopNote(channel & 0x0F, note);
+}
+
+void Generator::midiPitchBend(unsigned channel, int bend)
+{
+    pitchBend(channel & 0x0F, bend);
+}
+
+void Generator::midiPitchBendSensitivity(unsigned channel, int cents)
+{
+    m_parts[channel & 0x0F].bendsense = cents * (1e-2 / 8192);
+}
+
+void Generator::midiHold(unsigned channel, bool held)
+{
+    hold(channel & 0x0F, held);
+}
+
+void Generator::midiBankSelect(unsigned channel, bool lsb, uint8_t value)
+{
+    Part &p = m_parts[channel & 0x0F];
+    if(lsb)
+        p.bankLsb = value & 0x7F;
+    else
+        p.bankMsb = value & 0x7F;
+}
+
+void Generator::midiProgramChange(unsigned channel, uint8_t program)
+{
+    unsigned part = channel & 0x0F;
+    Part &p = m_parts[part];
+    // On percussion channel only the bank is chosen, the key selects the instrument
+    if(!p.percussion)
+        p.program = program & 0x7F;
+    updatePartBank(part);
+}
+
+void Generator::midiNoteOffAll(unsigned channel)
+{
+    noteOffAll(static_cast<int>(channel & 0x0F));
+}
+
+void Generator::midiSoundOff(unsigned channel)
+{
+    unsigned part = channel & 0x0F;
+    int next;
+    for(int ch = m_noteManager.firstPlaying(); ch >= 0; ch = next)
+    {
+        next = m_noteManager.nextPlaying(ch);
+        if(m_noteManager.channel(ch).part == part)
+            silenceChannel(ch);
+    }
+}
+
+void Generator::midiReset()
+{
+    for(unsigned part = 0; part < MIDI_CHANNELS; ++part)
+    {
+        m_parts[part] = Part();
+        m_parts[part].percussion = (part == 9);
+        updatePartBank(part);
+    }
 }
 
 void Generator::changeNote(int newnote)
@@ -732,142 +1245,158 @@ void Generator::changeLFO(bool enabled)
 {
     lfo_enable = uint8_t(enabled);
     lfo_reg = (((lfo_enable << 3)&0x08) | (lfo_freq & 0x07)) & 0x0F;
-    WriteReg(0, 0x22, lfo_reg);
+    WriteRegAll(0, 0x22, lfo_reg);
 }
 
 void Generator::changeLFOfreq(int freq)
 {
     lfo_freq = uint8_t(freq);
     lfo_reg = (((lfo_enable << 3)&0x08) | (lfo_freq & 0x07)) & 0x0F;
-    WriteReg(0, 0x22, lfo_reg);
+    WriteRegAll(0, 0x22, lfo_reg);
 }
 
 void Generator::changeVolumeModel(int volmodel)
 {
+    if(volmodel < VOLUME_Generic || volmodel > VOLUME_9X)
+        volmodel = VOLUME_Generic;
     m_volumeScale = volmodel;
+    m_volumeTable = volumeTables().level[volmodel].data();
 }
 
 void Generator::generate(int16_t *frames, unsigned nframes)
 {
-    chip->generate(frames, nframes);
+    size_t chips = m_chips.size();
+    m_chips[0]->generate(frames, nframes);
+    for(size_t i = 1; i < chips; ++i)
+        m_chips[i]->generateAndMix(frames, nframes);
+    if(m_nextChips)
+        generateChipSwitch(frames, nframes);
     // 2x Gain by default
     for(size_t i = 0; i < nframes * 2; ++i)
         frames[i] *= 2;
+    m_noteManager.advance(nframes);
+    m_debugClock += nframes;
 }
 
-Generator::NotesManager::NotesManager()
+void Generator::generateChipSwitch(int16_t *frames, unsigned nframes)
 {
-    channels.reserve(USED_CHANNELS_4OP);
-}
+    // new emulators are muted while their buffered register writes settle
+    const uint32_t warmFrames = m_rate * 150 / 1000;
+    const uint32_t fadeFrames = m_rate * 20 / 1000;
+    const uint32_t maxFrames = static_cast<uint32_t>(m_switchBuffer.size() / 2);
+    std::vector<std::unique_ptr<OPNChipBase>> &next = m_nextChips->chips;
 
-Generator::NotesManager::~NotesManager()
-{}
+    while(nframes > 0)
+    {
+        uint32_t n = (nframes < maxFrames) ? nframes : maxFrames;
+        int16_t *buffer = m_switchBuffer.data();
 
-void Generator::NotesManager::allocateChannels(int count)
-{
-    channels.clear();
-    channels.resize(count);
-    cycle = 0;
+        next[0]->generate(buffer, n);
+        for(size_t i = 1; i < next.size(); ++i)
+            next[i]->generateAndMix(buffer, n);
+
+        for(uint32_t f = 0; f < n; ++f)
+        {
+            uint32_t pos = m_switchFrames + f;
+            if(pos < warmFrames)
+                continue;
+            int32_t gain = (pos < warmFrames + fadeFrames) ?
+                static_cast<int32_t>((pos - warmFrames) * 256 / fadeFrames) : 256;
+            for(unsigned c = 0; c < 2; ++c)
+            {
+                int32_t prev = frames[2 * f + c];
+                int32_t cur = buffer[2 * f + c];
+                frames[2 * f + c] = static_cast<int16_t>((prev * (256 - gain) + cur * gain) / 256);
+            }
+        }
+
+        m_switchFrames += n;
+        frames += 2 * n;
+        nframes -= n;
+
+        if(m_switchFrames >= warmFrames + fadeFrames)
+        {
+            // the rest of the block is produced by the new emulators alone
+            if(nframes > 0)
+            {
+                next[0]->generate(frames, nframes);
+                for(size_t i = 1; i < next.size(); ++i)
+                    next[i]->generateAndMix(frames, nframes);
+            }
+            m_chips.swap(next);
+            m_retiredChips = std::move(m_nextChips);
+            return;
+        }
+    }
 }
 
-uint8_t Generator::NotesManager::noteOn(int note, uint32_t volume, uint8_t ccvolume, uint8_t ccexpr, bool *r)
+void Generator::collectDebugInfo(GeneratorDebugInfo &info)
 {
-    uint8_t beganAt = cycle;
-    uint8_t chan = 0;
-
-    // Increase age of all working notes;
-    for(Note &ch : channels)
+    // refresh the rates a few times per second, shorter periods are too noisy
+    uint64_t elapsed = m_debugClock - m_debugRateClock;
+    if(elapsed >= m_rate / 4)
     {
-        if(note >= 0)
-            ch.age++;
+        double scale = static_cast<double>(m_rate) / static_cast<double>(elapsed);
+        m_debug.regWritesRate = static_cast<uint32_t>((m_debug.regWrites - m_debugRateWrites) * scale);
+        m_debug.regElidedRate = static_cast<uint32_t>((m_debug.regElided - m_debugRateElided) * scale);
+        m_debugRateClock = m_debugClock;
+        m_debugRateWrites = m_debug.regWrites;
+        m_debugRateElided = m_debug.regElided;
     }
 
-    bool replace = true;
+    info.chan4op = m_debug.chan4op;
+    info.regWrites = m_debug.regWrites;
+    info.regElided = m_debug.regElided;
+    info.regWritesRate = m_debug.regWritesRate;
+    info.regElidedRate = m_debug.regElidedRate;
+    info.envelopes = false;
 
-    do
+    int channels = m_noteManager.channelCount();
+    if(channels > GeneratorDebugInfo::MAX_VOICES)
+        channels = GeneratorDebugInfo::MAX_VOICES;
+    info.voicesCount = static_cast<uint32_t>(channels);
+
+    for(int ch = 0; ch < channels; ++ch)
     {
-        chan = cycle++;
-        // Rotate cycles
-        if(cycle == channels.size())
-            cycle = 0;
+        const NotesManager::Note &n = m_noteManager.channel(ch);
+        GeneratorVoiceInfo &v = info.voices[ch];
 
-        if(channels[chan].note == -1)
+        v.note = static_cast<int16_t>(n.note);
+        v.part = n.part;
+        v.releaseAge = 0;
+        switch(m_noteManager.state(ch))
         {
-            channels[chan].note = note;
-            channels[chan].volume = volume;
-            channels[chan].ccvolume = ccvolume;
-            channels[chan].ccexpr = ccexpr;
-            channels[chan].held = false;
-            channels[chan].age = 0;
-            replace = false;
+        case NotesManager::STATE_PLAYING:
+            v.key = n.held ? GeneratorVoiceInfo::KEY_HELD : GeneratorVoiceInfo::KEY_ON;
+            break;
+        case NotesManager::STATE_RELEASED:
+            v.key = GeneratorVoiceInfo::KEY_RELEASED;
+            v.releaseAge = static_cast<uint32_t>(m_noteManager.releaseAge(ch) * 1000 / m_rate);
+            break;
+        default:
+            v.key = GeneratorVoiceInfo::KEY_IDLE;
             break;
         }
 
-        if (cycle == beganAt) // If no free channels found
-        {
-            int age = -1;
-            int oldest = -1;
-            // Find oldest note
-            for(uint8_t c = 0; c < channels.size(); c++)
-            {
-                if((channels[c].note >= 0) && ((age == -1) || (channels[c].age > age)))
-                {
-                    oldest = c;
-                    age = channels[c].age;
-                }
-            }
+        // bank keys carry the serial of the bank in high bits
+        if(n.patchId == 0)
+            v.patch = GeneratorVoiceInfo::PATCH_NONE;
+        else if((n.patchId >> 32) == 0)
+            v.patch = GeneratorVoiceInfo::PATCH_EDITOR;
+        else
+            v.patch = static_cast<int32_t>(n.patchId & 0xFFFFFFFF) - 1;
 
-            if(age >= 0)
+        const OPNChipBase &chip = *m_chips[chanChip(static_cast<uint32_t>(ch))];
+        unsigned chipChannel = static_cast<unsigned>(ch % NUM_OF_CHANNELS);
+        for(unsigned op = 0; op < 4; ++op)
+        {
+            if(chip.readEnvelope(chipChannel, op, v.egPhase[op], v.egLevel[op]))
+                info.envelopes = true;
+            else
             {
-                chan = (uint8_t)oldest;
-                channels[chan].note = note;
-                channels[chan].volume = volume;
-                channels[chan].ccvolume = ccvolume;
-                channels[chan].ccexpr = ccexpr;
-                channels[chan].held = false;
-                channels[chan].age = 0;
+                v.egPhase[op] = OPNChipBase::ENVELOPE_OFF;
+                v.egLevel[op] = 1023;
             }
-            break;
         }
-    } while(1);
-
-    if(r)
-        *r = replace;
-
-    return chan;
-}
-
-int8_t Generator::NotesManager::noteOff(int note)
-{
-    int8_t chan = findNoteOffChannel(note);
-    if(chan != -1)
-        channelOff(chan);
-    return chan;
-}
-
-void Generator::NotesManager::channelOff(int ch)
-{
-    channels[ch].note = -1;
-}
-
-int8_t Generator::NotesManager::findNoteOffChannel(int note)
-{
-    // find the first active note not in held state (delayed noteoff)
-    for(uint8_t chan = 0; chan < channels.size(); chan++)
-    {
-        if(channels[chan].note == note && !channels[chan].held)
-            return (int8_t)chan;
     }
-    return -1;
-}
-
-void Generator::NotesManager::hold(int ch, bool h)
-{
-    channels[ch].held = h;
-}
-
-void Generator::NotesManager::clearNotes()
-{
-    for(uint8_t chan = 0; chan < channels.size(); chan++)
-        channels[chan].note = -1;
 }
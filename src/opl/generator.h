@@ -20,16 +20,19 @@
 #define GENERATOR_H
 
 #include "chips/opn_chip_base.h"
+#include "notes_manager.h"
 
 #include "../bank.h"
 #include <stdint.h>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include <QIODevice>
 #include <QObject>
 
 #define NUM_OF_CHANNELS         6
+#define MAX_OPN_CHIPS           8
 #define MAX_OPLGEN_BUFFER_SIZE  4096
 
 struct OPN_Operator
@@ -50,10 +53,67 @@ struct OPN_PatchSetup
     uint8_t         tone;
 };
 
+struct OPN_PatchBank;
+
+//! State of the chip channel, as seen by the voice allocator and by the chip
+struct GeneratorVoiceInfo
+{
+    enum KeyState
+    {
+        //! Channel is silent
+        KEY_IDLE = 0,
+        //! Key-off was sent and the release tail is still sounding
+        KEY_RELEASED,
+        //! Channel is keyed on
+        KEY_ON,
+        //! Key is released, but the sustain pedal keeps the channel on
+        KEY_HELD
+    };
+    enum
+    {
+        //! Channel was never given a patch
+        PATCH_NONE = -2,
+        //! Channel plays the patch of the editor
+        PATCH_EDITOR = -1
+    };
+    //! Last played key, -1 if none
+    int16_t     note = -1;
+    //! Part (MIDI channel) which played the note, 16 is the editor
+    uint8_t     part = 0;
+    //! One of KeyState
+    uint8_t     key = KEY_IDLE;
+    //! Index of the instrument in the bank, or one of PATCH_NONE and PATCH_EDITOR
+    int32_t     patch = PATCH_NONE;
+    //! Time since the key-off in milliseconds
+    uint32_t    releaseAge = 0;
+    //! Envelope phases of operators in order of registers, see OPNChipBase::EnvelopePhase
+    uint8_t     egPhase[4] = {0, 0, 0, 0};
+    //! Envelope attenuations of operators, 0 (loudest) to 1023 (silent)
+    uint16_t    egLevel[4] = {1023, 1023, 1023, 1023};
+};
+
 struct GeneratorDebugInfo
 {
+    enum { MAX_VOICES = NUM_OF_CHANNELS * MAX_OPN_CHIPS };
+
+    //! Channel of the last started note
     int32_t chan4op = -1;
-    QString toStr();
+    //! Count of valid entries in voices
+    uint32_t voicesCount = 0;
+    //! Whether the emulator reports the envelopes of operators
+    bool    envelopes = false;
+    GeneratorVoiceInfo voices[MAX_VOICES];
+    //! Register writes which were sent to chips
+    uint64_t regWrites = 0;
+    //! Register writes which were skipped as the register already had the value
+    uint64_t regElided = 0;
+    //! Register writes per second, sent and skipped
+    uint32_t regWritesRate = 0;
+    uint32_t regElidedRate = 0;
+    //! MIDI messages lost because the input queue was full
+    uint32_t midiDropped = 0;
+
+    QString toStr() const;
 };
 
 class Generator
@@ -71,12 +131,57 @@ public:
         CHIP_PMDWIN,
         CHIP_END
     };
-    Generator(uint32_t sampleRate, OPN_Chips initialChip);
+    Generator(uint32_t sampleRate, OPN_Chips initialChip, unsigned chipsCount = 1);
     ~Generator();
 
     void initChip();
     void switchChip(OPN_Chips chipId, int family = static_cast<int>(OPNChip_OPN2));
 
+    //! Emulators built aside to replace the running ones
+    struct ChipSet
+    {
+        OPN_Chips   chipId = CHIP_Nuked;
+        OPNFamily   family = OPNChip_OPN2;
+        std::vector<std::unique_ptr<OPNChipBase>> chips;
+    };
+    /**
+     * @brief Build emulators for the chip switch, running ones are not touched
+     *
+     * Reads only the constant sample rate, so may be called from any thread.
+     * @param chipId Type of the emulator
+     * @param family Family of chips
+     * @param count Count of chips, must be equal to chipsCount()
+     * @return New set of emulators
+     */
+    ChipSet *createChipSet(OPN_Chips chipId, int family, unsigned count) const;
+    /**
+     * @brief Start the seamless switch to the prepared emulators
+     *
+     * Registers of running chips are replayed into the new ones, which are
+     * then run muted until their register writes settle, and finally faded
+     * in while the running ones fade out. Playing notes are kept, unless the
+     * family of chips changes.
+     * @param set Prepared emulators, the generator takes them on success
+     * @return false if the previous switch is still in progress or the count of chips differs
+     */
+    bool beginChipSwitch(ChipSet *set);
+    //! Whether the switch is in progress, or its replaced emulators were not taken yet
+    bool isSwitchingChips() const
+        { return m_nextChips || m_retiredChips; }
+    /**
+     * @brief Take the emulators replaced by the finished switch
+     * @return Set to delete outside of the audio thread, or null if none
+     */
+    ChipSet *takeRetiredChips()
+        { return m_retiredChips.release(); }
+    /**
+     * @brief Change count of emulated chips, each chip gives 6 more voices
+     * @param count Count of chips from 1 to MAX_OPN_CHIPS
+     */
+    void setChipsCount(unsigned count);
+    unsigned chipsCount() const
+        { return static_cast<unsigned>(m_chips.size()); }
+
     void generate(int16_t *frames, unsigned nframes);
 
     void NoteOn(uint32_t c, double hertz);
@@ -94,7 +199,6 @@ public:
     void PlayNoteCh(int channelID, bool patch = true);
     void StopNoteF(int noteID);
     void StopNoteCh(int channelID);
-    void PlayDrum(uint8_t drum, int noteID);
 
     enum VolumesScale
     {
@@ -124,63 +228,118 @@ public:
     void changePatch(const FmBank::Instrument &instrument, bool isDrum = false);
     void changeNote(int newnote);
 
+    /* Multi-timbral playback of the bank by MIDI channels */
+
+    /**
+     * @brief Set the register images of the bank played by MIDI channels
+     * @param bank Images, must stay alive until the next call
+     *
+     * The notes of the old bank keep sounding, its images must stay alive
+     * until playsPatchBank() returns false for it.
+     */
+    void setPatchBank(OPN_PatchBank *bank);
+    OPN_PatchBank *patchBank() const
+        { return m_patchBank; }
+    /**
+     * @brief Replace one register image of the current bank in place
+     * @param index Index of the image, melodic ones first, then percussion
+     * @param image New register image
+     * @param playable Whether the instrument is not blank
+     */
+    void changeBankImage(int index, const OPN_PatchSetup &image, bool playable);
+    //! Whether any playing note refers an image of the bank
+    bool playsPatchBank(const OPN_PatchBank &bank) const;
+    //! Key off the notes which refer the images of the bank
+    void releasePatchBank(const OPN_PatchBank &bank);
+
+    void midiNoteOn(unsigned channel, int note, uint32_t velocity, uint8_t ccvolume, uint8_t ccexpr);
+    void midiNoteOff(unsigned channel, int note);
+    void midiPitchBend(unsigned channel, int bend);
+    void midiPitchBendSensitivity(unsigned channel, int cents);
+    void midiHold(unsigned channel, bool held);
+    void midiBankSelect(unsigned channel, bool lsb, uint8_t value);
+    void midiProgramChange(unsigned channel, uint8_t program);
+    void midiNoteOffAll(unsigned channel);
+    void midiSoundOff(unsigned channel);
+    void midiReset();
+
     void changeLFO(bool enabled);
     void changeLFOfreq(int freq);
     void changeVolumeModel(int volmodel);
 
-    const GeneratorDebugInfo &debugInfo() const
-        { return m_debug; }
+    uint32_t sampleRate() const
+        { return m_rate; }
+
+    /**
+     * @brief Take the snapshot of voices and of register statistics
+     * @param info Destination of the snapshot
+     */
+    void collectDebugInfo(GeneratorDebugInfo &info);
 
 private:
+    //! Statistics of the generator, voices are filled on collection
     GeneratorDebugInfo m_debug;
+    //! Sample clock and counters at the last update of the write rates
+    uint64_t    m_debugClock = 0;
+    uint64_t    m_debugRateClock = 0;
+    uint64_t    m_debugRateWrites = 0;
+    uint64_t    m_debugRateElided = 0;
 
 private:
-    void WriteReg(uint8_t port, uint16_t address, uint8_t byte);
+    void WriteReg(uint32_t chipId, uint8_t port, uint16_t address, uint8_t byte);
+    //! Write the global register into every chip
+    void WriteRegAll(uint8_t port, uint16_t address, uint8_t byte);
+    static OPNChipBase *createChip(OPN_Chips chipId, OPNFamily family);
+    //! Write known registers into the new emulator of the chip
+    void replayRegisters(OPNChipBase &chip, uint32_t chipId, bool keys);
+    //! Generate the output of the switch and finish it when done
+    void generateChipSwitch(int16_t *frames, unsigned nframes);
+    //! Estimated speed of release of the patch in decibels per sample
+    double releaseSpeed(const OPN_PatchSetup &patch) const;
+
+    void playNote(unsigned part, int noteID,
+                  const OPN_PatchSetup *patch, uint64_t patchKey,
+                  uint32_t volume, uint8_t ccvolume, uint8_t ccexpr);
+    void stopNote(unsigned part, int noteID);
+    void pitchBend(unsigned part, int bend);
+    void hold(unsigned part, bool held);
+    //! Key-off notes of the part, or of all parts if negative
+    void noteOffAll(int part);
+    //! Cut the note immediately
+    void silenceChannel(int ch);
+    void updatePartBank(unsigned part);
 
-    class NotesManager
+    NotesManager m_noteManager;
+
+    enum
+    {
+        MIDI_CHANNELS = 16,
+        //! Part played by the editor controls
+        PART_EDITOR = MIDI_CHANNELS,
+        PARTS_COUNT
+    };
+
+    //! State of the MIDI channel or of the editor controls
+    struct Part
     {
-    public:
-        struct Note
-        {
-            //! Currently pressed key. -1 means channel is free
-            int note    = -1;
-            //! Note volume determined by velocity
-            uint32_t volume = 0;
-            //! Channel volume determined by controller
-            uint8_t ccvolume = 0;
-            //! Channel expression determined by controller
-            uint8_t ccexpr = 0;
-            //! Age in count of noteOn requests
-            int age = 0;
-            //! Whether it has a pending noteOff being delayed while held
-            bool held = false;
-        };
-    private:
-        //! Channels range, contains entries count equal to chip channels
-        QVector<Note> channels;
-        //! Round-Robin cycler. Looks for any free channel that is not busy. Otherwise, oldest busy note will be replaced
-        uint8_t cycle = 0;
-    public:
-        NotesManager();
-        ~NotesManager();
-        void allocateChannels(int count);
-        uint8_t noteOn(int note, uint32_t volume, uint8_t ccvolume, uint8_t ccexpr, bool *replace = nullptr);
-        int8_t  noteOff(int note);
-        void    channelOff(int ch);
-        int8_t  findNoteOffChannel(int note);
-        void hold(int ch, bool h);
-        void clearNotes();
-        const Note &channel(int ch) const
-            { return channels.at(ch); }
-        int channelCount() const
-            { return static_cast<int>(channels.size()); }
-    } m_noteManager;
+        double  bend = 0.0;
+        double  bendsense = 2.0 / 8192;
+        bool    hold = false;
+        bool    percussion = false;
+        uint8_t bankMsb = 0;
+        uint8_t bankLsb = 0;
+        //! Chosen program, -1 to play the edited patch
+        int     program = -1;
+        //! Index of the first image of the chosen bank, -1 if none
+        int     bankFirst = -1;
+    } m_parts[PARTS_COUNT];
+
+    OPN_PatchBank *m_patchBank = nullptr;
 
     int32_t     note;
-    double      m_bend = 0.0;
-    double      m_bendsense = 2.0 / 8192;
-    bool        m_hold = false;
     int         m_volumeScale = VOLUME_Generic;
+    //! Precompiled levels of the current volume model
+    const uint8_t *m_volumeTable = nullptr;
     bool        m_isInstrumentLoaded = false;
     uint8_t     lfo_enable = 0x00;
     uint8_t     lfo_freq   = 0x00;
@@ -188,17 +347,30 @@ private:
     OPNFamily   m_chipFamily = OPNChip_OPN2;
 
     OPN_PatchSetup m_patch;
+    //! Identifier of the current patch, changes on every patch change
+    uint32_t    m_patchId = 0;
 
     uint32_t    m_rate = 44100;
 
-    std::unique_ptr<OPNChipBase> chip;
+    OPN_Chips   m_chipId = CHIP_Nuked;
+    std::vector<std::unique_ptr<OPNChipBase>> m_chips;
+    //! Emulators being switched to, they get all register writes too
+    std::unique_ptr<ChipSet> m_nextChips;
+    //! Emulators replaced by the last switch
+    std::unique_ptr<ChipSet> m_retiredChips;
+    //! Frames generated since the beginning of the switch
+    uint32_t    m_switchFrames = 0;
+    //! Output of the new emulators during the switch
+    std::vector<int16_t> m_switchBuffer;
 
-    //! index of operators pair, cached, needed by Touch()
-    uint16_t    m_ins[NUM_OF_CHANNELS];
-    //! value poked to B0, cached, needed by NoteOff)(
-    uint8_t     m_pit[NUM_OF_CHANNELS];
     //! LFO and panning value cached
-    uint8_t     m_pan_lfo[NUM_OF_CHANNELS];
+    std::vector<uint8_t> m_pan_lfo;
+
+    enum { REGS_PER_CHIP = 0x200, REG_UNKNOWN = 0x100 };
+    //! Last values written into registers of chips, REG_UNKNOWN if never written
+    std::vector<uint16_t> m_regCache;
+    //! Operators keyed on per channel, as written into the register 0x28
+    std::vector<uint8_t> m_keyCache;
 };
 
 #endif // GENERATOR_H
@@ -0,0 +1,183 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "generator_offline.h"
+#include "../audio/wav_writer.h"
+#include <algorithm>
+#include <cmath>
+
+//! Count of frames generated per single step
+static const unsigned s_renderBlock = 512;
+
+GeneratorEvent GeneratorEvent::noteOn(double time, int note, uint32_t velocity)
+{
+    GeneratorEvent e;
+    e.time = time;
+    e.type = NoteOn;
+    e.note = note;
+    e.velocity = velocity;
+    return e;
+}
+
+GeneratorEvent GeneratorEvent::noteOff(double time, int note)
+{
+    GeneratorEvent e;
+    e.time = time;
+    e.type = NoteOff;
+    e.note = note;
+    return e;
+}
+
+GeneratorEvent GeneratorEvent::pitchBend(double time, int bend)
+{
+    GeneratorEvent e;
+    e.time = time;
+    e.type = PitchBend;
+    e.value = bend;
+    return e;
+}
+
+GeneratorEvent GeneratorEvent::patchChange(double time, const FmBank::Instrument &instrument, bool isDrum)
+{
+    GeneratorEvent e;
+    e.time = time;
+    e.type = PatchChange;
+    e.instrument = instrument;
+    e.isDrum = isDrum;
+    return e;
+}
+
+GeneratorEvent GeneratorEvent::hold(double time, bool held)
+{
+    GeneratorEvent e;
+    e.time = time;
+    e.type = Hold;
+    e.value = held ? 1 : 0;
+    return e;
+}
+
+GeneratorEvent GeneratorEvent::allNotesOff(double time)
+{
+    GeneratorEvent e;
+    e.time = time;
+    e.type = AllNotesOff;
+    return e;
+}
+
+OfflineGenerator::OfflineGenerator(uint32_t sampleRate, Generator::OPN_Chips chipId, int family, unsigned chipsCount)
+    : m_gen(sampleRate, chipId, chipsCount),
+      m_rate(sampleRate)
+{
+    if(family != static_cast<int>(OPNChip_OPN2))
+        m_gen.switchChip(chipId, family);
+}
+
+bool OfflineGenerator::render(const std::vector<GeneratorEvent> &events, const Sink &sink)
+{
+    std::vector<const GeneratorEvent *> sorted;
+    sorted.reserve(events.size());
+    for(const GeneratorEvent &e : events)
+        sorted.push_back(&e);
+
+    // Keep the original order of simultaneous events
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const GeneratorEvent *a, const GeneratorEvent *b) -> bool
+                     {
+                         return a->time < b->time;
+                     });
+
+    int16_t buffer[2 * s_renderBlock];
+    uint64_t position = 0;
+
+    for(size_t i = 0, n = sorted.size(); i <= n; ++i)
+    {
+        double time;
+        if(i < n)
+            time = sorted[i]->time;
+        else
+            time = (n > 0 ? sorted[n - 1]->time : 0.0) + m_tail;
+
+        uint64_t target = (time > 0.0) ? static_cast<uint64_t>(std::llround(time * m_rate)) : 0;
+
+        while(position < target)
+        {
+            uint64_t left = target - position;
+            unsigned count = (left < s_renderBlock) ? static_cast<unsigned>(left) : s_renderBlock;
+            m_gen.generate(buffer, count);
+            if(!sink(buffer, count))
+                return false;
+            position += count;
+        }
+
+        if(i < n)
+            processEvent(*sorted[i]);
+    }
+
+    return true;
+}
+
+bool OfflineGenerator::render(const std::vector<GeneratorEvent> &events, std::vector<int16_t> &out)
+{
+    out.clear();
+    return render(events,
+                  [&out](const int16_t *frames, unsigned nframes) -> bool
+                  {
+                      out.insert(out.end(), frames, frames + 2 * nframes);
+                      return true;
+                  });
+}
+
+bool OfflineGenerator::renderToFile(const std::vector<GeneratorEvent> &events, const std::string &path)
+{
+    WavWriter wav;
+    if(!wav.open(path, m_rate, 2))
+        return false;
+
+    bool ok = render(events,
+                     [&wav](const int16_t *frames, unsigned nframes) -> bool
+                     {
+                         return wav.write(frames, nframes);
+                     });
+
+    return wav.close() && ok;
+}
+
+void OfflineGenerator::processEvent(const GeneratorEvent &event)
+{
+    switch(event.type)
+    {
+    case GeneratorEvent::NoteOn:
+        m_gen.PlayNoteF(event.note, event.velocity);
+        break;
+    case GeneratorEvent::NoteOff:
+        m_gen.StopNoteF(event.note);
+        break;
+    case GeneratorEvent::PitchBend:
+        m_gen.PitchBend(event.value);
+        break;
+    case GeneratorEvent::PatchChange:
+        m_gen.changePatch(event.instrument, event.isDrum);
+        break;
+    case GeneratorEvent::Hold:
+        m_gen.Hold(event.value != 0);
+        break;
+    case GeneratorEvent::AllNotesOff:
+        m_gen.NoteOffAllChans();
+        break;
+    }
+}
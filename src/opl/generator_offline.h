@@ -0,0 +1,128 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GENERATOR_OFFLINE_H
+#define GENERATOR_OFFLINE_H
+
+#include "generator.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Timed event of the scripted sequence for offline rendering
+ */
+struct GeneratorEvent
+{
+    enum Type
+    {
+        //! Press the key, uses `note` and `velocity`
+        NoteOn,
+        //! Release the key, uses `note`
+        NoteOff,
+        //! Change the pitch bend, uses `value` in -8192..8191
+        PitchBend,
+        //! Upload the new patch, uses `instrument` and `isDrum`
+        PatchChange,
+        //! Press or release the sustain pedal, uses `value` as boolean
+        Hold,
+        //! Release all playing notes
+        AllNotesOff
+    };
+
+    //! Time of the event in seconds since the beginning of the sequence
+    double      time = 0.0;
+    Type        type = NoteOn;
+    int         note = 60;
+    uint32_t    velocity = 127;
+    int         value = 0;
+    FmBank::Instrument instrument = FmBank::emptyInst();
+    bool        isDrum = false;
+
+    static GeneratorEvent noteOn(double time, int note, uint32_t velocity = 127);
+    static GeneratorEvent noteOff(double time, int note);
+    static GeneratorEvent pitchBend(double time, int bend);
+    static GeneratorEvent patchChange(double time, const FmBank::Instrument &instrument, bool isDrum = false);
+    static GeneratorEvent hold(double time, bool held);
+    static GeneratorEvent allNotesOff(double time);
+};
+
+/**
+ * @brief Renders the scripted sequence of events faster than real time
+ *
+ * Drives own instance of Generator without any audio device, the output
+ * is identical to what the real-time playback would produce at same rate.
+ */
+class OfflineGenerator
+{
+public:
+    //! Receives the rendered interleaved stereo frames, returns false to abort
+    typedef std::function<bool (const int16_t *frames, unsigned nframes)> Sink;
+
+    OfflineGenerator(uint32_t sampleRate,
+                     Generator::OPN_Chips chipId = Generator::CHIP_Nuked,
+                     int family = static_cast<int>(OPNChip_OPN2),
+                     unsigned chipsCount = 1);
+
+    /**
+     * @brief Set the duration rendered after the last event
+     * @param seconds Length of the tail in seconds
+     */
+    void setTail(double seconds)
+        { m_tail = (seconds > 0.0) ? seconds : 0.0; }
+    double tail() const
+        { return m_tail; }
+
+    uint32_t sampleRate() const
+        { return m_rate; }
+
+    //! Generator instance, can be used to set the volume model, LFO, etc.
+    Generator &generator()
+        { return m_gen; }
+
+    /**
+     * @brief Render the whole sequence and pass the output to the sink
+     * @param events List of events, not required to be sorted
+     * @param sink Receiver of the rendered audio
+     * @return true if the whole sequence was rendered
+     */
+    bool render(const std::vector<GeneratorEvent> &events, const Sink &sink);
+    /**
+     * @brief Render the whole sequence into the memory
+     * @param events List of events, not required to be sorted
+     * @param out Interleaved stereo frames
+     * @return true on success
+     */
+    bool render(const std::vector<GeneratorEvent> &events, std::vector<int16_t> &out);
+    /**
+     * @brief Render the whole sequence into the WAV file
+     * @param events List of events, not required to be sorted
+     * @param path Path to the output file
+     * @return true on success
+     */
+    bool renderToFile(const std::vector<GeneratorEvent> &events, const std::string &path);
+
+private:
+    void processEvent(const GeneratorEvent &event);
+
+    Generator   m_gen;
+    uint32_t    m_rate;
+    double      m_tail = 1.0;
+};
+
+#endif // GENERATOR_OFFLINE_H
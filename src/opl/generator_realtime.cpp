@@ -18,8 +18,8 @@
 
 #include "generator_realtime.h"
 #include "generator.h"
+#include "patch_bank.h"
 #include <chrono>
-#include <string.h>
 
 enum MessageTag
 {
@@ -31,7 +31,9 @@ enum MessageTag
     MSG_CtlPitchBend,
     MSG_CtlHold,
     MSG_CtlPlayChord,
-    MSG_CtlPatchChange,
+    MSG_CtlPatchChanged,
+    MSG_CtlBankChange,
+    MSG_CtlBankImage,
     MSG_CtlLFO,
     MSG_CtlLFOFreq,
     MSG_CtlVolumeModel,
@@ -44,6 +46,14 @@ struct MessageHeader
     unsigned size;
 };
 
+//! Header of MIDI messages, the size is the one of MIDI bytes
+struct MidiMessageHeader
+{
+    MessageHeader hdr;
+    //! Time of reception on the timeline of midi_clock()
+    uint64_t time;
+};
+
 // Begin Messages
 enum class ChordType
 {
@@ -58,39 +68,58 @@ struct ChordMessage
     unsigned note;
 };
 
-struct PatchChangeMessage
+struct BankImageMessage
 {
-    FmBank::Instrument instrument;
-    bool isDrum;
+    //! Serial of the bank which the index refers
+    uint32_t serial;
+    int index;
+    OPN_PatchSetup image;
+    bool playable;
 };
+
 // End Messages
 
+//! Object released by the audio thread
+struct RetiredObject
+{
+    enum Type
+    {
+        Bank,
+        Chips
+    } type;
+    void *object;
+};
+
 enum { fifo_capacity = 8192 };
 
-static void wait_for_fifo_write_space(Ring_Buffer &rb, unsigned size)
-{
-    while(rb.size_free() < sizeof(MessageHeader) + size) {
-#if defined(_WIN32)
-        Sleep(1);
-#else
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-#endif
-    }
-}
+//! Period of taking snapshots of the generator state, in milliseconds
+enum { debug_info_period = 25 };
+//! Delay to read the requested snapshot, longer than one audio buffer
+enum { debug_info_request_delay = 200 };
+
 
 IRealtimeControl::IRealtimeControl(QObject *parent)
     : QObject(parent)
 {
     m_debugInfoTimer = new QTimer(this);
-    m_debugInfoTimer->setInterval(50);
+    m_debugInfoTimer->setInterval(30);
     connect(m_debugInfoTimer, SIGNAL(timeout()), this, SLOT(debugInfoUpdate()));
     m_debugInfoTimer->start();
 }
 
+void IRealtimeControl::setDebugInfoEnabled(bool enabled)
+{
+    if(enabled)
+        m_debugInfoTimer->start();
+    else
+        m_debugInfoTimer->stop();
+}
+
 void IRealtimeControl::debugInfoUpdate()
 {
-    GeneratorDebugInfo info = generatorDebugInfo();
-    emit debugInfo(info.toStr());
+    const GeneratorDebugInfo *info = generatorDebugInfo();
+    if(info)
+        emit debugInfo(info->toStr());
 }
 
 RealtimeGenerator::RealtimeGenerator(const std::shared_ptr<Generator> &gen, QObject *parent)
@@ -98,27 +127,110 @@ RealtimeGenerator::RealtimeGenerator(const std::shared_ptr<Generator> &gen, QObj
       m_gen(gen),
       m_rb_ctl(new Ring_Buffer(fifo_capacity)),
       m_rb_midi(new Ring_Buffer(fifo_capacity)),
-      m_body(new uint8_t[fifo_capacity])
+      m_rb_retire(new Ring_Buffer(fifo_capacity)),
+      m_pendingChips(nullptr),
+      m_chipsCount(gen->chipsCount()),
+      m_body(new uint8_t[fifo_capacity]()),
+      m_ctl_waiters(0),
+      m_patchSlot(new Triple_Buffer<PatchSlot>),
+      m_debugInfo(new Triple_Buffer<GeneratorDebugInfo>),
+      m_debugInfoEnabled(true),
+      m_debugInfoRequested(false),
+      m_tap(new Audio_Tap),
+      m_midiDropped(0)
+{
+    for(CoalescedValue &c : m_coalesced)
+    {
+        c.value.store(0);
+        c.queued.store(false);
+    }
+}
+
+void RealtimeGenerator::wait_for_write_space(Ring_Buffer &rb, unsigned size)
+{
+    const size_t needed = sizeof(MessageHeader) + size;
+    while(rb.size_free() < needed)
+    {
+        // register before checking again, so the wake-up can't be missed
+        m_ctl_waiters.fetch_add(1);
+        if(rb.size_free() < needed)
+        {
+            // time out in case the audio stream is stopped
+            m_ctl_space.timed_wait(100);
+        }
+        m_ctl_waiters.fetch_sub(1);
+    }
+}
+
+void RealtimeGenerator::put_coalesced(int tag, CoalescedControl control, int value)
+{
+    CoalescedValue &c = m_coalesced[control];
+    c.value.store(value);
+    // the queued message will pick the latest value
+    if(c.queued.exchange(true))
+        return;
+
+    Ring_Buffer &rb = *m_rb_ctl;
+    MessageHeader hdr = {(MessageTag)tag, 0};
+    wait_for_write_space(rb, hdr.size);
+    rb.put(hdr);
+}
+
+int RealtimeGenerator::take_coalesced(CoalescedControl control)
 {
+    CoalescedValue &c = m_coalesced[control];
+    // clear first, so a value stored afterwards is queued again
+    c.queued.store(false);
+    return c.value.load();
 }
 
 RealtimeGenerator::~RealtimeGenerator()
-{}
+{
+    // the audio processing is stopped at this point
+    collectRetired();
+    delete m_pendingChips.exchange(nullptr);
+    OPN_PatchBank *bank = m_gen->patchBank();
+    m_gen->setPatchBank(nullptr);
+    delete bank;
+    for(unsigned i = 0; i < m_drainingCount; ++i)
+        delete m_drainingBanks[i];
+}
+
+void RealtimeGenerator::collectRetired()
+{
+    Ring_Buffer &rb = *m_rb_retire;
+    RetiredObject retired;
+    while(rb.get(retired))
+    {
+        switch(retired.type)
+        {
+        case RetiredObject::Bank:
+            delete static_cast<const OPN_PatchBank *>(retired.object);
+            break;
+        case RetiredObject::Chips:
+            delete static_cast<Generator::ChipSet *>(retired.object);
+            break;
+        }
+    }
+}
 
 /* Control */
 void RealtimeGenerator::ctl_switchChip(int chipId, int family)
 {
-    // non-RT, hence lock and processing in control thread
-    std::unique_lock<mutex_type> lock(m_generator_mutex);
-    Q_UNUSED(lock);
-    m_gen->switchChip((Generator::OPN_Chips)chipId, family);
+    collectRetired();
+
+    // emulators are built here, the audio thread switches to them seamlessly
+    Generator::ChipSet *set = m_gen->createChipSet((Generator::OPN_Chips)chipId, family, m_chipsCount);
+
+    // a set which was not taken yet is superseded
+    delete m_pendingChips.exchange(set);
 }
 
 void RealtimeGenerator::ctl_silence()
 {
     Ring_Buffer &rb = *m_rb_ctl;
     MessageHeader hdr = {MSG_CtlSilence, 0};
-    wait_for_fifo_write_space(rb, hdr.size);
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
 }
 
@@ -126,7 +238,7 @@ void RealtimeGenerator::ctl_noteOffAllChans()
 {
     Ring_Buffer &rb = *m_rb_ctl;
     MessageHeader hdr = {MSG_CtlNoteOffAllChans, 0};
-    wait_for_fifo_write_space(rb, hdr.size);
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
 }
 
@@ -134,7 +246,7 @@ void RealtimeGenerator::ctl_playNote()
 {
     Ring_Buffer &rb = *m_rb_ctl;
     MessageHeader hdr = {MSG_CtlPlayNote, sizeof(uint)};
-    wait_for_fifo_write_space(rb, hdr.size);
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
     rb.put(m_note);
 }
@@ -143,25 +255,21 @@ void RealtimeGenerator::ctl_stopNote()
 {
     Ring_Buffer &rb = *m_rb_ctl;
     MessageHeader hdr = {MSG_CtlStopNote, sizeof(uint)};
-    wait_for_fifo_write_space(rb, hdr.size);
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
     rb.put(m_note);
 }
 
 void RealtimeGenerator::ctl_pitchBend(int bend)
 {
-    Ring_Buffer &rb = *m_rb_ctl;
-    MessageHeader hdr = {MSG_CtlPitchBend, sizeof(int)};
-    wait_for_fifo_write_space(rb, hdr.size);
-    rb.put(hdr);
-    rb.put(bend);
+    put_coalesced(MSG_CtlPitchBend, Coalesced_PitchBend, bend);
 }
 
 void RealtimeGenerator::ctl_hold(bool held)
 {
     Ring_Buffer &rb = *m_rb_ctl;
     MessageHeader hdr = {MSG_CtlHold, sizeof(bool)};
-    wait_for_fifo_write_space(rb, hdr.size);
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
     rb.put(held);
 }
@@ -170,7 +278,7 @@ void RealtimeGenerator::ctl_playChord(int chord)
 {
     Ring_Buffer &rb = *m_rb_ctl;
     MessageHeader hdr = {MSG_CtlPlayChord, sizeof(ChordMessage)};
-    wait_for_fifo_write_space(rb, hdr.size);
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
     ChordMessage ch;
     ch.chord = (ChordType)chord;
@@ -193,55 +301,77 @@ void IRealtimeControl::ctl_playMinor7Chord()
 
 void RealtimeGenerator::ctl_changePatch(FmBank::Instrument &instrument, bool isDrum)
 {
+    PatchSlot &slot = m_patchSlot->write_buffer();
+    slot.instrument = instrument;
+    slot.isDrum = isDrum;
+    m_patchSlot->publish();
+    // the instrument isn't copied into the queue, only its change is notified
+    put_coalesced(MSG_CtlPatchChanged, Coalesced_Patch, 0);
+}
+
+void RealtimeGenerator::ctl_changeBank(const FmBank &bank)
+{
+    collectRetired();
+
+    // images are compiled here, the audio thread only takes the pointer
+    OPN_PatchBank *images = new OPN_PatchBank(bank);
+    m_bankSerial = images->serial;
+
     Ring_Buffer &rb = *m_rb_ctl;
-    MessageHeader hdr = {MSG_CtlPatchChange, sizeof(PatchChangeMessage)};
-    wait_for_fifo_write_space(rb, hdr.size);
+    MessageHeader hdr = {MSG_CtlBankChange, sizeof(images)};
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
-    PatchChangeMessage pc;
-    pc.instrument = instrument;
-    pc.isDrum = isDrum;
-    rb.put(pc);
+    rb.put(images);
 }
 
-void RealtimeGenerator::ctl_changeLFO(bool lfo)
+void RealtimeGenerator::ctl_changeBankInstrument(int index, const FmBank::Instrument &instrument, bool isDrum)
 {
+    if(m_bankSerial == 0)
+        return;
+
+    // only the image of the instrument is compiled and copied into the queue
+    BankImageMessage msg;
+    msg.serial = m_bankSerial;
+    msg.index = index;
+    OPN_PatchBank::compile(instrument, isDrum, msg.image);
+    msg.playable = !instrument.is_blank;
+
     Ring_Buffer &rb = *m_rb_ctl;
-    MessageHeader hdr = {MSG_CtlLFO, sizeof(bool)};
-    wait_for_fifo_write_space(rb, hdr.size);
+    MessageHeader hdr = {MSG_CtlBankImage, sizeof(BankImageMessage)};
+    wait_for_write_space(rb, hdr.size);
     rb.put(hdr);
-    rb.put(lfo);
+    rb.put(msg);
+}
+
+void RealtimeGenerator::ctl_changeLFO(bool lfo)
+{
+    put_coalesced(MSG_CtlLFO, Coalesced_LFO, lfo ? 1 : 0);
 }
 
 void RealtimeGenerator::ctl_changeLFOfreq(int freq)
 {
-    Ring_Buffer &rb = *m_rb_ctl;
-    MessageHeader hdr = {MSG_CtlLFOFreq, sizeof(int)};
-    wait_for_fifo_write_space(rb, hdr.size);
-    rb.put(hdr);
-    rb.put(freq);
+    put_coalesced(MSG_CtlLFOFreq, Coalesced_LFOFreq, freq);
 }
 
 void RealtimeGenerator::ctl_changeVolumeModel(int model)
 {
-    Ring_Buffer &rb = *m_rb_ctl;
-    MessageHeader hdr = {MSG_CtlVolumeModel, sizeof(int)};
-    wait_for_fifo_write_space(rb, hdr.size);
-    rb.put(hdr);
-    rb.put(model);
+    put_coalesced(MSG_CtlVolumeModel, Coalesced_VolumeModel, model);
 }
 
 void RealtimeGenerator::ctl_changeVolume(unsigned vol)
 {
-    Ring_Buffer &rb = *m_rb_ctl;
-    MessageHeader hdr = {MSG_CtlVolume, sizeof(unsigned)};
-    wait_for_fifo_write_space(rb, hdr.size);
-    rb.put(hdr);
-    rb.put(vol);
+    put_coalesced(MSG_CtlVolume, Coalesced_Volume, (int)vol);
 }
 
 
 /* MIDI */
-void RealtimeGenerator::midi_event(const uint8_t *msg, unsigned msglen)
+uint64_t IRealtimeMIDI::midi_clock()
+{
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void RealtimeGenerator::midi_event(const uint8_t *msg, unsigned msglen, uint64_t time)
 {
     enum { midi_msglen_max = 64 };
 
@@ -249,43 +379,121 @@ void RealtimeGenerator::midi_event(const uint8_t *msg, unsigned msglen)
         return;
 
     Ring_Buffer &rb = *m_rb_midi;
-    MessageHeader hdr = {MSG_MidiEvent, msglen};
-    if (rb.size_free() >= sizeof(hdr) + hdr.size) {
+    MidiMessageHeader hdr = {{MSG_MidiEvent, msglen}, time};
+    if (rb.size_free() >= sizeof(hdr) + hdr.hdr.size) {
         rb.put(hdr);
         rb.put(msg, msglen);
     }
+    else
+        m_midiDropped.fetch_add(1, std::memory_order_relaxed);
 }
 
 /* Realtime */
 void RealtimeGenerator::rt_generate(int16_t *frames, unsigned nframes)
 {
-    std::unique_lock<mutex_type> lock(m_generator_mutex, std::try_to_lock);
-    if(!lock.owns_lock()) {
-        memset(frames, 0, 2 * nframes * sizeof(*frames));
-        return;
+    Generator &gen = *m_gen;
+
+    /* switch the chip at the block boundary */
+    if(!gen.isSwitchingChips())
+    {
+        Generator::ChipSet *set = m_pendingChips.exchange(nullptr);
+        if(set && !gen.beginChipSwitch(set))
+        {
+            // not for this generator, return it to delete in control thread
+            RetiredObject retired = {RetiredObject::Chips, set};
+            if(m_rb_retire->size_free() >= sizeof(retired))
+                m_rb_retire->put(retired);
+        }
     }
 
     MessageHeader header;
 
     /* handle Control messages */
+    bool ctl_drained = false;
     for(Ring_Buffer &rb = *m_rb_ctl;
          rb.peek(header) && rb.size_used() >= sizeof(header) + header.size;)
     {
         rb.discard(sizeof(header));
         rb.get(m_body.get(), header.size);
+        ctl_drained = true;
         rt_message_process(header.tag, m_body.get(), header.size);
     }
 
-    /* handle MIDI messages */
+    // post only if someone waits, so the audio thread rarely calls the system
+    if(ctl_drained && m_ctl_waiters.load() > 0)
+        m_ctl_space.post();
+
+    /* handle MIDI messages, each at its frame within the block */
+    const uint64_t now = midi_clock();
+    const uint64_t period = (uint64_t)nframes * 1000000000 / gen.sampleRate();
+    uint64_t start = m_midiWindowStart;
+    // after a stall, the messages are spread over one period only
+    if(start == 0 || start > now || now - start > 4 * period)
+        start = (now > period) ? (now - period) : 0;
+    m_midiWindowStart = now;
+
+    unsigned rendered = 0;
+    MidiMessageHeader midi;
     for(Ring_Buffer &rb = *m_rb_midi;
-         rb.peek(header) && rb.size_used() >= sizeof(header) + header.size;)
+         rb.peek(midi) && rb.size_used() >= sizeof(midi) + midi.hdr.size;)
     {
-        rb.discard(sizeof(header));
-        rb.get(m_body.get(), header.size);
-        rt_message_process(header.tag, m_body.get(), header.size);
+        // received after the block has begun, it belongs to the next one
+        if(midi.time > now)
+            break;
+
+        unsigned offset = 0;
+        if(midi.time > start)
+            offset = (unsigned)((midi.time - start) * nframes / (now - start));
+        if(offset > nframes)
+            offset = nframes;
+        if(offset > rendered)
+        {
+            gen.generate(frames + 2 * rendered, offset - rendered);
+            rendered = offset;
+        }
+
+        rb.discard(sizeof(midi));
+        rb.get(m_body.get(), midi.hdr.size);
+        rt_message_process(midi.hdr.tag, m_body.get(), midi.hdr.size);
     }
 
-    m_gen->generate(frames, nframes);
+    if(rendered < nframes)
+        gen.generate(frames + 2 * rendered, nframes - rendered);
+
+    /* hand the replaced chips over to the control thread */
+    if(gen.isSwitchingChips() && m_rb_retire->size_free() >= sizeof(RetiredObject))
+    {
+        Generator::ChipSet *old = gen.takeRetiredChips();
+        if(old)
+        {
+            RetiredObject retired = {RetiredObject::Chips, old};
+            m_rb_retire->put(retired);
+        }
+    }
+
+    /* hand the replaced banks over when their notes are released */
+    if(m_drainingCount > 0)
+        rt_drain_banks();
+
+    // bounded cost, one copy of the block at most
+    m_tap->write(frames, nframes);
+
+    m_debugInfoFrames += nframes;
+    bool takeDebugInfo = m_debugInfoEnabled.load(std::memory_order_relaxed) &&
+        m_debugInfoFrames >= m_gen->sampleRate() * debug_info_period / 1000;
+    if(m_debugInfoRequested.load(std::memory_order_relaxed))
+    {
+        m_debugInfoRequested.store(false, std::memory_order_relaxed);
+        takeDebugInfo = true;
+    }
+    if(takeDebugInfo)
+    {
+        m_debugInfoFrames = 0;
+        GeneratorDebugInfo &info = m_debugInfo->write_buffer();
+        m_gen->collectDebugInfo(info);
+        info.midiDropped = m_midiDropped.load(std::memory_order_relaxed);
+        m_debugInfo->publish();
+    }
 }
 
 void RealtimeGenerator::rt_message_process(int tag, const uint8_t *data, unsigned len)
@@ -317,7 +525,7 @@ void RealtimeGenerator::rt_message_process(int tag, const uint8_t *data, unsigne
         gen.StopNote();
         break;
     case MSG_CtlPitchBend:
-        gen.PitchBend(*(int *)data);
+        gen.PitchBend(take_coalesced(Coalesced_PitchBend));
         break;
     case MSG_CtlHold:
         gen.Hold(*(bool *)data);
@@ -338,23 +546,42 @@ void RealtimeGenerator::rt_message_process(int tag, const uint8_t *data, unsigne
         }
         break;
     }
-    case MSG_CtlPatchChange: {
-        const PatchChangeMessage &pc = *(PatchChangeMessage *)data;
-        gen.changePatch(pc.instrument, pc.isDrum);
+    case MSG_CtlPatchChanged: {
+        take_coalesced(Coalesced_Patch);
+        // nothing new if the previous notification took this instrument already
+        Triple_Buffer<PatchSlot> &tb = *m_patchSlot;
+        if(tb.update())
+            gen.changePatch(tb.read_buffer().instrument, tb.read_buffer().isDrum);
+        break;
+    }
+    case MSG_CtlBankChange: {
+        OPN_PatchBank *bank = *(OPN_PatchBank *const *)data;
+        OPN_PatchBank *old = gen.patchBank();
+        gen.setPatchBank(bank);
+        if(old)
+            rt_retire_bank(old);
+        break;
+    }
+    case MSG_CtlBankImage: {
+        const BankImageMessage &msg = *(const BankImageMessage *)data;
+        // the index is meaningless in any other bank
+        const OPN_PatchBank *bank = gen.patchBank();
+        if(bank && bank->serial == msg.serial)
+            gen.changeBankImage(msg.index, msg.image, msg.playable);
         break;
     }
     case MSG_CtlLFO:
-        gen.changeLFO(*(bool *)data);
+        gen.changeLFO(take_coalesced(Coalesced_LFO) != 0);
         break;
     case MSG_CtlLFOFreq:
-        gen.changeLFOfreq(*(int *)data);
+        gen.changeLFOfreq(take_coalesced(Coalesced_LFOFreq));
         break;
     case MSG_CtlVolumeModel:
-        gen.changeVolumeModel(*(int *)data);
+        gen.changeVolumeModel(take_coalesced(Coalesced_VolumeModel));
         break;
     case MSG_CtlVolume:
     {
-        unsigned vol = *(unsigned *)data;
+        unsigned vol = (unsigned)take_coalesced(Coalesced_Volume);
         vol = (vol < 128) ? vol : 127;
         for (unsigned i = 0; i < 16; ++i)
             m_midichan[i].volume = vol;
@@ -363,11 +590,57 @@ void RealtimeGenerator::rt_message_process(int tag, const uint8_t *data, unsigne
     }
 }
 
+void RealtimeGenerator::rt_retire_bank(OPN_PatchBank *bank)
+{
+    if(m_drainingCount == draining_banks_max)
+    {
+        // too many replacements in a row, cut the notes of the oldest bank
+        m_gen->releasePatchBank(*m_drainingBanks[0]);
+        rt_drain_banks();
+        // if the queue is full, leak the old images rather than block
+        if(m_drainingCount == draining_banks_max)
+        {
+            for(unsigned i = 1; i < m_drainingCount; ++i)
+                m_drainingBanks[i - 1] = m_drainingBanks[i];
+            --m_drainingCount;
+        }
+    }
+    m_drainingBanks[m_drainingCount++] = bank;
+}
+
+void RealtimeGenerator::rt_drain_banks()
+{
+    const Generator &gen = *m_gen;
+    unsigned kept = 0;
+    for(unsigned i = 0; i < m_drainingCount; ++i)
+    {
+        OPN_PatchBank *bank = m_drainingBanks[i];
+        RetiredObject retired = {RetiredObject::Bank, bank};
+        if(!gen.playsPatchBank(*bank) && m_rb_retire->size_free() >= sizeof(retired))
+            m_rb_retire->put(retired);
+        else
+            m_drainingBanks[kept++] = bank;
+    }
+    m_drainingCount = kept;
+}
+
 void RealtimeGenerator::rt_midi_process(const uint8_t *data, unsigned len)
 {
     Generator &gen = *m_gen;
 
-    if(len == 3)
+    if(len == 2)
+    {
+        unsigned msg = data[0] >> 4;
+        unsigned chan = data[0] & 0x0f;
+        unsigned value = data[1] & 0x7f;
+
+        switch(msg) {
+        case 0xc:
+            gen.midiProgramChange(chan, (uint8_t)value);
+            break;
+        }
+    }
+    else if(len == 3)
     {
         unsigned msg = data[0] >> 4;
         unsigned chan = data[0] & 0x0f;
@@ -381,20 +654,24 @@ void RealtimeGenerator::rt_midi_process(const uint8_t *data, unsigned len)
 
         switch(msg) {
         case 0x8:
-            gen.changeNote((int)note);
-            gen.StopNote();
+            gen.midiNoteOff(chan, (int)note);
             break;
         case 0x9:
-            gen.changeNote((int)note);
-            gen.PlayNote(vel, ch.volume, ch.expression);
+            gen.midiNoteOn(chan, (int)note, vel, ch.volume, ch.expression);
             break;
         case 0xb:
             switch (note) {
             case 120:  // all sound off
-                gen.Silence();
+                gen.midiSoundOff(chan);
                 break;
             case 123:  // all notes off
-                gen.NoteOffAllChans();
+                gen.midiNoteOffAll(chan);
+                break;
+            case 0:  // bank select MSB
+                gen.midiBankSelect(chan, false, (uint8_t)vel);
+                break;
+            case 32:  // bank select LSB
+                gen.midiBankSelect(chan, true, (uint8_t)vel);
                 break;
             case 7:  // volume
                 ch.volume = vel;
@@ -403,7 +680,7 @@ void RealtimeGenerator::rt_midi_process(const uint8_t *data, unsigned len)
                 ch.expression = vel;
                 break;
             case 64:  // hold pedal
-                gen.Hold(vel >= 64);
+                gen.midiHold(chan, vel >= 64);
                 break;
             case 98:  // NRPN LSB
                 ch.lastlrpn = vel, ch.nrpn = true;
@@ -422,7 +699,7 @@ void RealtimeGenerator::rt_midi_process(const uint8_t *data, unsigned len)
                 if (!ch.nrpn && addr == 0) {
                     ch.bendsensemsb = vel;
                     int cents = ch.bendsensemsb * 100 + ch.bendsenselsb;
-                    gen.PitchBendSensitivity(cents);
+                    gen.midiPitchBendSensitivity(chan, cents);
                 }
                 break;
             }
@@ -431,19 +708,33 @@ void RealtimeGenerator::rt_midi_process(const uint8_t *data, unsigned len)
                 if (!ch.nrpn && addr == 0) {
                     ch.bendsenselsb = vel;
                     int cents = ch.bendsensemsb * 100 + ch.bendsenselsb;
-                    gen.PitchBendSensitivity(cents);
+                    gen.midiPitchBendSensitivity(chan, cents);
                 }
                 break;
             }
             break;
         case 0xe:
-            gen.PitchBend((int)((vel << 7) | note) - 8192);
+            gen.midiPitchBend(chan, (int)((vel << 7) | note) - 8192);
             break;
         }
     }
 }
 
-const GeneratorDebugInfo &RealtimeGenerator::generatorDebugInfo() const
+void RealtimeGenerator::setDebugInfoEnabled(bool enabled)
+{
+    m_debugInfoEnabled.store(enabled, std::memory_order_relaxed);
+    IRealtimeControl::setDebugInfoEnabled(enabled);
+}
+
+void RealtimeGenerator::requestDebugInfo()
+{
+    m_debugInfoRequested.store(true, std::memory_order_relaxed);
+    if(!m_debugInfoTimer->isActive())
+        QTimer::singleShot(debug_info_request_delay, this, SLOT(debugInfoUpdate()));
+}
+
+const GeneratorDebugInfo *RealtimeGenerator::generatorDebugInfo()
 {
-    return m_gen->debugInfo();
+    Triple_Buffer<GeneratorDebugInfo> &tb = *m_debugInfo;
+    return tb.update() ? &tb.read_buffer() : nullptr;
 }
@@ -20,21 +20,19 @@
 #define GENERATOR_REALTIME_H
 
 #include "realtime/ring_buffer.h"
+#include "realtime/triple_buffer.h"
+#include "realtime/audio_tap.h"
+#include "realtime/semaphore.h"
+#include "generator.h"
 #include "../bank.h"
 #include <QObject>
 #include <QTimer>
-#include <thread>
 #include <memory>
-#include <mutex>
-#include <QMutex>
+#include <atomic>
 #include <system_error>
 #include <stdint.h>
-#if defined(_WIN32)
-#include <windows.h>
-#endif
 
-class Generator;
-struct GeneratorDebugInfo;
+struct OPN_PatchBank;
 
 /**
    A control interface which drives a generator from a user interface.
@@ -46,6 +44,14 @@ public:
     IRealtimeControl(QObject *parent = nullptr);
     virtual ~IRealtimeControl() {}
     virtual void ctl_switchChip(int chipId, int family) = 0;
+    //! Copy of the latest output, to read from any thread
+    virtual const Audio_Tap *audioTap() const = 0;
+
+    /**
+     * @brief Enable the periodic debug info, enabled by default
+     * When disabled, the state of the generator is taken on request only.
+     */
+    virtual void setDebugInfoEnabled(bool enabled);
 
 public slots:
     void changeNote(int note) { m_note = note; }
@@ -66,11 +72,22 @@ public slots:
     void ctl_playMinor7Chord();
 
     virtual void ctl_changePatch(FmBank::Instrument &instrument, bool isDrum = false) = 0;
+    virtual void ctl_changeBank(const FmBank &bank) = 0;
+    /**
+     * @brief Update one instrument of the bank sent by ctl_changeBank()
+     * @param index Index of the instrument, melodic ones first, then percussion
+     * @param instrument Edited instrument
+     * @param isDrum Whether the instrument is percussion
+     */
+    virtual void ctl_changeBankInstrument(int index, const FmBank::Instrument &instrument, bool isDrum) = 0;
     virtual void ctl_changeLFO(bool lfo) = 0;
     virtual void ctl_changeLFOfreq(int freq) = 0;
     virtual void ctl_changeVolumeModel(int model) = 0;
     virtual void ctl_changeVolume(unsigned vol) = 0;
 
+    //! Take the state of the generator once, it's emitted by debugInfo() soon
+    virtual void requestDebugInfo() = 0;
+
 signals:
     void debugInfo(QString);
 
@@ -78,7 +95,8 @@ private slots:
     void debugInfoUpdate();
 
 protected:
-    virtual const GeneratorDebugInfo &generatorDebugInfo() const = 0;
+    //! Latest published debug info, or null if nothing new was published
+    virtual const GeneratorDebugInfo *generatorDebugInfo() = 0;
 
 protected:
     unsigned m_note = 0;
@@ -92,7 +110,15 @@ class IRealtimeMIDI
 {
 public:
     virtual ~IRealtimeMIDI() {}
-    virtual void midi_event(const uint8_t *msg, unsigned msglen) = 0;
+    /**
+     * @brief Queue the MIDI message for playing
+     * @param msg Bytes of the message
+     * @param msglen Count of bytes
+     * @param time Time of reception on the timeline of midi_clock()
+     */
+    virtual void midi_event(const uint8_t *msg, unsigned msglen, uint64_t time) = 0;
+    //! Monotonic time in nanoseconds, used to schedule MIDI messages
+    static uint64_t midi_clock();
 };
 
 /**
@@ -127,27 +153,111 @@ public:
     void ctl_hold(bool held) override;
     void ctl_playChord(int chord) override;
     void ctl_changePatch(FmBank::Instrument &instrument, bool isDrum = false) override;
+    void ctl_changeBank(const FmBank &bank) override;
+    void ctl_changeBankInstrument(int index, const FmBank::Instrument &instrument, bool isDrum) override;
     void ctl_changeLFO(bool lfo) override;
     void ctl_changeLFOfreq(int freq) override;
     void ctl_changeVolumeModel(int model) override;
     void ctl_changeVolume(unsigned vol) override;
+    const Audio_Tap *audioTap() const override { return m_tap.get(); }
+    void setDebugInfoEnabled(bool enabled) override;
+    void requestDebugInfo() override;
     /* MIDI */
-    void midi_event(const uint8_t *msg, unsigned msglen) override;
+    void midi_event(const uint8_t *msg, unsigned msglen, uint64_t time) override;
+    //! Count of MIDI messages lost because the queue was full
+    unsigned midiDropped() const
+        { return m_midiDropped.load(std::memory_order_relaxed); }
     /* Realtime */
     void rt_generate(int16_t *frames, unsigned nframes) override;
 
 private:
+    //! Controls which queue only the latest value
+    enum CoalescedControl
+    {
+        Coalesced_PitchBend,
+        Coalesced_LFO,
+        Coalesced_LFOFreq,
+        Coalesced_VolumeModel,
+        Coalesced_Volume,
+        Coalesced_Patch,
+        Coalesced_Count
+    };
+    //! Wait until the queue has enough space for the message
+    void wait_for_write_space(Ring_Buffer &rb, unsigned size);
+    //! Queue the control, unless it's already queued and not processed yet
+    void put_coalesced(int tag, CoalescedControl control, int value);
+    //! Take the latest value of the control in the audio thread
+    int take_coalesced(CoalescedControl control);
+
     void rt_message_process(int tag, const uint8_t *data, unsigned len);
     void rt_midi_process(const uint8_t *data, unsigned len);
+    //! Keep the replaced bank until its notes are released
+    void rt_retire_bank(OPN_PatchBank *bank);
+    //! Hand the replaced banks no longer played over to the control thread
+    void rt_drain_banks();
+    //! Delete the objects which were released by the audio thread
+    void collectRetired();
 
 protected:
-    const GeneratorDebugInfo &generatorDebugInfo() const override;
+    const GeneratorDebugInfo *generatorDebugInfo() override;
 
 private:
     std::shared_ptr<Generator> m_gen;
     std::unique_ptr<Ring_Buffer> m_rb_ctl;
     std::unique_ptr<Ring_Buffer> m_rb_midi;
+    //! Objects no longer used by the audio thread, to delete in control thread
+    std::unique_ptr<Ring_Buffer> m_rb_retire;
+    //! Emulators prepared for the chip switch, taken by the audio thread
+    std::atomic<Generator::ChipSet *> m_pendingChips;
+    //! Count of chips, fixed for the lifetime of the generator
+    unsigned m_chipsCount = 1;
     std::unique_ptr<uint8_t[]> m_body;
+    //! Serial of the latest bank sent to the audio thread, control thread only
+    uint32_t m_bankSerial = 0;
+
+    enum { draining_banks_max = 4 };
+    //! Replaced banks which notes still sound, audio thread only
+    OPN_PatchBank *m_drainingBanks[draining_banks_max] = {};
+    unsigned m_drainingCount = 0;
+
+    //! Posted by the audio thread when it frees the space of the control queue
+    Semaphore m_ctl_space;
+    //! Count of threads waiting for the space of the control queue
+    std::atomic<unsigned> m_ctl_waiters;
+
+    struct CoalescedValue
+    {
+        std::atomic<int> value;
+        //! Whether the message is in the queue and not processed yet
+        std::atomic<bool> queued;
+    };
+    CoalescedValue m_coalesced[Coalesced_Count];
+
+    //! Edited instrument, the queue only notifies about its change
+    struct PatchSlot
+    {
+        FmBank::Instrument instrument;
+        bool isDrum = false;
+    };
+    std::unique_ptr<Triple_Buffer<PatchSlot>> m_patchSlot;
+
+    //! Snapshots of the generator state, written by the audio thread
+    std::unique_ptr<Triple_Buffer<GeneratorDebugInfo>> m_debugInfo;
+    //! Frames generated since the last snapshot
+    unsigned m_debugInfoFrames = 0;
+    //! Whether the audio thread takes the snapshots periodically
+    std::atomic<bool> m_debugInfoEnabled;
+    //! Whether a single snapshot is requested
+    std::atomic<bool> m_debugInfoRequested;
+
+    //! Latest output, written by the audio thread
+    std::unique_ptr<Audio_Tap> m_tap;
+
+    //! MIDI messages lost because the queue was full
+    std::atomic<unsigned> m_midiDropped;
+    //! MIDI clock at the previous audio block, the messages received since
+    //! then are spread over the current block
+    uint64_t m_midiWindowStart = 0;
 
     struct MidiChannelInfo
     {
@@ -160,23 +270,6 @@ private:
         unsigned expression = 127;
     };
     MidiChannelInfo m_midichan[16];
-
-#if !defined(_WIN32)
-    std::mutex m_generator_mutex;
-    typedef std::mutex mutex_type;
-#else
-    class QStdMutex
-    {
-    public:
-        void lock() { m.lock(); }
-        void unlock() { m.unlock(); }
-        bool try_lock() { return m.tryLock(); }
-    private:
-        QMutex m;
-    };
-    QStdMutex m_generator_mutex;
-    typedef QStdMutex mutex_type;
-#endif
 };
 
 
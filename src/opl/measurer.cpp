@@ -27,9 +27,11 @@
 #include <chrono>
 #include <cmath>
 #include <memory>
+#include <algorithm>
 
 #include "measurer.h"
 #include "generator.h"
+#include "envelope_model.h"
 
 #ifndef M_PI
 #define M_PI    3.14159265358979323846
@@ -64,7 +66,8 @@ public:
 
     void reset(size_t capacity)
     {
-        m_data.reset(new T[2 * capacity]());
+        if(capacity != m_capacity)
+            m_data.reset(new T[2 * capacity]());
         m_index = 0;
         m_length = 0;
         m_capacity = capacity;
@@ -114,6 +117,169 @@ static double MeasureRMS(const double *signal, const double *window, unsigned le
     return rms;
 }
 
+/**
+ * @brief History of the audio, with the RMS of its Hann windowed content
+ *
+ * Gives the same result as MeasureRMS() over the whole history, without
+ * windowing all of it at every analysis step. The squared Hann window is
+ * a sum of cosines of the sample position, so the sums the RMS is made of
+ * are kept as sums of the samples multiplied by these cosines. They are
+ * referenced to the absolute position, so the sliding only adds the new
+ * sample and removes the oldest one, in constant time.
+ *
+ * While the history fills, the window length changes at every step and
+ * the RMS is measured directly. The sums are recomputed from the history
+ * when it becomes full, and periodically to cancel the rounding drift.
+ */
+class LoudnessHistory
+{
+    AudioHistory<double> m_history;
+    //! Period of the window cosine, one less than the window length
+    unsigned m_period = 0;
+    //! Phase of the next sample within the period
+    unsigned m_phase = 0;
+    std::unique_ptr<double[]> m_cos;
+    std::unique_ptr<double[]> m_sin;
+    //! Sums of the samples, by 1, cos and sin of the phase
+    double m_sum = 0, m_sumCos = 0, m_sumSin = 0;
+    //! Sums of the squares, by 1, cos and sin of the phase and its double
+    double m_sq = 0, m_sqCos = 0, m_sqSin = 0, m_sqCos2 = 0, m_sqSin2 = 0;
+    bool m_synced = false;
+    //! Samples added since the sums were computed from the history
+    size_t m_sinceSync = 0;
+    //! Windows for the direct measurement while filling, by length
+    std::vector<std::pair<unsigned, std::vector<double> > > m_windows;
+
+    //! Sums are recomputed after this many windows of samples
+    enum { resync_windows = 64 };
+
+    unsigned phaseBefore(unsigned phase) const
+        { return (phase == 0) ? (m_period - 1) : (phase - 1); }
+    unsigned doublePhase(unsigned phase) const
+        { return (2 * phase < m_period) ? (2 * phase) : (2 * phase - m_period); }
+
+    void include(double x, unsigned phase, double sign)
+    {
+        const unsigned phase2 = doublePhase(phase);
+        const double xs = sign * x;
+        const double sq = xs * x;
+        m_sum += xs;
+        m_sumCos += xs * m_cos[phase];
+        m_sumSin += xs * m_sin[phase];
+        m_sq += sq;
+        m_sqCos += sq * m_cos[phase];
+        m_sqSin += sq * m_sin[phase];
+        m_sqCos2 += sq * m_cos[phase2];
+        m_sqSin2 += sq * m_sin[phase2];
+    }
+
+    void resync()
+    {
+        m_sum = m_sumCos = m_sumSin = 0;
+        m_sq = m_sqCos = m_sqSin = m_sqCos2 = m_sqSin2 = 0;
+        const double *data = m_history.data();
+        const size_t length = m_history.size();
+        // the oldest sample has the phase of the newest one
+        unsigned phase = phaseBefore(m_phase);
+        for(size_t i = 0; i < length; ++i)
+        {
+            include(data[i], phase, 1.0);
+            phase = (phase + 1 == m_period) ? 0 : (phase + 1);
+        }
+        m_synced = true;
+        m_sinceSync = 0;
+    }
+
+    //! Hann window of the length, computed once
+    const double *window(unsigned length)
+    {
+        for(const std::pair<unsigned, std::vector<double> > &w : m_windows)
+        {
+            if(w.first == length)
+                return w.second.data();
+        }
+        m_windows.push_back(std::make_pair(length, std::vector<double>(length)));
+        std::vector<double> &w = m_windows.back().second;
+        HannWindow(w.data(), length);
+        return w.data();
+    }
+
+public:
+    size_t size() const { return m_history.size(); }
+
+    /**
+     * @brief Clear the history, the buffers are kept while the capacity is same
+     * @param capacity Count of samples to keep, the length of the window
+     */
+    void reset(size_t capacity)
+    {
+        const bool sameCapacity = m_history.capacity() == capacity;
+        m_history.reset(capacity);
+        m_phase = 0;
+        m_synced = false;
+        if(sameCapacity)
+            return;
+
+        m_period = (unsigned)capacity - 1;
+        m_cos.reset(new double[m_period]);
+        m_sin.reset(new double[m_period]);
+        for(unsigned i = 0; i < m_period; ++i)
+        {
+            m_cos[i] = std::cos(2 * M_PI * i / m_period);
+            m_sin[i] = std::sin(2 * M_PI * i / m_period);
+        }
+        m_windows.clear();
+    }
+
+    void add(double x)
+    {
+        const bool full = m_history.size() == m_history.capacity();
+        const double oldest = full ? m_history.data()[0] : 0.0;
+        const unsigned phase = m_phase;
+        m_history.add(x);
+        m_phase = (phase + 1 == m_period) ? 0 : (phase + 1);
+        if(!m_synced)
+            return;
+        include(x, phase, 1.0);
+        include(oldest, phaseBefore(phase), -1.0);
+        ++m_sinceSync;
+    }
+
+    double rms()
+    {
+        const size_t length = m_history.size();
+        if(length < m_history.capacity())
+            return MeasureRMS(m_history.data(), window((unsigned)length), (unsigned)length);
+
+        if(!m_synced || m_sinceSync >= resync_windows * length)
+            resync();
+
+        // rotate the sums to the phase of the oldest sample, the window start
+        const unsigned first = phaseBefore(m_phase);
+        const unsigned first2 = doublePhase(first);
+        const double sumCos = m_cos[first] * m_sumCos + m_sin[first] * m_sumSin;
+        const double sqCos = m_cos[first] * m_sqCos + m_sin[first] * m_sqSin;
+        const double sqCos2 = m_cos[first2] * m_sqCos2 + m_sin[first2] * m_sqSin2;
+
+        // w = (1 - cos) / 2, w^2 = 3/8 - cos / 2 + cos(2x) / 8
+        const double windowed = 0.5 * (m_sum - sumCos);
+        const double windowedSq = 0.375 * m_sq - 0.5 * sqCos + 0.125 * sqCos2;
+
+        double variance = windowedSq - windowed * windowed / length;
+        if(variance < 0)
+            variance = 0;
+        double rms = std::sqrt(variance / (length - 1));
+
+#ifdef DEBUG_SLIDING_RMS_VALIDATION
+        double direct = MeasureRMS(m_history.data(), window((unsigned)length), (unsigned)length);
+        if(std::fabs(rms - direct) > 1e-6 * direct + 1e-3)
+            qDebug() << "Sliding RMS" << rms << "differs from direct" << direct;
+#endif
+
+        return rms;
+    }
+};
+
 #ifdef DEBUG_WRITE_AMPLITUDE_PLOT
 static bool WriteAmplitudePlot(
     const std::string &fileprefix,
@@ -185,6 +351,59 @@ static bool WriteAmplitudePlot(
 #endif
 
 static const unsigned g_outputRate = 53267;
+static const unsigned g_clockRate = 7670454;
+
+//! Version of the measurement, bump it when the results are changed
+enum { g_measurerVersion = 4 };
+
+//! MIDI note played to measure the instrument
+static int MeasureNoteNumber(const FmBank::Instrument &in)
+{
+    int notenum = in.percNoteNum >= 128 ? (in.percNoteNum - 128) : in.percNoteNum;
+    if(notenum == 0)
+        notenum = 25;
+    return notenum;
+}
+
+//! Registers of the instrument written for the measurement
+static void MeasurePatch(const FmBank::Instrument &in, OPN_PatchSetup &patch)
+{
+    for(int op = 0; op < 4; op++)
+    {
+        patch.OPS[op].data[0] = in.getRegDUMUL(op);
+        patch.OPS[op].data[1] = in.getRegLevel(op);
+        patch.OPS[op].data[2] = in.getRegRSAt(op);
+        patch.OPS[op].data[3] = in.getRegAMD1(op);
+        patch.OPS[op].data[4] = in.getRegD2(op);
+        patch.OPS[op].data[5] = in.getRegSysRel(op);
+        patch.OPS[op].data[6] = in.getRegSsgEg(op);
+    }
+    patch.fbalg    = in.getRegFbAlg();
+    patch.lfosens  = 0;//Disable LFO sensitivity for clear measure
+    patch.finetune = static_cast<int8_t>(in.note_offset1);
+    patch.tone     = 0;
+}
+
+//! Block and F-number of the note, as written to the registers 0xA4 and 0xA0
+static uint16_t MeasureBlockFnum(int notenum, int noteOffset)
+{
+    double hertz = 321.88557 * std::exp(0.057762265 * (notenum + noteOffset));
+    uint16_t x2 = 0x0000;
+    if(hertz < 0 || hertz > 262143)
+    {
+        std::fprintf(stderr, "MEASURER WARNING: Why does note %d + note-offset %d produce hertz %g?          \n",
+                     notenum, noteOffset, hertz);
+        hertz = 262143;
+    }
+
+    while(hertz >= 2047.5)
+    {
+        hertz /= 2.0;    // Calculate octave
+        x2 += 0x800;
+    }
+    x2 += static_cast<uint32_t>(hertz + 0.5);
+    return x2;
+}
 
 struct TinySynth
 {
@@ -208,7 +427,11 @@ struct TinySynth
 
     void resetChip()
     {
-        m_chip->setRate(g_outputRate, 7670454);
+        // emulators allocate their state on the rate change, a reused one is only reset
+        if(m_chip->rate() != g_outputRate || m_chip->clockRate() != g_clockRate)
+            m_chip->setRate(g_outputRate, g_clockRate);
+        else
+            m_chip->reset();
 
         m_chip->writeReg(0, 0x22, 0x00);   //LFO off
         m_chip->writeReg(0, 0x27, 0x0 );   //Channel 3 mode normal
@@ -230,28 +453,13 @@ struct TinySynth
         const FmBank::Instrument &in = *in_p;
         OPN_PatchSetup patch;
 
-        m_notenum = in.percNoteNum >= 128 ? (in.percNoteNum - 128) : in.percNoteNum;
-        if(m_notenum == 0)
-            m_notenum = 25;
+        m_notenum = MeasureNoteNumber(in);
         m_notesNum = 1;
         m_fineTune = 0;
         m_noteOffsets[0] = in.note_offset1;
         //m_noteOffsets[1] = in.note_offset2;
 
-        for(int op = 0; op < 4; op++)
-        {
-            patch.OPS[op].data[0] = in.getRegDUMUL(op);
-            patch.OPS[op].data[1] = in.getRegLevel(op);
-            patch.OPS[op].data[2] = in.getRegRSAt(op);
-            patch.OPS[op].data[3] = in.getRegAMD1(op);
-            patch.OPS[op].data[4] = in.getRegD2(op);
-            patch.OPS[op].data[5] = in.getRegSysRel(op);
-            patch.OPS[op].data[6] = in.getRegSsgEg(op);
-        }
-        patch.fbalg    = in.getRegFbAlg();
-        patch.lfosens  = 0;//Disable LFO sensitivity for clear measure
-        patch.finetune = static_cast<int8_t>(in.note_offset1);
-        patch.tone     = 0;
+        MeasurePatch(in, patch);
 
         m_c = 0;
         m_port = (m_c <= 2) ? 0 : 1;
@@ -273,21 +481,7 @@ struct TinySynth
 
     void noteOn()
     {
-        double hertz = 321.88557 * std::exp(0.057762265 * (m_notenum + m_noteOffsets[0]));
-        uint16_t x2 = 0x0000;
-        if(hertz < 0 || hertz > 262143)
-        {
-            std::fprintf(stderr, "MEASURER WARNING: Why does note %d + note-offset %d produce hertz %g?          \n",
-                         m_notenum, m_noteOffsets[0], hertz);
-            hertz = 262143;
-        }
-
-        while(hertz >= 2047.5)
-        {
-            hertz /= 2.0;    // Calculate octave
-            x2 += 0x800;
-        }
-        x2 += static_cast<uint32_t>(hertz + 0.5);
+        uint16_t x2 = MeasureBlockFnum(m_notenum, m_noteOffsets[0]);
 
         // Keyon the note
         m_chip->writeReg(m_port, 0xA4 + m_cc, (x2>>8) & 0xFF);//Set frequency and octave
@@ -353,18 +547,159 @@ static void BenchmarkChip(FmBank::Instrument *in_p, OPNChipBase *chip)
     }
 }
 
-static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *result_p, OPNChipBase *chip)
+/**
+ * @brief Detection of the sounding durations from the loudness
+ *
+ * Takes the RMS of every analysis window after the key-on, then after the
+ * key-off, the same way for the emulated and for the estimated sound.
+ */
+struct DurationDetector
+{
+    //! Count of the analysis windows per second
+    enum { interval = 150 };
+    //! Count of samples in the analysis window
+    enum { samples_per_interval = g_outputRate / interval };
+
+    //! Seconds of the sound before it can be found silent
+    enum { max_silent = 6 };
+    //! Maximum seconds of the key-on and of the key-off
+    enum { max_on = 40, max_off = 60 };
+    enum { max_period_on = max_on * interval, max_period_off = max_off * interval };
+
+    const double min_coefficient_on = 0.008;
+    const double min_coefficient_off = 0.1;
+
+    //! Count of the samples in the loudness window, 0.1 seconds
+    static size_t historyLength()
+    {
+        return (size_t)std::ceil(0.1 * g_outputRate);
+    }
+
+    unsigned windows_passed_on = 0;
+    unsigned windows_passed_off = 0;
+
+    /* For Analyze the results */
+    double begin_amplitude        = 0;
+    double peak_amplitude_value   = 0;
+    size_t peak_amplitude_time    = 0;
+    size_t quarter_amplitude_time = max_period_on;
+    bool   quarter_amplitude_time_found = false;
+    size_t keyoff_out_time        = 0;
+    bool   keyoff_out_time_found  = false;
+
+    double highest_sofar = 0;
+
+    /**
+     * @brief Take the window of the key-on
+     * @param period Index of the window
+     * @param rms Loudness of the window
+     * @param audible The sound was over the quantization noise so far
+     * @return false when the key-on is to be ended
+     */
+    bool addOn(unsigned period, double rms, bool audible)
+    {
+        /* ======== Peak time detection ======== */
+        if(period == 0)
+        {
+            begin_amplitude = rms;
+            peak_amplitude_value = rms;
+            peak_amplitude_time = 0;
+        }
+        else if(rms > peak_amplitude_value)
+        {
+            peak_amplitude_value = rms;
+            peak_amplitude_time  = period;
+            // In next step, update the quater amplitude time
+            quarter_amplitude_time_found = false;
+        }
+        else if(!quarter_amplitude_time_found && (rms <= peak_amplitude_value * min_coefficient_on))
+        {
+            quarter_amplitude_time = period;
+            quarter_amplitude_time_found = true;
+        }
+        /* ======== Peak time detection =END==== */
+
+        if(rms > highest_sofar)
+            highest_sofar = rms;
+
+        if((period > max_silent * interval) &&
+           ( (rms < highest_sofar * min_coefficient_on) || !audible )
+        )
+            return false;
+
+        ++windows_passed_on;
+        return true;
+    }
+
+    void endOn()
+    {
+        if(!quarter_amplitude_time_found)
+            quarter_amplitude_time = windows_passed_on;
+    }
+
+    //! The key-on lasted all the time, it's released without the replay
+    bool heldToEnd() const
+    {
+        return windows_passed_on >= max_period_on;
+    }
+
+    //! Count of the key-on windows to replay before the key-off
+    unsigned replayPeriods() const
+    {
+        size_t periods = (peak_amplitude_time > 0) ? peak_amplitude_time : 1;
+        return (unsigned)std::min<size_t>(periods, max_period_on);
+    }
+
+    /**
+     * @brief Take the window of the key-off
+     * @param period Index of the window
+     * @param rms Loudness of the window
+     * @param audible The sound was over the quantization noise so far
+     * @return false when the key-off is to be ended
+     */
+    bool addOff(unsigned period, double rms, bool audible)
+    {
+        /* ======== Find Key Off time ======== */
+        if(!keyoff_out_time_found && (rms <= peak_amplitude_value * min_coefficient_off))
+        {
+            keyoff_out_time = period;
+            keyoff_out_time_found = true;
+        }
+        /* ======== Find Key Off time ==END=== */
+
+        if(rms < highest_sofar * min_coefficient_off)
+            return false;
+
+        if((period > max_silent * interval) && !audible)
+            return false;
+
+        ++windows_passed_off;
+        return true;
+    }
+
+    void finish(DurationInfo &result, bool audible) const
+    {
+        result.peak_amplitude_time = peak_amplitude_time;
+        result.peak_amplitude_value = peak_amplitude_value;
+        result.begin_amplitude = begin_amplitude;
+        result.quarter_amplitude_time = (double)quarter_amplitude_time;
+        result.keyoff_out_time = (double)keyoff_out_time;
+
+        result.ms_sound_kon  = (int64_t)(quarter_amplitude_time * 1000.0 / interval);
+        result.ms_sound_koff = (int64_t)(keyoff_out_time        * 1000.0 / interval);
+        result.nosound = (peak_amplitude_value < 0.5) || !audible;
+    }
+};
+
+static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *result_p, OPNChipBase *chip, LoudnessHistory &audioHistory)
 {
     const FmBank::Instrument &in = *in_p;
     DurationInfo &result = *result_p;
 
-    AudioHistory<double> audioHistory;
-
-    const unsigned interval             = 150;
-    const unsigned samples_per_interval = g_outputRate / interval;
+    DurationDetector detector;
+    const unsigned samples_per_interval = DurationDetector::samples_per_interval;
 
-    const double historyLength = 0.1;  // maximum duration to memorize (seconds)
-    audioHistory.reset(std::ceil(historyLength * g_outputRate));
+    audioHistory.reset(DurationDetector::historyLength());
 
 #if defined(ENABLE_PLOTS) || defined(DEBUG_WRITE_AMPLITUDE_PLOT)
     const double timestep = (double)samples_per_interval / g_outputRate;  // interval between analysis steps (seconds)
@@ -373,10 +708,6 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
     result.amps_timestep = timestep;
 #endif
 
-    std::unique_ptr<double[]> window;
-    window.reset(new double[audioHistory.capacity()]);
-    unsigned winsize = 0;
-
     TinySynth synth;
     synth.m_chip = chip;
     synth.resetChip();
@@ -384,34 +715,14 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
     synth.noteOn();
 
     /* For capturing */
-    const unsigned max_silent = 6;
-    const unsigned max_on  = 40;
-    const unsigned max_off = 60;
-
-    unsigned max_period_on = max_on * interval;
-    unsigned max_period_off = max_off * interval;
-
-    const double min_coefficient_on = 0.008;
-    const double min_coefficient_off = 0.1;
-
-    unsigned windows_passed_on = 0;
-    unsigned windows_passed_off = 0;
-
-    /* For Analyze the results */
-    double begin_amplitude        = 0;
-    double peak_amplitude_value   = 0;
-    size_t peak_amplitude_time    = 0;
-    size_t quarter_amplitude_time = max_period_on;
-    bool   quarter_amplitude_time_found = false;
-    size_t keyoff_out_time        = 0;
-    bool   keyoff_out_time_found  = false;
+    const unsigned max_period_on = DurationDetector::max_period_on;
+    const unsigned max_period_off = DurationDetector::max_period_off;
 
     const size_t audioBufferLength = 256;
     const size_t audioBufferSize = 2 * audioBufferLength;
     int16_t audioBuffer[audioBufferSize];
 
     // For up to 40 seconds, measure mean amplitude.
-    double highest_sofar = 0;
     short sound_min = 0, sound_max = 0;
 
 #if defined(ENABLE_PLOTS)
@@ -422,7 +733,7 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
     std::vector<double> amplitudecurve_on;
     amplitudecurve_on.reserve(max_period_on);
 #endif
-    for(unsigned period = 0; period < max_period_on; ++period, ++windows_passed_on)
+    for(unsigned period = 0; period < max_period_on; ++period)
     {
         for(unsigned i = 0; i < samples_per_interval;)
         {
@@ -439,47 +750,15 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
             i += blocksize;
         }
 
-        if(winsize != audioHistory.size())
-        {
-            winsize = audioHistory.size();
-            HannWindow(window.get(), winsize);
-        }
-
-        double rms = MeasureRMS(audioHistory.data(), window.get(), winsize);
-        /* ======== Peak time detection ======== */
-        if(period == 0)
-        {
-            begin_amplitude = rms;
-            peak_amplitude_value = rms;
-            peak_amplitude_time = 0;
-        }
-        else if(rms > peak_amplitude_value)
-        {
-            peak_amplitude_value = rms;
-            peak_amplitude_time  = period;
-            // In next step, update the quater amplitude time
-            quarter_amplitude_time_found = false;
-        }
-        else if(!quarter_amplitude_time_found && (rms <= peak_amplitude_value * min_coefficient_on))
-        {
-            quarter_amplitude_time = period;
-            quarter_amplitude_time_found = true;
-        }
-        /* ======== Peak time detection =END==== */
+        double rms = audioHistory.rms();
 #if defined(ENABLE_PLOTS) || defined(DEBUG_AMPLITUDE_PEAK_VALIDATION) || defined(DEBUG_WRITE_AMPLITUDE_PLOT)
         amplitudecurve_on.push_back(rms);
 #endif
-        if(rms > highest_sofar)
-            highest_sofar = rms;
-
-        if((period > max_silent * interval) &&
-           ( (rms < highest_sofar * min_coefficient_on) || (sound_min >= -1 && sound_max <= 1) )
-        )
+        if(!detector.addOn(period, rms, !(sound_min >= -1 && sound_max <= 1)))
             break;
     }
 
-    if(!quarter_amplitude_time_found)
-        quarter_amplitude_time = windows_passed_on;
+    detector.endOn();
 
 #ifdef DEBUG_AMPLITUDE_PEAK_VALIDATION
     char outBufOld[250];
@@ -488,39 +767,39 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
     std::memset(outBufNew, 0, 250);
 
     std::snprintf(outBufOld, 250, "Peak: beg=%g, peakv=%g, peakp=%zu, q=%zu",
-                begin_amplitude,
-                peak_amplitude_value,
-                peak_amplitude_time,
-                quarter_amplitude_time);
+                detector.begin_amplitude,
+                detector.peak_amplitude_value,
+                detector.peak_amplitude_time,
+                detector.quarter_amplitude_time);
 
     /* Detect the peak time */
-    begin_amplitude        = amplitudecurve_on[0];
-    peak_amplitude_value   = begin_amplitude;
-    peak_amplitude_time    = 0;
-    quarter_amplitude_time = amplitudecurve_on.size();
-    keyoff_out_time        = 0;
+    detector.begin_amplitude        = amplitudecurve_on[0];
+    detector.peak_amplitude_value   = detector.begin_amplitude;
+    detector.peak_amplitude_time    = 0;
+    detector.quarter_amplitude_time = amplitudecurve_on.size();
+    detector.keyoff_out_time        = 0;
     for(size_t a = 1; a < amplitudecurve_on.size(); ++a)
     {
-        if(amplitudecurve_on[a] > peak_amplitude_value)
+        if(amplitudecurve_on[a] > detector.peak_amplitude_value)
         {
-            peak_amplitude_value = amplitudecurve_on[a];
-            peak_amplitude_time  = a;
+            detector.peak_amplitude_value = amplitudecurve_on[a];
+            detector.peak_amplitude_time  = a;
         }
     }
-    for(size_t a = peak_amplitude_time; a < amplitudecurve_on.size(); ++a)
+    for(size_t a = detector.peak_amplitude_time; a < amplitudecurve_on.size(); ++a)
     {
-        if(amplitudecurve_on[a] <= peak_amplitude_value * min_coefficient_on)
+        if(amplitudecurve_on[a] <= detector.peak_amplitude_value * detector.min_coefficient_on)
         {
-            quarter_amplitude_time = a;
+            detector.quarter_amplitude_time = a;
             break;
         }
     }
 
     std::snprintf(outBufNew, 250, "Peak: beg=%g, peakv=%g, peakp=%zu, q=%zu",
-                begin_amplitude,
-                peak_amplitude_value,
-                peak_amplitude_time,
-                quarter_amplitude_time);
+                detector.begin_amplitude,
+                detector.peak_amplitude_value,
+                detector.peak_amplitude_time,
+                detector.quarter_amplitude_time);
 
     if(memcmp(outBufNew, outBufOld, 250) != 0)
     {
@@ -529,7 +808,7 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
     }
 #endif
 
-    if(windows_passed_on >= max_period_on)
+    if(detector.heldToEnd())
     {
         // Just Keyoff the note
         synth.noteOff();
@@ -541,10 +820,9 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
         synth.setInstrument(&in);
         synth.noteOn();
 
-        audioHistory.reset(std::ceil(historyLength * g_outputRate));
-        for(unsigned period = 0;
-            ((period < peak_amplitude_time) || (period == 0)) && (period < max_period_on);
-            ++period)
+        audioHistory.reset(DurationDetector::historyLength());
+        const unsigned replay_periods = detector.replayPeriods();
+        for(unsigned period = 0; period < replay_periods; ++period)
         {
             for(unsigned i = 0; i < samples_per_interval;)
             {
@@ -568,7 +846,7 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
     std::vector<double> amplitudecurve_off;
     amplitudecurve_off.reserve(max_period_off);
 #endif
-    for(unsigned period = 0; period < max_period_off; ++period, ++windows_passed_off)
+    for(unsigned period = 0; period < max_period_off; ++period)
     {
         for(unsigned i = 0; i < samples_per_interval;)
         {
@@ -585,27 +863,11 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
             i += blocksize;
         }
 
-        if(winsize != audioHistory.size())
-        {
-            winsize = audioHistory.size();
-            HannWindow(window.get(), winsize);
-        }
-
-        double rms = MeasureRMS(audioHistory.data(), window.get(), winsize);
-        /* ======== Find Key Off time ======== */
-        if(!keyoff_out_time_found && (rms <= peak_amplitude_value * min_coefficient_off))
-        {
-            keyoff_out_time = period;
-            keyoff_out_time_found = true;
-        }
-        /* ======== Find Key Off time ==END=== */
+        double rms = audioHistory.rms();
 #if defined(ENABLE_PLOTS) || defined(DEBUG_AMPLITUDE_PEAK_VALIDATION) || defined(DEBUG_WRITE_AMPLITUDE_PLOT)
         amplitudecurve_off.push_back(rms);
 #endif
-        if(rms < highest_sofar * min_coefficient_off)
-            break;
-
-        if((period > max_silent * interval) && (sound_min >= -1 && sound_max <= 1))
+        if(!detector.addOff(period, rms, !(sound_min >= -1 && sound_max <= 1)))
             break;
     }
 
@@ -615,55 +877,621 @@ static void ComputeDurations(const FmBank::Instrument *in_p, DurationInfo *resul
 #endif
 
 #ifdef DEBUG_AMPLITUDE_PEAK_VALIDATION
-    size_t debug_peak_old = keyoff_out_time;
+    size_t debug_peak_old = detector.keyoff_out_time;
 
     /* Analyze the final results */
     for(size_t a = 0; a < amplitudecurve_off.size(); ++a)
     {
-        if(amplitudecurve_off[a] <= peak_amplitude_value * min_coefficient_off)
+        if(amplitudecurve_off[a] <= detector.peak_amplitude_value * detector.min_coefficient_off)
         {
-            keyoff_out_time = a;
+            detector.keyoff_out_time = a;
             break;
         }
     }
 
-    if(debug_peak_old != keyoff_out_time)
+    if(debug_peak_old != detector.keyoff_out_time)
     {
-        qDebug() << "KeyOff time is 1:" << debug_peak_old << " and 2:" << keyoff_out_time;
+        qDebug() << "KeyOff time is 1:" << debug_peak_old << " and 2:" << detector.keyoff_out_time;
     }
 #endif
 
-    result.peak_amplitude_time = peak_amplitude_time;
-    result.peak_amplitude_value = peak_amplitude_value;
-    result.begin_amplitude = begin_amplitude;
-    result.quarter_amplitude_time = (double)quarter_amplitude_time;
-    result.keyoff_out_time = (double)keyoff_out_time;
+    detector.finish(result, !(sound_min >= -1 && sound_max <= 1));
+}
+
+//! Peak of a carrier at the zero attenuation, as output by the default emulator
+static const double g_carrierAmplitude = 2887.0;
+//! Peak of the channel output, the sum of the carriers is clipped to it
+static const double g_channelAmplitude = 2896.0;
+
+enum { quantized_table_steps = 8, quantized_table_size = 32 * quantized_table_steps };
+
+static std::vector<double> BuildQuantizedTable()
+{
+    enum { phases = 256 };
+    std::vector<double> table(quantized_table_size);
+    for(unsigned i = 0; i < quantized_table_size; ++i)
+    {
+        double a = (double)i / quantized_table_steps;
+        double sum = 0;
+        for(unsigned p = 0; p < phases; ++p)
+        {
+            double x = std::trunc(a * std::sin(2 * M_PI * (p + 0.5) / phases));
+            sum += x * x;
+        }
+        table[i] = sum / phases;
+    }
+    return table;
+}
+
+/**
+ * @brief Mean square of the sine of the peak amplitude, truncated to integers
+ *
+ * The quiet sound is made of a few integer levels, its loudness differs
+ * from the one of the ideal sine.
+ */
+static double QuantizedMeanSquare(double amplitude)
+{
+    enum { table_steps = quantized_table_steps, table_size = quantized_table_size };
+    // built once by the first caller, the other measuring threads wait for it
+    static const std::vector<double> table = BuildQuantizedTable();
+
+    if(amplitude >= 32.0)
+        return amplitude * amplitude / 2.0;
+    double pos = amplitude * table_steps;
+    unsigned i = (unsigned)pos;
+    if(i + 1 >= table_size)
+        return table[table_size - 1];
+    double frac = pos - i;
+    return table[i] * (1.0 - frac) + table[i + 1] * frac;
+}
+
+//! Peak of a carrier at the attenuation, in units of the envelope generator
+static double CarrierAmplitude(double attenuation)
+{
+    return g_carrierAmplitude * std::pow(10.0, -attenuation * 0.09375 / 20.0);
+}
+
+/**
+ * @brief Loudness of the instrument, computed from the levels of the carriers
+ *
+ * The phase modulation doesn't change the loudness of a carrier, so the
+ * modulators are skipped. The sound is divided into cells of samples, and
+ * the loudness window is summed over the cells.
+ */
+class CarrierLoudness
+{
+public:
+    //! Count of samples in the cell, the analysis window is a whole count of cells
+    enum { cell_length = 71 };
+
+    virtual ~CarrierLoudness() {}
+
+    //! Carriers of the algorithms, as bits of the operators in order of registers
+    static unsigned carriers(unsigned algorithm)
+    {
+        static const uint8_t masks[8] = {0x8, 0x8, 0x8, 0x8, 0xC, 0xE, 0xE, 0xF};
+        return masks[algorithm & 7];
+    }
+
+    //! Release the key at the sample, the cells after it are recomputed
+    virtual void keyOff(size_t sample)
+    {
+        size_t cells = sample / cell_length;
+        if(m_power.size() > cells)
+        {
+            m_power.resize(cells);
+            m_amplitude.resize(cells);
+        }
+    }
+
+    //! Loudness of the window ending before the sample, same as LoudnessHistory::rms()
+    double rms(size_t end)
+    {
+        const size_t capacity = DurationDetector::historyLength();
+        const size_t length = std::min(end, capacity);
+        const size_t endCell = (end - 1) / cell_length + 1;
+        computeCells(endCell);
+
+        const std::vector<double> *weights = &m_fullWeights;
+        if(length < capacity)
+        {
+            cellWeights(m_filling, end, length);
+            weights = &m_filling;
+        }
+
+        double sum = 0;
+        for(size_t c = 0; c < weights->size() && c < endCell; ++c)
+            sum += (*weights)[c] * m_power[endCell - 1 - c];
+        return std::sqrt(sum / (length - 1));
+    }
+
+    //! Amplitude of the sound near the sample
+    double amplitude(size_t sample)
+    {
+        size_t cell = sample / cell_length;
+        computeCells(cell + 1);
+        return m_amplitude[cell];
+    }
+
+    //! The sound was over the quantization noise so far
+    bool audible() const
+    {
+        return m_highest >= 2.0;
+    }
+
+    double highest() const
+    {
+        return m_highest;
+    }
+
+protected:
+    //! Attenuations of the carriers, by the total levels
+    double m_levels[4];
+    unsigned m_count = 0;
+
+    /**
+     * @brief Sum the amplitudes of the carriers in the next cell
+     * @param cell Index of the cell, following the previous one
+     */
+    virtual double cellAmplitude(size_t cell) = 0;
+
+    //! Forget the computed cells, for the new instrument
+    void resetCells()
+    {
+        m_power.clear();
+        m_amplitude.clear();
+        m_highest = 0;
+        // the windows end at the cell bounds
+        const size_t capacity = DurationDetector::historyLength();
+        if(m_fullWeights.empty())
+            cellWeights(m_fullWeights, (capacity / cell_length + 1) * cell_length, capacity);
+    }
+
+    //! Take the total levels of the carriers of the instrument
+    void setupLevels(const FmBank::Instrument &in)
+    {
+        const unsigned mask = carriers(in.algorithm);
+        m_count = 0;
+        for(unsigned op = 0; op < 4; ++op)
+        {
+            if(mask & (1u << op))
+                m_levels[m_count++] = in.OP[op].level * 8.0;
+        }
+    }
+
+private:
+    //! Mean squares of the cells computed so far
+    std::vector<double> m_power;
+    std::vector<double> m_amplitude;
+    //! Weights of the cells before the window end, for the full window
+    std::vector<double> m_fullWeights;
+    //! Weights of the window which isn't full yet, reused by the calls of rms()
+    std::vector<double> m_filling;
+    //! Highest amplitude of the cells computed so far
+    double m_highest = 0;
+
+    void computeCells(size_t count)
+    {
+        while(m_power.size() < count)
+        {
+            double amplitude = cellAmplitude(m_power.size());
+            m_amplitude.push_back(amplitude);
+            amplitude = std::min(amplitude, g_channelAmplitude);
+            m_power.push_back(QuantizedMeanSquare(amplitude));
+            if(amplitude > m_highest)
+                m_highest = amplitude;
+        }
+    }
+
+    static void cellWeights(std::vector<double> &weights, size_t end, size_t length)
+    {
+        const size_t first = end - length;
+        const size_t cells = (end - 1) / cell_length - first / cell_length + 1;
+        weights.assign(cells, 0.0);
+        for(size_t i = 0; i < length; ++i)
+        {
+            double w = 0.5 * (1.0 - std::cos(2 * M_PI * i / (length - 1)));
+            size_t cell = (end - 1) / cell_length - (first + i) / cell_length;
+            weights[cell] += w * w;
+        }
+    }
+};
+
+//! Loudness of the carriers, by the envelope model
+class EstimatedLoudness : public CarrierLoudness
+{
+    EnvelopeModel m_envelopes[4];
+    //! Sample of the key-off, none if the key is held
+    size_t m_keyOff = (size_t)-1;
+
+protected:
+    double cellAmplitude(size_t cell) override
+    {
+        const double time = (cell + 0.5) * cell_length / g_outputRate;
+        double sum = 0;
+        for(unsigned c = 0; c < m_count; ++c)
+        {
+            double attenuation = (m_keyOff != (size_t)-1) ?
+                m_envelopes[c].attenuation(time, (double)m_keyOff / g_outputRate) :
+                m_envelopes[c].attenuation(time);
+            double amplitude = CarrierAmplitude(attenuation + m_levels[c]);
+            sum += amplitude * amplitude;
+        }
+        return std::sqrt(sum);
+    }
+
+public:
+    void setup(const FmBank::Instrument &in, uint16_t blockFnum)
+    {
+        const unsigned keyCode = EnvelopeModel::keyCode(blockFnum >> 11, blockFnum & 0x7FF);
+        // the envelope generator is clocked every 3 samples of the chip
+        const double clockRate = g_clockRate / (6.0 * 24.0 * 3.0);
+        const unsigned mask = carriers(in.algorithm);
+        unsigned count = 0;
+        for(unsigned op = 0; op < 4; ++op)
+        {
+            if(mask & (1u << op))
+                m_envelopes[count++].setup(in.OP[op], keyCode, clockRate);
+        }
+        setupLevels(in);
+        m_keyOff = (size_t)-1;
+        resetCells();
+    }
+
+    void keyOff(size_t sample) override
+    {
+        m_keyOff = sample;
+        CarrierLoudness::keyOff(sample);
+    }
+};
+
+/**
+ * @brief Loudness of the carriers, by the envelope generators of the emulator
+ *
+ * Only the envelopes are emulated, the synthesis is skipped. The levels
+ * are exact, including the SSG-EG, which the model doesn't follow.
+ */
+class SimulatedLoudness : public CarrierLoudness
+{
+    TinySynth m_synth;
+    const FmBank::Instrument *m_instrument = nullptr;
+    unsigned m_carriers = 0;
+
+    //! Start the note, and run the envelopes up to the sample
+    bool start(size_t sample)
+    {
+        m_synth.resetChip();
+        m_synth.setInstrument(m_instrument);
+        m_synth.noteOn();
+        return m_synth.m_chip->generateEnvelopes(sample);
+    }
+
+protected:
+    double cellAmplitude(size_t) override
+    {
+        // the levels are taken in the middle of the cell
+        const size_t half = cell_length / 2;
+        OPNChipBase *chip = m_synth.m_chip;
+        chip->generateEnvelopes(half);
+
+        double sum = 0;
+        for(unsigned op = 0, c = 0; op < 4; ++op)
+        {
+            if(!(m_carriers & (1u << op)))
+                continue;
+            uint8_t phase;
+            uint16_t level;
+            chip->readEnvelope(m_synth.m_c, op, phase, level);
+            double amplitude = CarrierAmplitude(level + m_levels[c++]);
+            sum += amplitude * amplitude;
+        }
+
+        chip->generateEnvelopes(cell_length - half);
+        return std::sqrt(sum);
+    }
 
-    result.ms_sound_kon  = (int64_t)(quarter_amplitude_time * 1000.0 / interval);
-    result.ms_sound_koff = (int64_t)(keyoff_out_time        * 1000.0 / interval);
-    result.nosound = (peak_amplitude_value < 0.5) || ((sound_min >= -1) && (sound_max <= 1));
+public:
+    explicit SimulatedLoudness(OPNChipBase *chip)
+    {
+        m_synth.m_chip = chip;
+    }
+
+    //! @return false if the emulator can't run the envelopes alone
+    bool setup(const FmBank::Instrument &in)
+    {
+        m_instrument = &in;
+        m_carriers = carriers(in.algorithm);
+        setupLevels(in);
+        resetCells();
+        return start(0);
+    }
+
+    void keyOff(size_t sample) override
+    {
+        // replay the key-on from the start, as the full emulation does
+        start(sample);
+        m_synth.noteOff();
+        CarrierLoudness::keyOff(sample);
+    }
+};
+
+//! The envelope keeps the level after the attack, while the key is held
+static bool EnvelopeIsSteady(const FmBank::Operator &op)
+{
+    return (op.attack >= 24) &&
+           ((op.decay1 == 0) || (op.sustain == 0)) &&
+           (op.decay2 == 0) && !(op.ssg_eg & 0x08);
+}
+
+/**
+ * @brief The loudness depends on more than the levels of the carriers
+ *
+ * The modulation index of a strong modulator changes the loudness of the
+ * carrier, when the frequencies are in a harmonic ratio. The carriers of
+ * the same frequency interfere.
+ */
+static bool LoudnessIsAmbiguous(const FmBank::Instrument &in)
+{
+    // operators modulating the carriers directly, by the algorithm
+    static const uint8_t feeders[8] = {0x2, 0x2, 0x3, 0x6, 0x3, 0x1, 0x1, 0x0};
+    // modulators above this level vary the loudness noticeably
+    const unsigned strong_modulator_level = 24;
+    // carriers closer than this level in the attenuation interfere noticeably
+    const unsigned interfering_level = 16;
+    // carriers below this level are too quiet to interfere
+    const unsigned silent_level = 64;
+
+    const unsigned carriers = CarrierLoudness::carriers(in.algorithm);
+    for(unsigned op = 0; op < 4; ++op)
+    {
+        const FmBank::Operator &o = in.OP[op];
+        if(carriers & (1u << op))
+        {
+            if((op == 0) && (in.feedback >= 6) && !EnvelopeIsSteady(o))
+                return true;
+            for(unsigned other = op + 1; other < 4; ++other)
+            {
+                const FmBank::Operator &p = in.OP[other];
+                if(!(carriers & (1u << other)) || (p.fmult != o.fmult))
+                    continue;
+                if((o.level >= silent_level) && (p.level >= silent_level))
+                    continue;
+                int distance = (int)o.level - (int)p.level;
+                if(std::abs(distance) < (int)interfering_level)
+                    return true;
+            }
+        }
+        else if((feeders[in.algorithm & 7] & (1u << op)) &&
+                (o.level < strong_modulator_level) && !EnvelopeIsSteady(o))
+            return true;
+    }
+    return false;
+}
+
+//! The SSG-EG repeats the envelope of a carrier, the model doesn't follow it
+static bool CarriersUseSsgEg(const FmBank::Instrument &in)
+{
+    const unsigned carriers = CarrierLoudness::carriers(in.algorithm);
+    for(unsigned op = 0; op < 4; ++op)
+    {
+        if((carriers & (1u << op)) && (in.OP[op].ssg_eg & 0x08))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Pass the loudness of the carriers through the detection of the emulated sound
+ * @return false if the loudness is ambiguous, and the sound is to be emulated
+ */
+static bool DetectDurations(CarrierLoudness &loudness, DurationInfo &result)
+{
+    DurationDetector detector;
+    const unsigned samples_per_interval = DurationDetector::samples_per_interval;
+
+    size_t sample = 0;
+    for(unsigned period = 0; period < DurationDetector::max_period_on; ++period)
+    {
+        sample += samples_per_interval;
+        if(!detector.addOn(period, loudness.rms(sample), loudness.audible()))
+            break;
+    }
+    detector.endOn();
+
+    // the sum of the carriers is clipped
+    if(loudness.highest() >= g_channelAmplitude)
+        return false;
+
+    size_t keyOff = detector.heldToEnd() ?
+        (size_t)DurationDetector::max_period_on * samples_per_interval :
+        (size_t)detector.replayPeriods() * samples_per_interval;
+    // the release starts close to the threshold of the key-off
+    if(loudness.rms(keyOff) < detector.peak_amplitude_value * detector.min_coefficient_off * 2.0)
+        return false;
+    loudness.keyOff(keyOff);
+
+    sample = keyOff;
+    for(unsigned period = 0; period < DurationDetector::max_period_off; ++period)
+    {
+        sample += samples_per_interval;
+        if(!detector.addOff(period, loudness.rms(sample), loudness.audible()))
+            break;
+    }
+
+    detector.finish(result, loudness.audible());
+    return true;
 }
 
+/**
+ * @brief Estimate the durations from the envelope model of the carriers
+ *
+ * Much faster than the emulation. The loudness passes the same detection
+ * as the emulated sound.
+ * @return false if the estimate is ambiguous, and the sound is to be emulated
+ */
+static bool EstimateDurations(const FmBank::Instrument &in, DurationInfo &result)
+{
+    if(LoudnessIsAmbiguous(in) || CarriersUseSsgEg(in))
+        return false;
+
+    EstimatedLoudness loudness;
+    loudness.setup(in, MeasureBlockFnum(MeasureNoteNumber(in), in.note_offset1));
+    return DetectDurations(loudness, result);
+}
+
+/**
+ * @brief Measure the durations from the envelope generators of the emulator
+ *
+ * Slower than the estimate, but it follows any envelope the emulator makes.
+ * @return false if the loudness is ambiguous or the emulator can't run the
+ * envelopes alone, and the sound is to be emulated fully
+ */
+static bool SimulateDurations(const FmBank::Instrument &in, DurationInfo &result, OPNChipBase *chip)
+{
+    if(LoudnessIsAmbiguous(in))
+        return false;
+
+    SimulatedLoudness loudness(chip);
+    if(!loudness.setup(in))
+        return false;
+    return DetectDurations(loudness, result);
+}
+
+/**
+ * @brief Emulator and buffers of the measurements of one thread
+ *
+ * Kept for the lifetime of the thread, so the measurements of a bank
+ * reuse them instead of allocating for every instrument.
+ */
+struct MeasureContext
+{
+    DefaultOPN2 chip;
+    LoudnessHistory history;
+
+    MeasureContext() : chip(OPNChip_OPN2) {}
+
+    static MeasureContext &local()
+    {
+        static thread_local MeasureContext context;
+        return context;
+    }
+};
+
+/**
+ * @brief Key of the instrument in the measurement cache
+ *
+ * Covers only what the measurement depends on: the written registers,
+ * the played note, the emulator, the version of the measurement, and
+ * whether the durations are allowed to be estimated.
+ */
+static uint64_t MeasureCacheKey(const FmBank::Instrument &in, bool fast = false)
+{
+    OPN_PatchSetup patch;
+    MeasurePatch(in, patch);
+
+    MeasurementCache::Key key;
+    for(int op = 0; op < 4; op++)
+        key.addBytes(patch.OPS[op].data, 7);
+    key.addByte(patch.fbalg);
+    key.addUint32(static_cast<uint32_t>(MeasureNoteNumber(in)));
+    key.addUint32(static_cast<uint16_t>(in.note_offset1));
+    key.addString(DefaultOPN2::name());
+    key.addUint32(OPNChip_OPN2);
+    key.addUint32(g_outputRate);
+    key.addUint32(g_clockRate);
+    key.addUint32(g_measurerVersion);
+    key.addByte(fast ? 1 : 0);
+    return key.value();
+}
+
+static bool LookupCachedDurations(MeasurementCache &cache, uint64_t key, FmBank::Instrument &in)
+{
+    MeasurementCache::Entry entry;
+    if(!cache.lookup(key, entry))
+        return false;
+    in.ms_sound_kon = entry.ms_sound_kon;
+    in.ms_sound_koff = entry.ms_sound_koff;
+    in.is_blank = entry.nosound;
+    return true;
+}
+
+static void StoreCachedDurations(MeasurementCache &cache, uint64_t key, const FmBank::Instrument &in)
+{
+    MeasurementCache::Entry entry;
+    entry.ms_sound_kon = in.ms_sound_kon;
+    entry.ms_sound_koff = in.ms_sound_koff;
+    entry.nosound = in.is_blank;
+    cache.insert(key, entry);
+}
+
+/**
+ * @brief Instruments of the bank sounding the same
+ *
+ * Only the first one is measured, the rest take its durations.
+ */
+struct MeasureGroup
+{
+    uint64_t key;
+    QVector<FmBank::Instrument *> members;
+
+    void fanOut() const
+    {
+        const FmBank::Instrument &first = *members.front();
+        for(int i = 1; i < members.size(); ++i)
+        {
+            FmBank::Instrument &ins = *members[i];
+            ins.ms_sound_kon = first.ms_sound_kon;
+            ins.ms_sound_koff = first.ms_sound_koff;
+            ins.is_blank = first.is_blank;
+        }
+    }
+};
+
 static void ComputeDurationsDefault(const FmBank::Instrument *in, DurationInfo *result)
 {
-    DefaultOPN2 chip(OPNChip_OPN2);
-    ComputeDurations(in, result, &chip);
+    MeasureContext &context = MeasureContext::local();
+    ComputeDurations(in, result, &context.chip, context.history);
 }
 
-static void MeasureDurations(FmBank::Instrument *in_p, OPNChipBase *chip)
+static void StoreDurations(FmBank::Instrument &in, const DurationInfo &result)
 {
-    FmBank::Instrument &in = *in_p;
-    DurationInfo result;
-    ComputeDurations(&in, &result, chip);
     in.ms_sound_kon = (uint16_t)result.ms_sound_kon;
     in.ms_sound_koff = (uint16_t)result.ms_sound_koff;
     in.is_blank = result.nosound;
 }
 
+static void MeasureDurations(FmBank::Instrument *in_p, OPNChipBase *chip, LoudnessHistory &history)
+{
+    DurationInfo result;
+    ComputeDurations(in_p, &result, chip, history);
+    StoreDurations(*in_p, result);
+}
+
 static void MeasureDurationsDefault(FmBank::Instrument *in_p)
 {
-    DefaultOPN2 chip(OPNChip_OPN2);
-    MeasureDurations(in_p, &chip);
+    MeasureContext &context = MeasureContext::local();
+    MeasureDurations(in_p, &context.chip, context.history);
+}
+
+/**
+ * @brief Take the estimate or the envelopes where they are unambiguous,
+ * emulate the rest
+ *
+ * Some of the accepted sounds still differ from the emulation by more
+ * than 5%, see the measure_estimate benchmark, so it's only on request.
+ */
+static void MeasureDurationsFast(FmBank::Instrument *in_p)
+{
+    // the loudness of the carriers follows the output of the default emulator
+    MeasureContext &context = MeasureContext::local();
+    DurationInfo result;
+    if(EstimateDurations(*in_p, result) ||
+       (CarriersUseSsgEg(*in_p) && SimulateDurations(*in_p, result, &context.chip)))
+    {
+        StoreDurations(*in_p, result);
+        return;
+    }
+    MeasureDurations(in_p, &context.chip, context.history);
 }
 
 static void MeasureDurationsBenchmark(FmBank::Instrument *in_p, OPNChipBase *chip, QVector<Measurer::BenchmarkResult> *result)
@@ -703,6 +1531,14 @@ Measurer::Measurer(QWidget *parent) :
 Measurer::~Measurer()
 {}
 
+void Measurer::loadCache()
+{
+    if(m_cacheLoaded)
+        return;
+    m_cache.load();
+    m_cacheLoaded = true;
+}
+
 static void insertOrBlank(FmBank::Instrument &ins, const FmBank::Instrument &blank, QQueue<FmBank::Instrument *> &tasks)
 {
     ins.is_blank = false;
@@ -716,6 +1552,28 @@ static void insertOrBlank(FmBank::Instrument &ins, const FmBank::Instrument &bla
     }
 }
 
+//! Apply all calculated values into backup store to don't re-calculate same stuff
+static void syncDurations(const FmBank &bank, FmBank &bankBackup)
+{
+    int i = 0;
+    for(i = 0; i < bank.Ins_Melodic_box.size() && i < bankBackup.Ins_Melodic_box.size(); i++)
+    {
+        const FmBank::Instrument &ins1 = bank.Ins_Melodic_box[i];
+        FmBank::Instrument &ins2 = bankBackup.Ins_Melodic_box[i];
+        ins2.ms_sound_kon  = ins1.ms_sound_kon;
+        ins2.ms_sound_koff = ins1.ms_sound_koff;
+        ins2.is_blank = ins1.is_blank;
+    }
+    for(i = 0; i < bank.Ins_Percussion_box.size() && i < bankBackup.Ins_Percussion_box.size(); i++)
+    {
+        const FmBank::Instrument &ins1 = bank.Ins_Percussion_box[i];
+        FmBank::Instrument &ins2 = bankBackup.Ins_Percussion_box[i];
+        ins2.ms_sound_kon  = ins1.ms_sound_kon;
+        ins2.ms_sound_koff = ins1.ms_sound_koff;
+        ins2.is_blank = ins1.is_blank;
+    }
+}
+
 bool Measurer::doMeasurement(FmBank &bank, FmBank &bankBackup, bool forceReset)
 {
     QQueue<FmBank::Instrument *> tasks;
@@ -745,10 +1603,46 @@ bool Measurer::doMeasurement(FmBank &bank, FmBank &bankBackup, bool forceReset)
     if(tasks.isEmpty())
         return true;// Nothing to do! :)
 
+    // Group the same sounds, taking the durations measured before
+    loadCache();
+    const int total = tasks.size();
+    QVector<MeasureGroup> groups;
+    QHash<quint64, int> groupOfKey;
+    foreach(FmBank::Instrument *ins, tasks)
+    {
+        uint64_t key = MeasureCacheKey(*ins);
+        QHash<quint64, int>::iterator it = groupOfKey.find(key);
+        if(it != groupOfKey.end())
+        {
+            groups[*it].members.append(ins);
+            continue;
+        }
+        if(LookupCachedDurations(m_cache, key, *ins))
+            continue; // duplicates of it are found in the cache too
+        groupOfKey.insert(key, groups.size());
+        MeasureGroup group;
+        group.key = key;
+        group.members.append(ins);
+        groups.append(group);
+    }
+    tasks.clear();
+
+    QQueue<FmBank::Instrument *> measured;
+    foreach(const MeasureGroup &group, groups)
+        measured.enqueue(group.members.front());
+
+    if(measured.isEmpty())
+    {
+        syncDurations(bank, bankBackup);
+        m_cache.save();
+        return true;
+    }
+
     QProgressDialog m_progressBox(m_parentWindow);
     m_progressBox.setWindowModality(Qt::WindowModal);
     m_progressBox.setWindowTitle(tr("Sounding delay calculation"));
-    m_progressBox.setLabelText(tr("Please wait..."));
+    m_progressBox.setLabelText(tr("Please wait...\n"
+                                  "Measuring %1 unique sounds of %2 instruments").arg(measured.size()).arg(total));
 
 #ifndef IS_QT_4
     QFutureWatcher<void> watcher;
@@ -757,50 +1651,60 @@ bool Measurer::doMeasurement(FmBank &bank, FmBank &bankBackup, bool forceReset)
     watcher.connect(&watcher, SIGNAL(progressValueChanged(int)), &m_progressBox, SLOT(setValue(int)));
     watcher.connect(&watcher, SIGNAL(finished()), &m_progressBox, SLOT(accept()));
 
-    watcher.setFuture(QtConcurrent::map(tasks, &MeasureDurationsDefault));
+    watcher.setFuture(QtConcurrent::map(measured, &MeasureDurationsDefault));
 
     m_progressBox.exec();
     watcher.waitForFinished();
 
-    tasks.clear();
-
-    // Apply all calculated values into backup store to don't re-calculate same stuff
-    for(i = 0; i < bank.Ins_Melodic_box.size() && i < bankBackup.Ins_Melodic_box.size(); i++)
+    if(watcher.isCanceled())
     {
-        FmBank::Instrument &ins1 = bank.Ins_Melodic_box[i];
-        FmBank::Instrument &ins2 = bankBackup.Ins_Melodic_box[i];
-        ins2.ms_sound_kon  = ins1.ms_sound_kon;
-        ins2.ms_sound_koff = ins1.ms_sound_koff;
-        ins2.is_blank = ins1.is_blank;
+        syncDurations(bank, bankBackup);
+        m_cache.save();
+        return false;
     }
-    for(i = 0; i < bank.Ins_Percussion_box.size() && i < bankBackup.Ins_Percussion_box.size(); i++)
+
+    foreach(const MeasureGroup &group, groups)
     {
-        FmBank::Instrument &ins1 = bank.Ins_Percussion_box[i];
-        FmBank::Instrument &ins2 = bankBackup.Ins_Percussion_box[i];
-        ins2.ms_sound_kon  = ins1.ms_sound_kon;
-        ins2.ms_sound_koff = ins1.ms_sound_koff;
-        ins2.is_blank = ins1.is_blank;
+        group.fanOut();
+        StoreCachedDurations(m_cache, group.key, *group.members.front());
     }
+    syncDurations(bank, bankBackup);
+    m_cache.save();
 
-    return !watcher.isCanceled();
+    return true;
 
 #else
-    m_progressBox.setMaximum(tasks.size());
+    m_progressBox.setMaximum(measured.size());
     m_progressBox.setValue(0);
     int count = 0;
-    foreach(FmBank::Instrument *ins, tasks)
+    foreach(const MeasureGroup &group, groups)
     {
-        MeasureDurationsDefault(ins);
+        MeasureDurationsDefault(group.members.front());
+        group.fanOut();
+        StoreCachedDurations(m_cache, group.key, *group.members.front());
         m_progressBox.setValue(++count);
         if(m_progressBox.wasCanceled())
+        {
+            m_cache.save();
             return false;
+        }
     }
+    syncDurations(bank, bankBackup);
+    m_cache.save();
     return true;
 #endif
 }
 
 bool Measurer::doMeasurement(FmBank::Instrument &instrument)
 {
+    loadCache();
+    const uint64_t key = MeasureCacheKey(instrument);
+    if(LookupCachedDurations(m_cache, key, instrument))
+    {
+        m_cache.save();
+        return true;
+    }
+
     QProgressDialog m_progressBox(m_parentWindow);
     m_progressBox.setWindowModality(Qt::WindowModal);
     m_progressBox.setWindowTitle(tr("Sounding delay calculation"));
@@ -817,13 +1721,30 @@ bool Measurer::doMeasurement(FmBank::Instrument &instrument)
     m_progressBox.exec();
     watcher.waitForFinished();
 
-    return !watcher.isCanceled();
+    if(watcher.isCanceled())
+        return false;
 
 #else
     m_progressBox.show();
     MeasureDurationsDefault(&instrument);
-    return true;
 #endif
+
+    StoreCachedDurations(m_cache, key, instrument);
+    m_cache.save();
+    return true;
+}
+
+void Measurer::measureDurations(FmBank::Instrument &instrument, bool fast)
+{
+    if(fast)
+        MeasureDurationsFast(&instrument);
+    else
+        MeasureDurationsDefault(&instrument);
+}
+
+quint64 Measurer::soundKey(const FmBank::Instrument &instrument, bool fast)
+{
+    return MeasureCacheKey(instrument, fast);
 }
 
 bool Measurer::doComputation(const FmBank::Instrument &instrument, DurationInfo &result)
@@ -853,6 +1774,22 @@ bool Measurer::doComputation(const FmBank::Instrument &instrument, DurationInfo
 #endif
 }
 
+bool Measurer::estimateDurations(const FmBank::Instrument &instrument, DurationInfo &result)
+{
+    return EstimateDurations(instrument, result);
+}
+
+bool Measurer::simulateDurations(const FmBank::Instrument &instrument, DurationInfo &result)
+{
+    MeasureContext &context = MeasureContext::local();
+    return SimulateDurations(instrument, result, &context.chip);
+}
+
+void Measurer::computeDurations(const FmBank::Instrument &instrument, DurationInfo &result)
+{
+    ComputeDurationsDefault(&instrument, &result);
+}
+
 bool Measurer::runBenchmark(FmBank::Instrument &instrument, QVector<BenchmarkResult> &result)
 {
     QProgressDialog m_progressBox(m_parentWindow);
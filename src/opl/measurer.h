@@ -24,12 +24,18 @@
 #include <QVector>
 #include <vector>
 #include "../bank.h"
+#include "measurer_cache.h"
 
 class Measurer : public QObject
 {
     Q_OBJECT
 
     QWidget *m_parentWindow;
+    //! Durations measured before, loaded on the first measurement
+    MeasurementCache m_cache;
+    bool m_cacheLoaded = false;
+
+    void loadCache();
 
 public:
     explicit Measurer(QWidget *parent = nullptr);
@@ -38,6 +44,14 @@ public:
     bool doMeasurement(FmBank &bank, FmBank &bankBackup, bool forceReset = false);
     bool doMeasurement(FmBank::Instrument &instrument);
 
+    /**
+     * @brief Measure the durations of the instrument in the calling thread, without the GUI
+     * @param fast Estimate the durations where it's unambiguous, less accurate than the emulation
+     */
+    static void measureDurations(FmBank::Instrument &instrument, bool fast = false);
+    //! Key of the measured sound, equal for the instruments which sound the same
+    static quint64 soundKey(const FmBank::Instrument &instrument, bool fast = false);
+
     struct DurationInfo
     {
         uint64_t    peak_amplitude_time;
@@ -57,6 +71,19 @@ public:
     };
     bool doComputation(const FmBank::Instrument &instrument, DurationInfo &result);
 
+    /**
+     * @brief Estimate the durations from the envelopes, without the emulation
+     * @return false if the estimate is ambiguous, and the sound is to be emulated
+     */
+    static bool estimateDurations(const FmBank::Instrument &instrument, DurationInfo &result);
+    /**
+     * @brief Measure the durations from the envelope generators alone
+     * @return false if the loudness is ambiguous, and the sound is to be emulated
+     */
+    static bool simulateDurations(const FmBank::Instrument &instrument, DurationInfo &result);
+    //! Emulate the durations in the calling thread
+    static void computeDurations(const FmBank::Instrument &instrument, DurationInfo &result);
+
     struct BenchmarkResult {
         QString name;
         qint64  elapsed;
@@ -0,0 +1,206 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "measurer_cache.h"
+#include "../common.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#ifndef IS_QT_4
+#include <QSaveFile>
+#include <QStandardPaths>
+#else
+#include <QDesktopServices>
+#endif
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+static const char cache_magic[8] = {'W', 'O', 'P', 'N', '-', 'M', 'C', '\0'};
+static const uint16_t cache_version = 1;
+static const size_t cache_header_size = 8 + 2 + 4;
+//! Key, durations on and off, last use, flags, reserved
+static const size_t cache_record_size = 8 + 2 + 2 + 4 + 1 + 1;
+
+enum CacheFlags
+{
+    CACHE_NOSOUND = 0x01
+};
+
+MeasurementCache::MeasurementCache(const QString &path)
+    : m_path(path)
+{}
+
+MeasurementCache::~MeasurementCache()
+{}
+
+QString MeasurementCache::defaultPath()
+{
+#ifndef IS_QT_4
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+#else
+    QString dir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+    return dir + "/opn2_bank_editor/measurements.cache";
+}
+
+bool MeasurementCache::load()
+{
+    m_entries.clear();
+    m_session = 1;
+
+    QFile file(m_path);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray data = file.readAll();
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.constData());
+    size_t size = static_cast<size_t>(data.size());
+
+    if(size < cache_header_size ||
+       memcmp(bytes, cache_magic, 8) != 0 ||
+       toUint16LE(bytes + 8) != cache_version)
+        return false;
+
+    uint32_t count = toUint32LE(bytes + 10);
+    if(size < cache_header_size + count * cache_record_size)
+        return false;
+
+    m_entries.reserve(static_cast<int>(count));
+    const uint8_t *rec = bytes + cache_header_size;
+    for(uint32_t i = 0; i < count; ++i, rec += cache_record_size)
+    {
+        quint64 key = toUint32LE(rec) | (quint64(toUint32LE(rec + 4)) << 32);
+        Record record;
+        record.entry.ms_sound_kon = toUint16LE(rec + 8);
+        record.entry.ms_sound_koff = toUint16LE(rec + 10);
+        record.lastUse = toUint32LE(rec + 12);
+        record.entry.nosound = (rec[16] & CACHE_NOSOUND) != 0;
+        m_entries.insert(key, record);
+        if(record.lastUse >= m_session)
+            m_session = record.lastUse + 1;
+    }
+
+    m_modified = false;
+    return true;
+}
+
+bool MeasurementCache::save()
+{
+    if(!m_modified)
+        return true;
+
+    evict();
+
+    QByteArray data(static_cast<int>(cache_header_size + m_entries.size() * cache_record_size), '\0');
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(data.data());
+    memcpy(bytes, cache_magic, 8);
+    fromUint16LE(cache_version, bytes + 8);
+    fromUint32LE(static_cast<uint32_t>(m_entries.size()), bytes + 10);
+
+    uint8_t *rec = bytes + cache_header_size;
+    for(QHash<quint64, Record>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+    {
+        const Record &record = it.value();
+        fromUint32LE(static_cast<uint32_t>(it.key()), rec);
+        fromUint32LE(static_cast<uint32_t>(it.key() >> 32), rec + 4);
+        fromUint16LE(record.entry.ms_sound_kon, rec + 8);
+        fromUint16LE(record.entry.ms_sound_koff, rec + 10);
+        fromUint32LE(record.lastUse, rec + 12);
+        rec[16] = record.entry.nosound ? CACHE_NOSOUND : 0;
+        rec += cache_record_size;
+    }
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    // written aside and renamed, so a concurrent reader sees a whole file
+#ifndef IS_QT_4
+    QSaveFile file(m_path);
+#else
+    QFile file(m_path);
+#endif
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    if(file.write(data) != data.size())
+        return false;
+#ifndef IS_QT_4
+    if(!file.commit())
+        return false;
+#endif
+
+    m_modified = false;
+    return true;
+}
+
+bool MeasurementCache::lookup(uint64_t key, Entry &entry)
+{
+    QHash<quint64, Record>::iterator it = m_entries.find(key);
+    if(it == m_entries.end())
+        return false;
+    entry = it->entry;
+    if(it->lastUse != m_session)
+    {
+        it->lastUse = m_session;
+        m_modified = true;
+    }
+    return true;
+}
+
+void MeasurementCache::insert(uint64_t key, const Entry &entry)
+{
+    Record record;
+    record.entry = entry;
+    record.lastUse = m_session;
+    m_entries.insert(key, record);
+    m_modified = true;
+}
+
+void MeasurementCache::evict()
+{
+    if(m_entries.size() <= capacity)
+        return;
+
+    std::vector<uint32_t> uses;
+    uses.reserve(static_cast<size_t>(m_entries.size()));
+    for(QHash<quint64, Record>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+        uses.push_back(it->lastUse);
+
+    // the entries used at the threshold are kept only as many as fit
+    size_t excess = uses.size() - capacity;
+    std::nth_element(uses.begin(), uses.begin() + excess, uses.end());
+    const uint32_t threshold = uses[excess];
+    size_t olderCount = 0;
+    for(uint32_t use : uses)
+    {
+        if(use < threshold)
+            ++olderCount;
+    }
+    size_t dropAtThreshold = excess - olderCount;
+
+    for(QHash<quint64, Record>::iterator it = m_entries.begin(); it != m_entries.end();)
+    {
+        if(it->lastUse < threshold)
+            it = m_entries.erase(it);
+        else if(it->lastUse == threshold && dropAtThreshold > 0)
+        {
+            it = m_entries.erase(it);
+            --dropAtThreshold;
+        }
+        else
+            ++it;
+    }
+}
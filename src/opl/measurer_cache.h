@@ -0,0 +1,116 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEASURER_CACHE_H
+#define MEASURER_CACHE_H
+
+#include <QString>
+#include <QHash>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Persistent cache of the measured sounding durations
+ *
+ * The entries are addressed by a hash of everything the measurement
+ * depends on, so the durations of a known instrument are taken without
+ * running the emulator. The cache is kept in a compact binary file, the
+ * least recently used entries are dropped when it's over the capacity.
+ */
+class MeasurementCache
+{
+public:
+    struct Entry
+    {
+        uint16_t ms_sound_kon = 0;
+        uint16_t ms_sound_koff = 0;
+        bool nosound = false;
+    };
+
+    //! Count of entries kept in the file
+    enum { capacity = 65536 };
+
+    /**
+     * @brief Builds the key, a 64-bit FNV-1a hash of the given data
+     */
+    class Key
+    {
+        uint64_t m_hash = 14695981039346656037ULL;
+    public:
+        void addByte(uint8_t byte)
+        {
+            m_hash ^= byte;
+            m_hash *= 1099511628211ULL;
+        }
+        void addBytes(const uint8_t *bytes, size_t size)
+        {
+            for(size_t i = 0; i < size; ++i)
+                addByte(bytes[i]);
+        }
+        void addUint32(uint32_t value)
+        {
+            for(unsigned i = 0; i < 4; ++i)
+                addByte(uint8_t(value >> (8 * i)));
+        }
+        void addString(const char *text)
+        {
+            for(; *text; ++text)
+                addByte(uint8_t(*text));
+            addByte(0);
+        }
+        uint64_t value() const
+            { return m_hash; }
+    };
+
+    explicit MeasurementCache(const QString &path = defaultPath());
+    ~MeasurementCache();
+
+    //! File in the user cache directory, shared by the editor and the tools
+    static QString defaultPath();
+
+    //! Read the file, a missing or damaged file leaves the cache empty
+    bool load();
+    //! Write the file, if anything was changed or used
+    bool save();
+
+    //! Find the entry, it becomes the most recently used one
+    bool lookup(uint64_t key, Entry &entry);
+    void insert(uint64_t key, const Entry &entry);
+
+    int size() const
+        { return m_entries.size(); }
+
+private:
+    struct Record
+    {
+        Entry entry;
+        //! Session of the last use, the greater the more recent
+        uint32_t lastUse = 0;
+    };
+
+    //! Drop the least recently used entries over the capacity
+    void evict();
+
+    QString m_path;
+    QHash<quint64, Record> m_entries;
+    //! Stamp of this session, next to the most recent one in the file
+    uint32_t m_session = 1;
+    bool m_modified = false;
+};
+
+#endif // MEASURER_CACHE_H
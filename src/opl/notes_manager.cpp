@@ -0,0 +1,373 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "notes_manager.h"
+#include <cmath>
+
+const double NotesManager::silenceLevel = 96.0;
+
+//! Sample clock value of the tails which never become silent
+static const uint64_t s_neverSilent = ~uint64_t(0);
+
+NotesManager::NotesManager()
+{}
+
+NotesManager::~NotesManager()
+{}
+
+void NotesManager::listPushBack(List &list, int ch, Link prev, Link next)
+{
+    Channel &c = channels[ch];
+    c.*prev = list.tail;
+    c.*next = -1;
+    if(list.tail >= 0)
+        channels[list.tail].*next = ch;
+    else
+        list.head = ch;
+    list.tail = ch;
+    ++list.count;
+}
+
+void NotesManager::listPushFront(List &list, int ch, Link prev, Link next)
+{
+    Channel &c = channels[ch];
+    c.*prev = -1;
+    c.*next = list.head;
+    if(list.head >= 0)
+        channels[list.head].*prev = ch;
+    else
+        list.tail = ch;
+    list.head = ch;
+    ++list.count;
+}
+
+void NotesManager::listRemove(List &list, int ch, Link prev, Link next)
+{
+    Channel &c = channels[ch];
+    if(c.*prev >= 0)
+        channels[c.*prev].*next = c.*next;
+    else
+        list.head = c.*next;
+    if(c.*next >= 0)
+        channels[c.*next].*prev = c.*prev;
+    else
+        list.tail = c.*prev;
+    c.*prev = -1;
+    c.*next = -1;
+    --list.count;
+}
+
+void NotesManager::listInsertAfter(List &list, int ch, int after, Link prev, Link next)
+{
+    if(after < 0)
+    {
+        listPushFront(list, ch, prev, next);
+        return;
+    }
+    if(after == list.tail)
+    {
+        listPushBack(list, ch, prev, next);
+        return;
+    }
+    Channel &c = channels[ch];
+    c.*prev = after;
+    c.*next = channels[after].*next;
+    channels[c.*next].*prev = ch;
+    channels[after].*next = ch;
+    ++list.count;
+}
+
+void NotesManager::setState(int ch, State state)
+{
+    leaveState(ch);
+    Channel &c = channels[ch];
+    c.state = state;
+    switch(state)
+    {
+    case STATE_IDLE:
+        // the most recently freed channel is taken first
+        listPushFront(stateList[STATE_IDLE], ch, &Channel::statePrev, &Channel::stateNext);
+        listPushFront(patchList[patchBucket(c.n.patchId)], ch, &Channel::keyPrev, &Channel::keyNext);
+        break;
+    case STATE_RELEASED:
+        insertReleased(ch);
+        break;
+    default:
+        listPushBack(stateList[state], ch, &Channel::statePrev, &Channel::stateNext);
+        break;
+    }
+}
+
+void NotesManager::leaveState(int ch)
+{
+    Channel &c = channels[ch];
+    switch(c.state)
+    {
+    case STATE_IDLE:
+        listRemove(stateList[STATE_IDLE], ch, &Channel::statePrev, &Channel::stateNext);
+        listRemove(patchList[patchBucket(c.n.patchId)], ch, &Channel::keyPrev, &Channel::keyNext);
+        break;
+    case STATE_RELEASED:
+        listRemove(releaseList[c.releaseClass], ch, &Channel::statePrev, &Channel::stateNext);
+        --stateList[STATE_RELEASED].count;
+        c.releaseClass = -1;
+        break;
+    default:
+        listRemove(stateList[c.state], ch, &Channel::statePrev, &Channel::stateNext);
+        break;
+    }
+}
+
+int NotesManager::releaseClass(double speed)
+{
+    int vacant = -1;
+    for(int i = 0; i < RELEASE_CLASSES; ++i)
+    {
+        if(releaseList[i].count == 0)
+        {
+            if(vacant < 0)
+                vacant = i;
+        }
+        else if(releaseClassSpeed[i] == speed)
+            return i;
+    }
+    // more speeds than lists, the list is still kept in order of silence
+    if(vacant < 0)
+        return 0;
+    releaseClassSpeed[vacant] = speed;
+    return vacant;
+}
+
+void NotesManager::insertReleased(int ch)
+{
+    Channel &c = channels[ch];
+    const Note &n = c.n;
+    double length = (n.releaseSpeed > 0.0) ? std::ceil(silenceLevel / n.releaseSpeed) : -1.0;
+    c.silentAt = (length >= 0.0 && length < 1e18) ? n.releasedAt + static_cast<uint64_t>(length) : s_neverSilent;
+
+    c.releaseClass = releaseClass(n.releaseSpeed);
+    List &list = releaseList[c.releaseClass];
+    // the tails of one speed become silent in order of release, it goes last
+    int after = list.tail;
+    while(after >= 0 && channels[after].silentAt > c.silentAt)
+        after = channels[after].statePrev;
+    listInsertAfter(list, ch, after, &Channel::statePrev, &Channel::stateNext);
+    ++stateList[STATE_RELEASED].count;
+}
+
+int NotesManager::quietestReleased(uint64_t patchKey) const
+{
+    int best = -1;
+    for(const List &list : releaseList)
+    {
+        int ch = list.head;
+        if(ch < 0)
+            continue;
+        const Channel &c = channels[ch];
+        bool better = (best < 0) || (c.silentAt < channels[best].silentAt) ||
+                      (c.silentAt == channels[best].silentAt &&
+                       c.n.patchId == patchKey && channels[best].n.patchId != patchKey);
+        if(better)
+            best = ch;
+    }
+    return best;
+}
+
+void NotesManager::unlinkKey(int ch)
+{
+    const Note &n = channels[ch].n;
+    if(n.held)
+        listRemove(heldList, ch, &Channel::keyPrev, &Channel::keyNext);
+    else if(n.note >= 0)
+        listRemove(keyList[keyBucket(n.note)], ch, &Channel::keyPrev, &Channel::keyNext);
+}
+
+void NotesManager::allocateChannels(int count)
+{
+    channels.clear();
+    channels.resize(static_cast<std::vector<Channel>::size_type>(count));
+    clearNotes();
+}
+
+double NotesManager::releaseLevel(int ch) const
+{
+    const Note &n = channels[ch].n;
+    return static_cast<double>(clock - n.releasedAt) * n.releaseSpeed;
+}
+
+void NotesManager::expireReleased()
+{
+    if(stateList[STATE_RELEASED].count == 0)
+        return;
+    for(List &list : releaseList)
+    {
+        int ch;
+        while((ch = list.head) >= 0 && channels[ch].silentAt <= clock)
+        {
+            channels[ch].n.releasing = false;
+            setState(ch, STATE_IDLE);
+        }
+    }
+}
+
+int NotesManager::noteOn(int note, uint8_t part,
+                         const OPN_PatchSetup *patch, uint64_t patchKey,
+                         uint32_t volume, uint8_t ccvolume, uint8_t ccexpr,
+                         bool *r)
+{
+    expireReleased();
+
+    bool replace = false;
+    int chan = -1;
+    for(int c = patchList[patchBucket(patchKey)].head; c >= 0; c = channels[c].keyNext)
+    {
+        if(channels[c].n.patchId == patchKey)
+        {
+            chan = c;
+            break;
+        }
+    }
+    if(chan < 0)
+        chan = stateList[STATE_IDLE].head;
+    if(chan < 0)
+        chan = quietestReleased(patchKey);
+    if(chan < 0)
+    {
+        chan = stateList[STATE_PLAYING].head;
+        replace = true;
+        unlinkKey(chan);
+    }
+
+    setState(chan, STATE_PLAYING);
+
+    Note &ch = channels[chan].n;
+    ch.note = note;
+    ch.volume = volume;
+    ch.ccvolume = ccvolume;
+    ch.ccexpr = ccexpr;
+    ch.held = false;
+    ch.releasing = false;
+    ch.serial = ++serial;
+    ch.part = part;
+    ch.patch = patch;
+    ch.patchKey = patchKey;
+
+    if(note >= 0)
+        listPushBack(keyList[keyBucket(note)], chan, &Channel::keyPrev, &Channel::keyNext);
+
+    if(r)
+        *r = replace;
+
+    return chan;
+}
+
+int NotesManager::noteOff(int note, uint8_t part, double releaseSpeed)
+{
+    int chan = findNoteOffChannel(note, part);
+    if(chan != -1)
+        channelOff(chan, releaseSpeed);
+    return chan;
+}
+
+void NotesManager::channelOff(int ch, double releaseSpeed)
+{
+    if(channels[ch].state == STATE_PLAYING)
+        unlinkKey(ch);
+
+    Note &n = channels[ch].n;
+    n.note = -1;
+    n.held = false;
+    n.patch = nullptr;
+    n.releasing = true;
+    n.releasedAt = clock;
+    n.releaseSpeed = releaseSpeed;
+    setState(ch, STATE_RELEASED);
+}
+
+int NotesManager::findNoteOffChannel(int note, uint8_t part) const
+{
+    if(note < 0)
+        return -1;
+    // find the oldest active note not in held state (delayed noteoff)
+    for(int chan = keyList[keyBucket(note)].head; chan >= 0; chan = channels[chan].keyNext)
+    {
+        const Note &n = channels[chan].n;
+        if(n.note == note && n.part == part)
+            return chan;
+    }
+    return -1;
+}
+
+void NotesManager::hold(int ch, bool h)
+{
+    Channel &c = channels[ch];
+    if(c.n.held == h)
+        return;
+
+    if(c.state == STATE_PLAYING)
+    {
+        unlinkKey(ch);
+        c.n.held = h;
+        if(h)
+            listPushBack(heldList, ch, &Channel::keyPrev, &Channel::keyNext);
+        else if(c.n.note >= 0)
+            listPushBack(keyList[keyBucket(c.n.note)], ch, &Channel::keyPrev, &Channel::keyNext);
+    }
+    else
+        c.n.held = h;
+}
+
+void NotesManager::setPatch(int ch, uint64_t patchId)
+{
+    Channel &c = channels[ch];
+    if(c.state != STATE_IDLE)
+    {
+        c.n.patchId = patchId;
+        return;
+    }
+    listRemove(patchList[patchBucket(c.n.patchId)], ch, &Channel::keyPrev, &Channel::keyNext);
+    c.n.patchId = patchId;
+    listPushFront(patchList[patchBucket(patchId)], ch, &Channel::keyPrev, &Channel::keyNext);
+}
+
+void NotesManager::clearNotes()
+{
+    for(List &l : stateList)
+        l = List();
+    for(List &l : keyList)
+        l = List();
+    for(List &l : patchList)
+        l = List();
+    for(List &l : releaseList)
+        l = List();
+    heldList = List();
+
+    int count = channelCount();
+    for(int ch = 0; ch < count; ++ch)
+    {
+        Channel &c = channels[ch];
+        c.n.note = -1;
+        c.n.held = false;
+        c.n.releasing = false;
+        c.n.patch = nullptr;
+        c.state = STATE_IDLE;
+        c.releaseClass = -1;
+        listPushBack(stateList[STATE_IDLE], ch, &Channel::statePrev, &Channel::stateNext);
+        listPushBack(patchList[patchBucket(c.n.patchId)], ch, &Channel::keyPrev, &Channel::keyNext);
+    }
+}
@@ -0,0 +1,225 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOTES_MANAGER_H
+#define NOTES_MANAGER_H
+
+#include <stdint.h>
+#include <vector>
+
+struct OPN_PatchSetup;
+
+/**
+ * @brief Voice allocator and key tracker of the generator
+ *
+ * Every channel belongs to exactly one of the idle, released or playing
+ * lists, the lists are intrusive and are linked through the channel
+ * indices. Playing channels are also linked into the list of their key
+ * or, while the sustain pedal keeps them, into the list of held channels.
+ * Idle channels are also linked into the list of their uploaded patch.
+ *
+ * Released channels are kept in one list per release speed, the tails of
+ * one speed fade out in order of their key-off, so every list is ordered
+ * by the moment its channels become silent. The speeds are the few rates
+ * of the envelope generator, so the heads of the lists are few.
+ * Every operation on a single note is therefore done in constant time.
+ */
+class NotesManager
+{
+public:
+    //! State of the channel
+    enum State
+    {
+        //! Channel is silent and is free to use
+        STATE_IDLE = 0,
+        //! Key-off was sent and the release tail is still sounding
+        STATE_RELEASED,
+        //! Channel is keyed on
+        STATE_PLAYING,
+        STATE_COUNT
+    };
+
+    struct Note
+    {
+        //! Currently pressed key. -1 means channel is not keyed on
+        int note    = -1;
+        //! Note volume determined by velocity
+        uint32_t volume = 0;
+        //! Channel volume determined by controller
+        uint8_t ccvolume = 0;
+        //! Channel expression determined by controller
+        uint8_t ccexpr = 0;
+        //! Serial number of the noteOn request which started this note
+        uint64_t serial = 0;
+        //! Whether it has a pending noteOff being delayed while held
+        bool held = false;
+        //! Whether the key-off was sent and the release tail is still sounding
+        bool releasing = false;
+        //! Sample clock value at the moment of key-off
+        uint64_t releasedAt = 0;
+        //! Estimated release speed in decibels per sample
+        double releaseSpeed = 0.0;
+        //! Part (MIDI channel) which plays this note
+        uint8_t part = 0;
+        //! Register image of the playing note
+        const OPN_PatchSetup *patch = nullptr;
+        //! Identifier of the register image of the playing note
+        uint64_t patchKey = 0;
+        //! Identifier of the patch which was uploaded into this channel, 0 is none
+        uint64_t patchId = 0;
+    };
+
+    //! Attenuation level which is considered as full silence (decibels)
+    static const double silenceLevel;
+
+    NotesManager();
+    ~NotesManager();
+
+    void allocateChannels(int count);
+    /**
+     * @brief Allocate a voice for the new note
+     *
+     * Takes the idle channel which has the requested patch uploaded, not
+     * to upload it again, otherwise the most recently freed idle channel.
+     * When nothing is idle, takes the released channel which tail is the
+     * nearest to the silence, the one with the same patch among the equal
+     * ones. Otherwise the oldest playing note is stolen.
+     */
+    int     noteOn(int note, uint8_t part,
+                   const OPN_PatchSetup *patch, uint64_t patchKey,
+                   uint32_t volume, uint8_t ccvolume, uint8_t ccexpr,
+                   bool *replace = nullptr);
+    int     noteOff(int note, uint8_t part, double releaseSpeed);
+    void    channelOff(int ch, double releaseSpeed);
+    int     findNoteOffChannel(int note, uint8_t part) const;
+    void    hold(int ch, bool h);
+    void    setPatch(int ch, uint64_t patchId);
+    void    advance(unsigned frames)
+        { clock += frames; }
+    void    clearNotes();
+
+    const Note &channel(int ch) const
+        { return channels[ch].n; }
+    int channelCount() const
+        { return static_cast<int>(channels.size()); }
+
+    //! Count of noteOn requests since the given note was started
+    uint64_t age(int ch) const
+        { return serial - channels[ch].n.serial; }
+    //! Estimated attenuation of the release tail in decibels
+    double releaseLevel(int ch) const;
+    //! Count of samples generated since the key-off of the channel
+    uint64_t releaseAge(int ch) const
+        { return clock - channels[ch].n.releasedAt; }
+    State state(int ch) const
+        { return channels[ch].state; }
+
+    //! Oldest playing channel, -1 if none
+    int firstPlaying() const
+        { return stateList[STATE_PLAYING].head; }
+    //! Next playing channel in order of age, -1 at the end
+    int nextPlaying(int ch) const
+        { return channels[ch].stateNext; }
+    //! First channel which key-off is delayed by the sustain, -1 if none
+    int firstHeld() const
+        { return heldList.head; }
+    //! Next held channel, -1 at the end
+    int nextHeld(int ch) const
+        { return channels[ch].keyNext; }
+    int playingCount() const
+        { return stateList[STATE_PLAYING].count; }
+
+private:
+    //! Head and tail of the intrusive list
+    struct List
+    {
+        int head = -1;
+        int tail = -1;
+        int count = 0;
+    };
+
+    struct Channel
+    {
+        Note    n;
+        State   state = STATE_IDLE;
+        //! Links in the list of the state, or in the release list when released
+        int     statePrev = -1;
+        int     stateNext = -1;
+        //! Links in the key list when playing, in the held list when held,
+        //! or in the patch list when idle
+        int     keyPrev = -1;
+        int     keyNext = -1;
+        //! Release list of the channel when released
+        int     releaseClass = -1;
+        //! Sample clock value when the release tail becomes silent
+        uint64_t silentAt = 0;
+    };
+
+    enum
+    {
+        //! Count of key lists, notes are hashed by their lowest bits
+        KEY_BUCKETS = 128,
+        //! Count of patch lists of the idle channels
+        PATCH_BUCKETS = 64,
+        //! Count of release lists, more than the release rates of the chip
+        RELEASE_CLASSES = 32
+    };
+
+    typedef int Channel::*Link;
+    void listPushBack(List &list, int ch, Link prev, Link next);
+    void listPushFront(List &list, int ch, Link prev, Link next);
+    void listRemove(List &list, int ch, Link prev, Link next);
+    //! Insert the channel after the other one, at the front if it's -1
+    void listInsertAfter(List &list, int ch, int after, Link prev, Link next);
+
+    void setState(int ch, State state);
+    //! Remove the channel from the lists of its state
+    void leaveState(int ch);
+    //! Insert the channel into its release list, in order of silence
+    void insertReleased(int ch);
+    //! Release list of the speed, a vacant list takes the new speed
+    int releaseClass(double speed);
+    //! Released channel the nearest to the silence, -1 if none
+    int quietestReleased(uint64_t patchKey) const;
+    //! Remove the channel from the key list or from the held list
+    void unlinkKey(int ch);
+    //! Move the released channels with faded tails into the idle list
+    void expireReleased();
+
+    static int keyBucket(int note)
+        { return note & (KEY_BUCKETS - 1); }
+    static int patchBucket(uint64_t patchId)
+        { return static_cast<int>((patchId * 0x9E3779B97F4A7C15ULL) >> 58) & (PATCH_BUCKETS - 1); }
+
+    //! Channels range, contains entries count equal to chip channels
+    std::vector<Channel> channels;
+    //! The released channels are linked in the release lists, only counted here
+    List    stateList[STATE_COUNT];
+    List    keyList[KEY_BUCKETS];
+    List    patchList[PATCH_BUCKETS];
+    List    releaseList[RELEASE_CLASSES];
+    //! Release speed of the channels of each release list
+    double  releaseClassSpeed[RELEASE_CLASSES];
+    List    heldList;
+    //! Count of generated samples, used to estimate the release tails
+    uint64_t clock = 0;
+    //! Count of noteOn requests, used to know the age of notes
+    uint64_t serial = 0;
+};
+
+#endif // NOTES_MANAGER_H
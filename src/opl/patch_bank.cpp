@@ -0,0 +1,97 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "patch_bank.h"
+#include <atomic>
+
+static std::atomic<uint32_t> s_patchBankSerial(0);
+
+OPN_PatchBank::OPN_PatchBank(const FmBank &bank)
+{
+    serial = ++s_patchBankSerial;
+    if(serial == 0)
+        serial = ++s_patchBankSerial;
+
+    const int melodicCount = bank.Ins_Melodic_box.size();
+    const int percussionCount = bank.Ins_Percussion_box.size();
+
+    images.resize(static_cast<size_t>(melodicCount + percussionCount));
+    playable.resize(images.size());
+
+    for(int i = 0; i < melodicCount; ++i)
+    {
+        const FmBank::Instrument &ins = bank.Ins_Melodic_box[i];
+        compile(ins, false, images[i]);
+        playable[i] = !ins.is_blank;
+    }
+
+    for(int i = 0; i < percussionCount; ++i)
+    {
+        const FmBank::Instrument &ins = bank.Ins_Percussion_box[i];
+        compile(ins, true, images[melodicCount + i]);
+        playable[melodicCount + i] = !ins.is_blank;
+    }
+
+    for(int i = 0; i < bank.Banks_Melodic.size() && (i * 128) < melodicCount; ++i)
+    {
+        MidiBank b = {bank.Banks_Melodic[i].msb, bank.Banks_Melodic[i].lsb, i * 128};
+        melodic.push_back(b);
+    }
+
+    for(int i = 0; i < bank.Banks_Percussion.size() && (i * 128) < percussionCount; ++i)
+    {
+        MidiBank b = {bank.Banks_Percussion[i].msb, bank.Banks_Percussion[i].lsb, melodicCount + i * 128};
+        percussion.push_back(b);
+    }
+}
+
+void OPN_PatchBank::compile(const FmBank::Instrument &instrument, bool isDrum, OPN_PatchSetup &patch)
+{
+    for(int op = 0; op < 4; op++)
+    {
+        patch.OPS[op].data[0] = instrument.getRegDUMUL(op);
+        patch.OPS[op].data[1] = instrument.getRegLevel(op);
+        patch.OPS[op].data[2] = instrument.getRegRSAt(op);
+        patch.OPS[op].data[3] = instrument.getRegAMD1(op);
+        patch.OPS[op].data[4] = instrument.getRegD2(op);
+        patch.OPS[op].data[5] = instrument.getRegSysRel(op);
+        patch.OPS[op].data[6] = instrument.getRegSsgEg(op);
+    }
+    patch.fbalg    = instrument.getRegFbAlg();
+    patch.lfosens  = instrument.getRegLfoSens();
+    patch.finetune = static_cast<int8_t>(instrument.note_offset1);
+    patch.tone     = 0;
+
+    if(isDrum || instrument.is_fixed_note)
+        patch.tone = instrument.percNoteNum;
+}
+
+int OPN_PatchBank::findBank(bool percussion, uint8_t msb, uint8_t lsb) const
+{
+    const std::vector<MidiBank> &banks = percussion ? this->percussion : melodic;
+    if(banks.empty())
+        return -1;
+
+    for(const MidiBank &b : banks)
+    {
+        if(b.msb == msb && b.lsb == lsb)
+            return b.first;
+    }
+
+    return banks.front().first;
+}
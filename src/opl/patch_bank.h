@@ -0,0 +1,81 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATCH_BANK_H
+#define PATCH_BANK_H
+
+#include "generator.h"
+#include <vector>
+
+/**
+ * @brief Register images of all instruments of the bank
+ *
+ * Built once in the control thread when the bank is loaded or changed.
+ * The audio thread only copies ready register blocks into the channels.
+ */
+struct OPN_PatchBank
+{
+    //! MIDI bank and the index of its first image
+    struct MidiBank
+    {
+        uint8_t msb;
+        uint8_t lsb;
+        int     first;
+    };
+
+    explicit OPN_PatchBank(const FmBank &bank);
+
+    /**
+     * @brief Convert the instrument into the register image
+     * @param instrument Source instrument
+     * @param isDrum Whether the instrument is percussion
+     * @param patch Destination register image
+     */
+    static void compile(const FmBank::Instrument &instrument, bool isDrum, OPN_PatchSetup &patch);
+
+    /**
+     * @brief Find the MIDI bank, falls back to the first bank when missing
+     * @param percussion Look up the percussion banks
+     * @param msb MIDI bank MSB index
+     * @param lsb MIDI bank LSB index
+     * @return Index of the first image of the bank, or -1 if none
+     */
+    int findBank(bool percussion, uint8_t msb, uint8_t lsb) const;
+
+    //! Image of the instrument, null if it's blank or out of range
+    const OPN_PatchSetup *image(int index) const
+    {
+        if(index < 0 || index >= static_cast<int>(images.size()) || !playable[index])
+            return nullptr;
+        return &images[index];
+    }
+
+    //! Key identifying the image, differs between the bank instances
+    uint64_t key(int index) const
+        { return (static_cast<uint64_t>(serial) << 32) | static_cast<uint32_t>(index + 1); }
+
+    std::vector<OPN_PatchSetup> images;
+    //! Whether the image is not blank and can be played
+    std::vector<uint8_t> playable;
+    std::vector<MidiBank> melodic;
+    std::vector<MidiBank> percussion;
+    //! Unique non-zero number of this instance
+    uint32_t serial;
+};
+
+#endif // PATCH_BANK_H
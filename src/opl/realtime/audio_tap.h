@@ -0,0 +1,100 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Wait-free copy of the latest output for displaying
+ *
+ * One writer appends the rendered stereo frames, overwriting the oldest
+ * ones, so it never waits and costs one or two memcpy per block. One reader
+ * takes the latest frames at any time. The writer announces the frames it's
+ * about to overwrite, and the reader drops those it may have copied torn.
+ */
+class Audio_Tap {
+public:
+    //! Count of stereo frames kept, a power of 2
+    enum { capacity = 8192 };
+
+    Audio_Tap() { std::memset(buf_, 0, sizeof(buf_)); }
+
+    // write operations
+    void write(const int16_t *frames, size_t nframes)
+    {
+        if(nframes > capacity)
+        {
+            frames += 2 * (nframes - capacity);
+            nframes = capacity;
+        }
+        const uint64_t wp = wp_.load(std::memory_order_relaxed);
+        wbegin_.store(wp + nframes, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        const size_t pos = (size_t)(wp & (capacity - 1));
+        const size_t first = (nframes < capacity - pos) ? nframes : (capacity - pos);
+        std::memcpy(&buf_[2 * pos], frames, 2 * first * sizeof(int16_t));
+        if(first < nframes)
+            std::memcpy(&buf_[0], frames + 2 * first, 2 * (nframes - first) * sizeof(int16_t));
+        wp_.store(wp + nframes, std::memory_order_release);
+    }
+
+    // read operations
+    /**
+     * @brief Copy the latest frames
+     * @param frames Destination of interleaved stereo frames
+     * @param nframes Count of frames wanted
+     * @return Count of frames copied, fewer if not written yet or overwritten while copying
+     */
+    size_t read_latest(int16_t *frames, size_t nframes) const
+    {
+        const uint64_t wp = wp_.load(std::memory_order_acquire);
+        if(nframes > capacity)
+            nframes = capacity;
+        if(nframes > wp)
+            nframes = (size_t)wp;
+        const uint64_t start = wp - nframes;
+        const size_t pos = (size_t)(start & (capacity - 1));
+        const size_t first = (nframes < capacity - pos) ? nframes : (capacity - pos);
+        std::memcpy(frames, &buf_[2 * pos], 2 * first * sizeof(int16_t));
+        if(first < nframes)
+            std::memcpy(frames + 2 * first, &buf_[0], 2 * (nframes - first) * sizeof(int16_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // the frames before this position may be overwritten already
+        const uint64_t wbegin = wbegin_.load(std::memory_order_relaxed);
+        const uint64_t safe = (wbegin > capacity) ? (wbegin - capacity) : 0;
+        if(safe <= start)
+            return nframes;
+        const size_t torn = (safe - start < nframes) ? (size_t)(safe - start) : nframes;
+        std::memmove(frames, frames + 2 * torn, 2 * (nframes - torn) * sizeof(int16_t));
+        return nframes - torn;
+    }
+    //! Count of frames written since the beginning
+    uint64_t position() const { return wp_.load(std::memory_order_acquire); }
+
+private:
+    Audio_Tap(const Audio_Tap &);
+    Audio_Tap &operator=(const Audio_Tap &);
+
+    int16_t buf_[2 * capacity];
+    std::atomic<uint64_t> wp_{0};
+    std::atomic<uint64_t> wbegin_{0};
+};
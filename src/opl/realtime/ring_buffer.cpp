@@ -16,7 +16,7 @@
 template <bool Atomic>
 Ring_Buffer_Ex<Atomic>::Ring_Buffer_Ex(size_t capacity)
     : cap_(capacity + 1),
-      rbdata_(new uint8_t[capacity + 1])
+      rbdata_(new uint8_t[capacity + 1]())
 {
 }
 
@@ -0,0 +1,142 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "semaphore.h"
+#include <system_error>
+#include <cerrno>
+#if defined(_WIN32)
+#   include <climits>
+#elif !defined(__APPLE__)
+#   include <ctime>
+#endif
+
+#if defined(_WIN32)
+Semaphore::Semaphore(unsigned value)
+{
+    sem_ = CreateSemaphore(nullptr, (LONG)value, LONG_MAX, nullptr);
+    if(!sem_)
+        throw std::system_error((int)GetLastError(), std::system_category());
+}
+
+Semaphore::~Semaphore()
+{
+    CloseHandle(sem_);
+}
+
+void Semaphore::post()
+{
+    ReleaseSemaphore(sem_, 1, nullptr);
+}
+
+void Semaphore::wait()
+{
+    WaitForSingleObject(sem_, INFINITE);
+}
+
+bool Semaphore::try_wait()
+{
+    return WaitForSingleObject(sem_, 0) == WAIT_OBJECT_0;
+}
+
+bool Semaphore::timed_wait(unsigned ms)
+{
+    return WaitForSingleObject(sem_, (DWORD)ms) == WAIT_OBJECT_0;
+}
+
+#elif defined(__APPLE__)
+Semaphore::Semaphore(unsigned value)
+{
+    sem_ = dispatch_semaphore_create((long)value);
+    if(!sem_)
+        throw std::system_error(ENOMEM, std::generic_category());
+}
+
+Semaphore::~Semaphore()
+{
+    dispatch_release(sem_);
+}
+
+void Semaphore::post()
+{
+    dispatch_semaphore_signal(sem_);
+}
+
+void Semaphore::wait()
+{
+    dispatch_semaphore_wait(sem_, DISPATCH_TIME_FOREVER);
+}
+
+bool Semaphore::try_wait()
+{
+    return dispatch_semaphore_wait(sem_, DISPATCH_TIME_NOW) == 0;
+}
+
+bool Semaphore::timed_wait(unsigned ms)
+{
+    dispatch_time_t timeout = dispatch_time(DISPATCH_TIME_NOW, (int64_t)ms * 1000000);
+    return dispatch_semaphore_wait(sem_, timeout) == 0;
+}
+
+#else
+Semaphore::Semaphore(unsigned value)
+{
+    if(sem_init(&sem_, 0, value) != 0)
+        throw std::system_error(errno, std::generic_category());
+}
+
+Semaphore::~Semaphore()
+{
+    sem_destroy(&sem_);
+}
+
+void Semaphore::post()
+{
+    sem_post(&sem_);
+}
+
+void Semaphore::wait()
+{
+    while(sem_wait(&sem_) != 0 && errno == EINTR)
+        continue;
+}
+
+bool Semaphore::try_wait()
+{
+    int ret;
+    while((ret = sem_trywait(&sem_)) != 0 && errno == EINTR)
+        continue;
+    return ret == 0;
+}
+
+bool Semaphore::timed_wait(unsigned ms)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if(ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+    int ret;
+    while((ret = sem_timedwait(&sem_, &ts)) != 0 && errno == EINTR)
+        continue;
+    return ret == 0;
+}
+#endif
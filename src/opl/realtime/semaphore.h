@@ -0,0 +1,56 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#if defined(_WIN32)
+#   include <windows.h>
+#elif defined(__APPLE__)
+#   include <dispatch/dispatch.h>
+#else
+#   include <semaphore.h>
+#endif
+
+/**
+ * @brief Counting semaphore of the operating system
+ *
+ * The post operation never blocks, so it may be used by the audio thread
+ * to wake up the control thread.
+ */
+class Semaphore {
+public:
+    explicit Semaphore(unsigned value = 0);
+    ~Semaphore();
+
+    void post();
+    void wait();
+    bool try_wait();
+    //! Wait at most the given count of milliseconds, false on timeout
+    bool timed_wait(unsigned ms);
+
+private:
+    Semaphore(const Semaphore &);
+    Semaphore &operator=(const Semaphore &);
+
+#if defined(_WIN32)
+    HANDLE sem_;
+#elif defined(__APPLE__)
+    dispatch_semaphore_t sem_;
+#else
+    sem_t sem_;
+#endif
+};
@@ -0,0 +1,62 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <atomic>
+
+/**
+ * @brief Lock-free exchange of a value between one writer and one reader
+ *
+ * The writer fills its private buffer and publishes it by swapping it
+ * with the middle one. The reader swaps its own buffer with the middle one
+ * when something new was published. Neither side ever waits, the reader
+ * always sees the complete value which was published last.
+ */
+template <class T>
+class Triple_Buffer {
+public:
+    Triple_Buffer() {}
+
+    // write operations
+    T &write_buffer() { return buf_[wi_]; }
+    void publish()
+    {
+        unsigned old = mid_.exchange(wi_ | dirty_bit, std::memory_order_acq_rel);
+        wi_ = old & index_mask;
+    }
+
+    // read operations
+    bool update()
+    {
+        if(!(mid_.load(std::memory_order_relaxed) & dirty_bit))
+            return false;
+        unsigned old = mid_.exchange(ri_, std::memory_order_acq_rel);
+        ri_ = old & index_mask;
+        return true;
+    }
+    const T &read_buffer() const { return buf_[ri_]; }
+
+private:
+    Triple_Buffer(const Triple_Buffer &);
+    Triple_Buffer &operator=(const Triple_Buffer &);
+
+    enum { index_mask = 3, dirty_bit = 4 };
+    T buf_[3];
+    unsigned wi_ = 0, ri_ = 1;
+    std::atomic<unsigned> mid_{2};
+};
@@ -0,0 +1,191 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the durations estimated from the envelope model, and the ones
+ * measured from the emulated envelopes alone, against the fully emulated
+ * ones over the instruments of the banks. Reports the agreement and the
+ * time spent by each way. Until every taken sound is close, the fast ways
+ * are used only by the measurer tool with --fast.
+ */
+
+#include <FileFormats/ffmt_factory.h>
+#include <opl/measurer.h>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//! Durations differing by less than this are the same, in milliseconds
+static const int64_t g_closeMs = 14;
+//! Relative difference of the durations which are still close
+static const double g_closeRatio = 0.05;
+
+static bool isClose(int64_t a, int64_t b)
+{
+    int64_t diff = std::llabs(a - b);
+    return (diff <= g_closeMs) || (diff <= g_closeRatio * std::max(a, b));
+}
+
+//! Agreement of a fast way with the emulation
+struct PathReport
+{
+    unsigned taken = 0;
+    unsigned exactKon = 0;
+    unsigned exactKoff = 0;
+    unsigned close = 0;
+    unsigned nosoundMismatch = 0;
+    double time = 0;
+
+    void print(const char *name) const
+    {
+        std::printf("%s:\n", name);
+        std::printf("  Taken:               %u\n", taken);
+        std::printf("  Same key-on:         %u\n", exactKon);
+        std::printf("  Same key-off:        %u\n", exactKoff);
+        std::printf("  Close on both:       %u\n", close);
+        std::printf("  Silence mismatches:  %u\n", nosoundMismatch);
+        std::printf("  Time:                %.3f s\n", time);
+    }
+};
+
+struct Report
+{
+    unsigned total = 0;
+    PathReport estimate;
+    PathReport envelopes;
+    double emulateTime = 0;
+};
+
+typedef bool (*FastDurations)(const FmBank::Instrument &, Measurer::DurationInfo &);
+
+static void comparePath(FastDurations fast, const FmBank::Instrument &ins,
+                        const Measurer::DurationInfo &emulated, PathReport &report,
+                        bool verbose, const QString &where)
+{
+    typedef std::chrono::steady_clock clock;
+    Measurer::DurationInfo result;
+
+    clock::time_point start = clock::now();
+    bool taken = fast(ins, result);
+    clock::time_point stop = clock::now();
+    report.time += std::chrono::duration<double>(stop - start).count();
+
+    if(!taken)
+        return;
+
+    ++report.taken;
+    report.exactKon += (result.ms_sound_kon == emulated.ms_sound_kon);
+    report.exactKoff += (result.ms_sound_koff == emulated.ms_sound_koff);
+    report.nosoundMismatch += (result.nosound != emulated.nosound);
+
+    bool close = isClose(result.ms_sound_kon, emulated.ms_sound_kon) &&
+                 isClose(result.ms_sound_koff, emulated.ms_sound_koff) &&
+                 (result.nosound == emulated.nosound);
+    report.close += close;
+
+    if(verbose && !close)
+    {
+        std::printf("%s: %lld/%lld, emulated %lld/%lld\n",
+                    where.toLocal8Bit().constData(),
+                    (long long)result.ms_sound_kon, (long long)result.ms_sound_koff,
+                    (long long)emulated.ms_sound_kon, (long long)emulated.ms_sound_koff);
+    }
+}
+
+static void compareInstrument(const FmBank::Instrument &ins, Report &report, bool verbose, const QString &where)
+{
+    typedef std::chrono::steady_clock clock;
+    Measurer::DurationInfo emulated;
+
+    clock::time_point start = clock::now();
+    Measurer::computeDurations(ins, emulated);
+    clock::time_point stop = clock::now();
+    report.emulateTime += std::chrono::duration<double>(stop - start).count();
+    ++report.total;
+
+    comparePath(&Measurer::estimateDurations, ins, emulated, report.estimate,
+                verbose, where + " (estimate)");
+    comparePath(&Measurer::simulateDurations, ins, emulated, report.envelopes,
+                verbose, where + " (envelopes)");
+}
+
+static void compareBank(const QString &path, Report &report, bool verbose)
+{
+    FmBank bank;
+    if(FmBankFormatFactory::OpenBankFile(path, bank) != FfmtErrCode::ERR_OK)
+        return;
+
+    const QVector<FmBank::Instrument> *boxes[2] = {&bank.Ins_Melodic_box, &bank.Ins_Percussion_box};
+    for(unsigned b = 0; b < 2; ++b)
+    {
+        const QVector<FmBank::Instrument> &box = *boxes[b];
+        for(int i = 0; i < box.size(); ++i)
+        {
+            QString where = QString("%1 %2 %3").arg(path).arg(b ? "drum" : "melodic").arg(i);
+            compareInstrument(box[i], report, verbose, where);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList inputs;
+    bool verbose = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "-v"))
+            verbose = true;
+        else
+            inputs.push_back(QString::fromLocal8Bit(argv[i]));
+    }
+
+    if(inputs.isEmpty())
+    {
+        std::fprintf(stderr, "%s [-v] <bank-file-or-directory>...\n", argv[0]);
+        return 1;
+    }
+
+    FmBankFormatFactory::registerAllFormats();
+
+    Report report;
+    for(const QString &input : inputs)
+    {
+        if(!QFileInfo(input).isDir())
+        {
+            compareBank(input, report, verbose);
+            continue;
+        }
+        QDirIterator it(input, QDir::Files, QDirIterator::Subdirectories);
+        while(it.hasNext())
+            compareBank(it.next(), report, verbose);
+    }
+
+    std::printf("Instruments:         %u\n", report.total);
+    std::printf("Emulation time:      %.3f s\n", report.emulateTime);
+    report.estimate.print("Envelope model");
+    report.envelopes.print("Emulated envelopes");
+
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Floods the realtime generator with synthetic MIDI streams at increasing
+ * rates, while a headless output pulls the blocks in time like a sound card.
+ * Reports the highest rate sustained without lost messages and late blocks.
+ */
+
+#include <opl/generator_realtime.h>
+#include <audio/ao_headless.h>
+#include <QCoreApplication>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+struct Message
+{
+    uint8_t data[3];
+    unsigned size;
+};
+
+static Message makeMessage(uint8_t status, uint8_t data1, uint8_t data2)
+{
+    Message m = {{status, data1, data2}, 3};
+    return m;
+}
+
+//! Dense chords of 8 notes, each released when the next one is struck
+static std::vector<Message> makeChords()
+{
+    static const int intervals[8] = {0, 4, 7, 11, 14, 17, 21, 24};
+    std::vector<Message> stream;
+    for(int k = 0; k < 256; ++k)
+    {
+        uint8_t chan = k % 16;
+        int root = 36 + (k * 7) % 48;
+        int prevRoot = 36 + ((k + 255) * 7) % 48;
+        uint8_t prevChan = (k + 15) % 16;
+        for(int i = 0; i < 8; ++i)
+            stream.push_back(makeMessage(0x80 | prevChan, uint8_t(prevRoot + intervals[i]), 0));
+        for(int i = 0; i < 8; ++i)
+            stream.push_back(makeMessage(0x90 | chan, uint8_t(root + intervals[i]), 100));
+    }
+    return stream;
+}
+
+//! Held notes with the modulation, volume, pan, expression and cutoff swept
+static std::vector<Message> makeControlSweeps()
+{
+    static const uint8_t controllers[5] = {1, 7, 10, 11, 74};
+    std::vector<Message> stream;
+    for(uint8_t chan = 0; chan < 16; ++chan)
+        stream.push_back(makeMessage(0x90 | chan, uint8_t(48 + chan), 100));
+    for(int value = 0; value < 256; ++value)
+    {
+        uint8_t v = uint8_t(value < 128 ? value : 255 - value);
+        for(uint8_t cc : controllers)
+            for(uint8_t chan = 0; chan < 16; ++chan)
+                stream.push_back(makeMessage(0xB0 | chan, cc, v));
+    }
+    for(uint8_t chan = 0; chan < 16; ++chan)
+        stream.push_back(makeMessage(0x80 | chan, uint8_t(48 + chan), 0));
+    return stream;
+}
+
+//! Held notes bent up and down over the whole range
+static std::vector<Message> makePitchBends()
+{
+    std::vector<Message> stream;
+    for(uint8_t chan = 0; chan < 16; ++chan)
+        stream.push_back(makeMessage(0x90 | chan, uint8_t(60 + chan), 100));
+    for(int step = 0; step < 512; ++step)
+    {
+        int bend = (step < 256 ? step : 511 - step) * 64;
+        for(uint8_t chan = 0; chan < 16; ++chan)
+            stream.push_back(makeMessage(0xE0 | chan, uint8_t(bend & 0x7F), uint8_t(bend >> 7)));
+    }
+    for(uint8_t chan = 0; chan < 16; ++chan)
+        stream.push_back(makeMessage(0x80 | chan, uint8_t(60 + chan), 0));
+    return stream;
+}
+
+//! Few notes, then all notes off, over and over
+static std::vector<Message> makeAllNotesOff()
+{
+    std::vector<Message> stream;
+    for(int k = 0; k < 256; ++k)
+    {
+        uint8_t chan = k % 16;
+        for(int i = 0; i < 3; ++i)
+            stream.push_back(makeMessage(0x90 | chan, uint8_t(40 + (k + i * 5) % 48), 100));
+        stream.push_back(makeMessage(0xB0 | chan, 123, 0));
+    }
+    return stream;
+}
+
+struct Scenario
+{
+    const char *name;
+    std::vector<Message> (*make)();
+};
+
+static const Scenario scenarios[] =
+{
+    {"chords", &makeChords},
+    {"cc-sweep", &makeControlSweeps},
+    {"pitch-bend", &makePitchBends},
+    {"all-notes-off", &makeAllNotesOff},
+};
+
+struct Settings
+{
+    double seconds = 1.0;
+    double latency = 0.01;
+    unsigned chips = 1;
+    FmBank bank;
+};
+
+struct Result
+{
+    uint64_t sent = 0;
+    unsigned dropped = 0;
+    AudioCallbackStats::Snapshot stats;
+
+    bool sustained() const
+        { return dropped == 0 && stats.underflows == 0; }
+    //! Average render time of the block in microseconds
+    double averageUs() const
+        { return stats.averageLoad * 0.01 * stats.periodUs; }
+};
+
+//! Play the stream at the rate for the duration, 0 rate sends nothing
+static Result runStream(const Settings &settings, const std::vector<Message> &stream, unsigned rate)
+{
+    AudioOutHeadless out(AudioOutHeadless::MODE_TIMED, settings.latency);
+    std::shared_ptr<Generator> gen(
+        new Generator(out.sampleRate(), Generator::CHIP_Nuked, settings.chips));
+    RealtimeGenerator rt(gen);
+    rt.setDebugInfoEnabled(false);
+
+    FmBank bank = settings.bank;
+    rt.ctl_changeBank(bank);
+    rt.ctl_changePatch(bank.Ins_Melodic_box[0], false);
+
+    out.start(rt);
+
+    Result result;
+    size_t index = 0;
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point begin = Clock::now();
+    const Clock::time_point end = begin + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(settings.seconds));
+
+    for(Clock::time_point now = begin; now < end; now = Clock::now())
+    {
+        double elapsed = std::chrono::duration<double>(now - begin).count();
+        uint64_t due = (uint64_t)(elapsed * rate);
+        for(; result.sent < due; ++result.sent)
+        {
+            const Message &m = stream[index];
+            index = (index + 1) % stream.size();
+            rt.midi_event(m.data, m.size, IRealtimeMIDI::midi_clock());
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+
+    out.stop();
+    out.stats().snapshot(result.stats);
+    result.dropped = rt.midiDropped();
+    return result;
+}
+
+static FmBank makeBank()
+{
+    FmBank::Instrument ins = FmBank::emptyInst();
+    ins.algorithm = 7;
+    for(int i = 0; i < 4; ++i)
+    {
+        ins.OP[i].level = (i == 0 || i == 3) ? 0 : 20;
+        ins.OP[i].fmult = uint8_t(i + 1);
+        ins.OP[i].attack = 31;
+        ins.OP[i].decay1 = 5;
+        ins.OP[i].decay2 = 3;
+        ins.OP[i].sustain = 2;
+        ins.OP[i].release = 8;
+    }
+    FmBank bank;
+    for(FmBank::Instrument &i : bank.Ins_Melodic_box)
+        i = ins;
+    return bank;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    Settings settings;
+
+    if(argc > 1)
+        settings.seconds = std::strtod(argv[1], nullptr);
+    if(argc > 2)
+        settings.latency = std::strtod(argv[2], nullptr) * 1e-3;
+    if(argc > 3)
+        settings.chips = static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10));
+
+    if(settings.seconds <= 0 || settings.latency <= 0 || settings.chips == 0)
+    {
+        std::fprintf(stderr, "%s [seconds-per-rate] [latency-ms] [chips]\n", argv[0]);
+        return 1;
+    }
+
+    settings.bank = makeBank();
+
+    const unsigned minRate = 1000;
+    const unsigned maxRate = 2048000;
+
+    Result idle = runStream(settings, std::vector<Message>(1), 0);
+    std::printf("%u chips, block of %u frames every %u us, idle render %.1f us, worst %u us\n\n",
+                settings.chips, idle.stats.frames, idle.stats.periodUs,
+                idle.averageUs(), idle.stats.worstUs);
+
+    std::printf("%-14s %9s %9s %8s %6s %9s %9s %10s\n",
+                "scenario", "rate/s", "sent", "dropped", "late", "worst us", "avg load", "ns/event");
+
+    for(const Scenario &scenario : scenarios)
+    {
+        std::vector<Message> stream = scenario.make();
+        unsigned sustainedRate = 0;
+
+        for(unsigned rate = minRate; rate <= maxRate; rate *= 2)
+        {
+            Result r = runStream(settings, stream, rate);
+            uint64_t processed = r.sent - r.dropped;
+            double extraNs = (r.averageUs() - idle.averageUs()) * 1e3 * r.stats.callbacks;
+            char perEvent[32] = "-";
+            // below the noise of the idle render, when the events are few
+            if(processed > 0 && extraNs > 0)
+                std::snprintf(perEvent, sizeof(perEvent), "%.1f", extraNs / processed);
+
+            std::printf("%-14s %9u %9llu %8u %6llu %9u %8.1f%% %10s\n",
+                        scenario.name, rate, (unsigned long long)r.sent, r.dropped,
+                        (unsigned long long)r.stats.underflows, r.stats.worstUs,
+                        r.stats.averageLoad, perEvent);
+            std::fflush(stdout);
+
+            if(!r.sustained())
+                break;
+            sustainedRate = rate;
+        }
+
+        std::printf("%-14s sustained up to %u events/s\n\n", scenario.name, sustainedRate);
+    }
+
+    return 0;
+}
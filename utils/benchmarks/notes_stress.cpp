@@ -0,0 +1,184 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replays a dense pseudo-random MIDI event stream through the voice
+ * allocator and reports the average cost of a single event.
+ */
+
+#include <opl/notes_manager.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct Event
+{
+    enum Type
+    {
+        NoteOn,
+        NoteOff,
+        HoldOn,
+        HoldOff,
+        AllNotesOff
+    } type;
+    int note;
+    uint8_t part;
+};
+
+//! Small deterministic generator, so every run replays the same stream
+static uint32_t nextRandom(uint32_t &state)
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+static std::vector<Event> makeStream(size_t count)
+{
+    std::vector<Event> events;
+    std::vector<Event> pressed;
+    uint32_t seed = 12345;
+    events.reserve(count);
+
+    while(events.size() < count)
+    {
+        uint32_t r = nextRandom(seed) % 1000;
+        Event e;
+        e.part = static_cast<uint8_t>(nextRandom(seed) % 16);
+        if(r < 2)
+        {
+            e.type = Event::AllNotesOff;
+            e.note = -1;
+            pressed.clear();
+        }
+        else if(r < 12)
+        {
+            e.type = (r & 1) ? Event::HoldOn : Event::HoldOff;
+            e.note = -1;
+        }
+        else if(r < 500 || pressed.empty())
+        {
+            e.type = Event::NoteOn;
+            e.note = 24 + static_cast<int>(nextRandom(seed) % 88);
+            pressed.push_back(e);
+        }
+        else
+        {
+            size_t i = nextRandom(seed) % pressed.size();
+            e = pressed[i];
+            e.type = Event::NoteOff;
+            pressed[i] = pressed.back();
+            pressed.pop_back();
+        }
+        events.push_back(e);
+    }
+
+    return events;
+}
+
+static double runStream(const std::vector<Event> &events, int channels, unsigned passes)
+{
+    NotesManager manager;
+    manager.allocateChannels(channels);
+    bool held = false;
+    unsigned long checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned pass = 0; pass < passes; ++pass)
+    {
+        for(const Event &e : events)
+        {
+            switch(e.type)
+            {
+            case Event::NoteOn:
+                checksum += static_cast<unsigned>(manager.noteOn(e.note, e.part, nullptr, 0, 127, 100, 127));
+                break;
+            case Event::NoteOff:
+            {
+                int ch = manager.findNoteOffChannel(e.note, e.part);
+                if(ch < 0)
+                    break;
+                if(held)
+                    manager.hold(ch, true);
+                else
+                    manager.channelOff(ch, 0.001);
+                checksum += static_cast<unsigned>(ch);
+                break;
+            }
+            case Event::HoldOn:
+                held = true;
+                break;
+            case Event::HoldOff:
+            {
+                held = false;
+                int ch;
+                while((ch = manager.firstHeld()) >= 0)
+                    manager.channelOff(ch, 0.001);
+                break;
+            }
+            case Event::AllNotesOff:
+            {
+                int ch;
+                while((ch = manager.firstPlaying()) >= 0)
+                    manager.channelOff(ch, 0.001);
+                break;
+            }
+            }
+            // Roughly one event per millisecond at 53267 Hz
+            manager.advance(53);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+    if(checksum == 0)
+        std::fprintf(stderr, "Unexpected checksum\n");
+
+    return ns / (static_cast<double>(events.size()) * passes);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = 1000000;
+    unsigned passes = 5;
+
+    if(argc > 1)
+        count = std::strtoul(argv[1], nullptr, 10);
+    if(argc > 2)
+        passes = static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10));
+
+    if(count == 0 || passes == 0)
+    {
+        std::fprintf(stderr, "%s [events-count] [passes]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Event> events = makeStream(count);
+
+    std::printf("%zu events, %u passes\n", count, passes);
+    for(int chips = 1; chips <= 8; chips *= 2)
+    {
+        int channels = 6 * chips;
+        double perEvent = runStream(events, channels, passes);
+        std::printf("%2d chips, %2d channels: %8.2f ns/event\n", chips, channels, perEvent);
+    }
+
+    return 0;
+}
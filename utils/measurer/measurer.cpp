@@ -16,52 +16,621 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Measures the sounding durations of the instruments of many banks at once.
+ *
+ * The instruments of all the banks are measured by one pool of threads, the
+ * ones sounding the same are measured once. The sounds found in the cache of
+ * the measurements, shared with the editor, are not measured again. Writes
+ * the measured banks, and optionally a report of the durations and of the
+ * time spent, in JSON or CSV.
+ *
+ * With a journal, every measured sound is recorded as soon as it's done, and
+ * a restarted run measures only the sounds missing from it. The sounds may be
+ * split in shards measured by separate processes, each one into a journal of
+ * its own, then merged into the banks:
+ *   measurer --shard 1/2 --journal a.journal banks/
+ *   measurer --shard 2/2 --journal b.journal banks/
+ *   measurer --merge --journal a.journal --journal b.journal banks/ -o out/
+ */
+
 #include <FileFormats/format_wohlstand_opn2.h>
 #include <opl/measurer.h>
-#include <QApplication>
+#include <opl/measurer_cache.h>
+#include "measurer_journal.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
+#include <algorithm>
 #include <atomic>
-#include <memory>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
 
+struct Options
+{
+    QStringList inputs;
+    //! Output file of a single input bank, otherwise the output directory
+    QString output;
+    //! Report of the durations, CSV if the file name ends with ".csv", JSON otherwise
+    QString report;
+    //! Count of the worker threads, 0 for one per processor
+    int jobs = 0;
+    //! Journals to replay, the new measurements are appended to the first one
+    QStringList journals;
+    //! Shard of the sounds to measure, from 0 to shardCount - 1
+    unsigned shardIndex = 0;
+    unsigned shardCount = 1;
+    //! Measure nothing, write the banks from the journals
+    bool merge = false;
+    //! Take the known sounds from the cache, and store the measured ones
+    bool useCache = true;
+    //! Estimate the durations where it's unambiguous, instead of the emulation
+    bool fast = false;
+};
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <wopn-file-or-directory>... -o <output>\n"
+            "       %s <wopn-file-input> <wopn-file-output>\n"
+            "  -o, --output <path>     Output file of a single input bank, otherwise\n"
+            "                          the directory to write the measured banks into\n"
+            "  -j, --jobs <count>      Count of worker threads (default: one per CPU)\n"
+            "  --report <file>         Write the durations and the times per instrument,\n"
+            "                          as CSV if the file ends with \".csv\", JSON otherwise\n"
+            "  --journal <file>        Skip the sounds measured in the journal, and append\n"
+            "                          the new ones to it. Given again, the next journals\n"
+            "                          are only read\n"
+            "  --shard <i>/<n>         Measure the i-th of n shards of the sounds into the\n"
+            "                          journal, without writing the banks\n"
+            "  --merge                 Write the banks from the journals, measuring nothing\n"
+            "  --no-cache              Measure every sound, without the measurement cache\n"
+            "  --fast                  Estimate the durations of the sounds with simple\n"
+            "                          envelopes instead of emulating them. Faster, but\n"
+            "                          some durations differ from the emulation\n"
+            "Directories are searched for the WOPN files recursively.\n",
+            program, program);
+}
+
+static bool parseOptions(const QStringList &args, Options &opts)
+{
+    for(int i = 1; i < args.size(); ++i)
+    {
+        const QString &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        bool ok = true;
+        if((arg == "-o" || arg == "--output") && hasValue)
+            opts.output = args[++i];
+        else if((arg == "-j" || arg == "--jobs") && hasValue)
+        {
+            opts.jobs = args[++i].toInt(&ok);
+            ok = ok && opts.jobs > 0;
+        }
+        else if(arg == "--report" && hasValue)
+            opts.report = args[++i];
+        else if(arg == "--journal" && hasValue)
+            opts.journals.append(args[++i]);
+        else if(arg == "--shard" && hasValue)
+        {
+            QStringList shard = args[++i].split('/');
+            bool okCount = false;
+            ok = (shard.size() == 2);
+            if(ok)
+            {
+                opts.shardIndex = shard[0].toUInt(&ok);
+                opts.shardCount = shard[1].toUInt(&okCount);
+            }
+            ok = ok && okCount && opts.shardIndex >= 1 && opts.shardIndex <= opts.shardCount;
+            opts.shardIndex -= 1;
+        }
+        else if(arg == "--merge")
+            opts.merge = true;
+        else if(arg == "--no-cache")
+            opts.useCache = false;
+        else if(arg == "--fast")
+            opts.fast = true;
+        else if(!arg.startsWith("-"))
+            opts.inputs.append(arg);
+        else
+            ok = false;
+
+        if(!ok)
+        {
+            fprintf(stderr, "Invalid argument: %s\n", arg.toLocal8Bit().constData());
+            return false;
+        }
+    }
+
+    // the former usage: one input and one output file
+    if(opts.output.isEmpty() && opts.journals.isEmpty() &&
+       opts.inputs.size() == 2 && !QFileInfo(opts.inputs[0]).isDir())
+        opts.output = opts.inputs.takeLast();
+
+    bool sharded = (opts.shardCount > 1);
+    if((sharded || opts.merge) && opts.journals.isEmpty())
+    {
+        fprintf(stderr, "The shards and the merge need a journal.\n");
+        return false;
+    }
+    if(sharded && opts.merge)
+    {
+        fprintf(stderr, "A shard can't be merged, merge the journals of all the shards.\n");
+        return false;
+    }
+
+    // a shard writes nothing but its journal
+    return !opts.inputs.isEmpty() && (sharded || !opts.output.isEmpty());
+}
+
+//! Bank file to measure
+struct BankJob
+{
+    QString input;
+    QString output;
+    FmBank bank;
+    bool loaded = false;
+};
+
+//! Instrument of a bank, with the sound measured for it
+struct InstrumentJob
+{
+    int bank;
+    bool drum;
+    int index;
+    //! Index of the measured sound, -1 if the instrument is blank
+    int sound;
+    //! Durations are taken from another instrument sounding the same
+    bool shared;
+};
+
+//! Unique sound among the instruments of all the banks
+struct SoundJob
+{
+    quint64 key;
+    FmBank::Instrument *instrument;
+    double elapsedMs;
+    //! Durations are taken from the journal
+    bool replayed;
+    //! Durations are taken from the cache
+    bool cached;
+};
+
+//! Measures the sound in a worker thread, and records it in the journal
+struct MeasureSound
+{
+    typedef void result_type;
+    MeasurementJournal *journal;
+    std::atomic<bool> *journalFailed;
+    bool fast;
+
+    void operator()(SoundJob *job) const
+    {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point start = clock::now();
+        Measurer::measureDurations(*job->instrument, fast);
+        clock::time_point stop = clock::now();
+        job->elapsedMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+        if(!journal)
+            return;
+        MeasurementJournal::Entry entry;
+        entry.ms_sound_kon = job->instrument->ms_sound_kon;
+        entry.ms_sound_koff = job->instrument->ms_sound_koff;
+        entry.nosound = job->instrument->is_blank;
+        if(!journal->append(job->key, entry))
+            journalFailed->store(true);
+    }
+};
+
+static QStringList findBanks(const QString &directory)
+{
+    QStringList found;
+    QDirIterator it(directory, QStringList() << "*.wopn" << "*.WOPN",
+                    QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext())
+        found.append(it.next());
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+//! Find the input banks and decide where each one is saved
+static bool collectBanks(const Options &opts, QVector<BankJob> &banks)
+{
+    for(const QString &input : opts.inputs)
+    {
+        QFileInfo info(input);
+        if(!info.exists())
+        {
+            fprintf(stderr, "No such file or directory: %s\n", input.toLocal8Bit().constData());
+            return false;
+        }
+        if(!info.isDir())
+        {
+            BankJob job;
+            job.input = input;
+            job.output = info.fileName();
+            banks.append(job);
+            continue;
+        }
+        QDir root(input);
+        for(const QString &path : findBanks(input))
+        {
+            BankJob job;
+            job.input = path;
+            job.output = root.relativeFilePath(path);
+            banks.append(job);
+        }
+    }
+
+    if(opts.output.isEmpty())
+        return true;
+
+    bool singleFile = (banks.size() == 1) && !QFileInfo(opts.inputs.front()).isDir() &&
+                      !QFileInfo(opts.output).isDir();
+    if(singleFile)
+    {
+        banks.front().output = opts.output;
+        return true;
+    }
+
+    QDir outputDir(opts.output);
+    for(BankJob &job : banks)
+    {
+        job.output = outputDir.filePath(job.output);
+        if(!QDir().mkpath(QFileInfo(job.output).absolutePath()))
+        {
+            fprintf(stderr, "Could not create the directory of %s\n", job.output.toLocal8Bit().constData());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Collect the instruments to measure, grouping the ones sounding the same
+ * @param banks Loaded banks, the blank instruments are marked in place
+ * @param instruments All the instruments of the banks
+ * @param sounds First instrument of each unique sound
+ * @param fast Whether the sounds are measured by the fast way, keyed apart
+ */
+static void collectInstruments(QVector<BankJob> &banks,
+                               QVector<InstrumentJob> &instruments,
+                               QVector<SoundJob> &sounds, bool fast)
+{
+    const FmBank::Instrument blank = FmBank::emptyInst();
+    QHash<quint64, int> soundOfKey;
+
+    for(int b = 0; b < banks.size(); ++b)
+    {
+        if(!banks[b].loaded)
+            continue;
+        QVector<FmBank::Instrument> *boxes[2] = {&banks[b].bank.Ins_Melodic_box, &banks[b].bank.Ins_Percussion_box};
+        for(unsigned d = 0; d < 2; ++d)
+        {
+            QVector<FmBank::Instrument> &box = *boxes[d];
+            for(int i = 0; i < box.size(); ++i)
+            {
+                FmBank::Instrument &ins = box[i];
+                InstrumentJob job;
+                job.bank = b;
+                job.drum = (d != 0);
+                job.index = i;
+                job.sound = -1;
+                job.shared = false;
+
+                ins.is_blank = false;
+                if(memcmp(&ins, &blank, sizeof(FmBank::Instrument)) == 0)
+                {
+                    ins.is_blank = true;
+                    ins.ms_sound_kon = 0;
+                    ins.ms_sound_koff = 0;
+                    instruments.append(job);
+                    continue;
+                }
+
+                quint64 key = Measurer::soundKey(ins, fast);
+                QHash<quint64, int>::iterator it = soundOfKey.find(key);
+                if(it != soundOfKey.end())
+                {
+                    job.sound = *it;
+                    job.shared = true;
+                }
+                else
+                {
+                    job.sound = sounds.size();
+                    soundOfKey.insert(key, job.sound);
+                    SoundJob sound;
+                    sound.key = key;
+                    sound.instrument = &ins;
+                    sound.elapsedMs = 0;
+                    sound.replayed = false;
+                    sound.cached = false;
+                    sounds.append(sound);
+                }
+                instruments.append(job);
+            }
+        }
+    }
+}
+
+static FmBank::Instrument &instrumentOf(QVector<BankJob> &banks, const InstrumentJob &job)
+{
+    FmBank &bank = banks[job.bank].bank;
+    return job.drum ? bank.Ins_Percussion_box[job.index] : bank.Ins_Melodic_box[job.index];
+}
+
+static QString csvQuoted(const QString &text)
+{
+    QString quoted = text;
+    quoted.replace("\"", "\"\"");
+    return "\"" + quoted + "\"";
+}
+
+static bool writeReport(const QString &path, QVector<BankJob> &banks,
+                        const QVector<InstrumentJob> &instruments,
+                        const QVector<SoundJob> &sounds,
+                        int replayed, int cached, int jobs, double elapsedMs)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    if(path.endsWith(".csv", Qt::CaseInsensitive))
+    {
+        QTextStream out(&file);
+        out << "file,kind,index,name,kon_ms,koff_ms,blank,shared,replayed,cached,time_ms\n";
+        for(const InstrumentJob &job : instruments)
+        {
+            const FmBank::Instrument &ins = instrumentOf(banks, job);
+            bool replayed = (job.sound >= 0) && sounds[job.sound].replayed;
+            bool cached = (job.sound >= 0) && sounds[job.sound].cached;
+            double timeMs = (job.sound >= 0 && !job.shared) ? sounds[job.sound].elapsedMs : 0.0;
+            out << csvQuoted(banks[job.bank].input) << ','
+                << (job.drum ? "drum" : "melodic") << ','
+                << job.index << ','
+                << csvQuoted(QString::fromUtf8(ins.name)) << ','
+                << ins.ms_sound_kon << ','
+                << ins.ms_sound_koff << ','
+                << (ins.is_blank ? 1 : 0) << ','
+                << (job.shared ? 1 : 0) << ','
+                << (replayed ? 1 : 0) << ','
+                << (cached ? 1 : 0) << ','
+                << QString::number(timeMs, 'f', 3) << '\n';
+        }
+        return out.status() == QTextStream::Ok;
+    }
+
+    QVector<QJsonArray> bankInstruments(banks.size());
+    for(const InstrumentJob &job : instruments)
+    {
+        const FmBank::Instrument &ins = instrumentOf(banks, job);
+        QJsonObject entry;
+        entry["kind"] = job.drum ? "drum" : "melodic";
+        entry["index"] = job.index;
+        entry["name"] = QString::fromUtf8(ins.name);
+        entry["kon_ms"] = ins.ms_sound_kon;
+        entry["koff_ms"] = ins.ms_sound_koff;
+        entry["blank"] = ins.is_blank;
+        entry["shared"] = job.shared;
+        entry["replayed"] = (job.sound >= 0) && sounds[job.sound].replayed;
+        entry["cached"] = (job.sound >= 0) && sounds[job.sound].cached;
+        entry["time_ms"] = (job.sound >= 0 && !job.shared) ? sounds[job.sound].elapsedMs : 0.0;
+        bankInstruments[job.bank].append(entry);
+    }
+
+    QJsonArray bankArray;
+    for(int b = 0; b < banks.size(); ++b)
+    {
+        QJsonObject entry;
+        entry["input"] = banks[b].input;
+        entry["output"] = banks[b].output;
+        entry["loaded"] = banks[b].loaded;
+        entry["instruments"] = bankInstruments[b];
+        bankArray.append(entry);
+    }
+
+    QJsonObject root;
+    root["jobs"] = jobs;
+    root["elapsed_ms"] = elapsedMs;
+    root["instruments"] = instruments.size();
+    root["unique_sounds"] = sounds.size();
+    root["replayed_sounds"] = replayed;
+    root["cached_sounds"] = cached;
+    root["banks"] = bankArray;
+
+    QByteArray data = QJsonDocument(root).toJson();
+    return file.write(data) == data.size();
+}
+
 int main(int argc, char *argv[])
 {
-    if(argc != 3)
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("OPN2 Measurer");
+
+    Options opts;
+    if(!parseOptions(app.arguments(), opts))
     {
-        fprintf(stderr, "%s <wopn-file-input> <wopn-file-output>\n", argv[0]);
+        printUsage(argv[0]);
         return 1;
     }
 
-    QApplication app(argc, argv);
+    QVector<BankJob> banks;
+    if(!collectBanks(opts, banks))
+        return 1;
+    if(banks.isEmpty())
+    {
+        fprintf(stderr, "No WOPN files to measure.\n");
+        return 1;
+    }
 
+    int status = 0;
     WohlstandOPN2 format;
-    QString wopnFileInput = argv[1];
+    for(BankJob &job : banks)
+    {
+        job.loaded = (format.loadFile(job.input, job.bank) == FfmtErrCode::ERR_OK);
+        if(!job.loaded)
+        {
+            fprintf(stderr, "Could not load the WOPN file %s\n", job.input.toLocal8Bit().constData());
+            status = 1;
+        }
+    }
 
-    FmBank bank;
-    FfmtErrCode errLoad = format.loadFile(wopnFileInput, bank);
+    // the pointers to the instruments are kept valid until the banks are saved
+    QVector<InstrumentJob> instruments;
+    QVector<SoundJob> sounds;
+    collectInstruments(banks, instruments, sounds, opts.fast);
 
-    if(errLoad != FfmtErrCode::ERR_OK)
+    // take the sounds measured before, by this run or by the other shards
+    QHash<quint64, MeasurementJournal::Entry> journaled;
+    for(const QString &path : opts.journals)
     {
-        fprintf(stderr, "Could not load the WOPN file.\n");
+        if(!MeasurementJournal::replay(path, journaled))
+        {
+            fprintf(stderr, "Could not read the journal %s\n", path.toLocal8Bit().constData());
+            return 1;
+        }
+    }
+
+    MeasurementJournal journal;
+    std::atomic<bool> journalFailed(false);
+    bool journaling = !opts.journals.isEmpty() && !opts.merge;
+    if(journaling && !journal.open(opts.journals.front()))
+    {
+        fprintf(stderr, "Could not open the journal %s\n", opts.journals.front().toLocal8Bit().constData());
         return 1;
     }
 
-    Measurer measurer;
-    FmBank bankBackup = bank;
+    MeasurementCache cache;
+    if(opts.useCache)
+        cache.load();
+
+    QVector<SoundJob *> pending;
+    int replayed = 0;
+    int cached = 0;
+    int missing = 0;
+    for(SoundJob &sound : sounds)
+    {
+        QHash<quint64, MeasurementJournal::Entry>::const_iterator it = journaled.constFind(sound.key);
+        MeasurementCache::Entry entry;
+        if(it != journaled.constEnd())
+        {
+            sound.instrument->ms_sound_kon = it->ms_sound_kon;
+            sound.instrument->ms_sound_koff = it->ms_sound_koff;
+            sound.instrument->is_blank = it->nosound;
+            sound.replayed = true;
+            ++replayed;
+            continue;
+        }
+
+        bool inShard = (sound.key % opts.shardCount == opts.shardIndex);
+        if(opts.useCache && inShard && cache.lookup(sound.key, entry))
+        {
+            sound.instrument->ms_sound_kon = entry.ms_sound_kon;
+            sound.instrument->ms_sound_koff = entry.ms_sound_koff;
+            sound.instrument->is_blank = entry.nosound;
+            sound.cached = true;
+            ++cached;
+            // the merge of the shards may run where this cache isn't
+            if(journaling && !journal.append(sound.key, entry))
+                journalFailed.store(true);
+        }
+        else if(opts.merge)
+            ++missing;
+        else if(inShard)
+            pending.append(&sound);
+    }
 
-    if(!measurer.doMeasurement(bank, bankBackup, true))
+    if(missing > 0)
     {
-        fprintf(stderr, "Measurement was interrupted.\n");
+        fprintf(stderr, "%d sounds are missing from the journals, the banks are not written.\n", missing);
         return 1;
     }
 
-    QString wopnFileOutput = argv[2];
+    int jobs = (opts.jobs > 0) ? opts.jobs : QThread::idealThreadCount();
+    QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+
+    MeasureSound measure;
+    measure.journal = journaling ? &journal : nullptr;
+    measure.journalFailed = &journalFailed;
+    measure.fast = opts.fast;
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    QtConcurrent::blockingMap(pending, measure);
+    clock::time_point stop = clock::now();
+    double elapsedMs = std::chrono::duration<double, std::milli>(stop - start).count();
 
-    FfmtErrCode errSave = format.saveFile(wopnFileOutput, bank);
-    if(errSave != FfmtErrCode::ERR_OK)
+    if(journalFailed.load())
     {
-        fprintf(stderr, "Could not save the WOPN file.\n");
-        return 1;
+        fprintf(stderr, "Could not write to the journal %s\n", opts.journals.front().toLocal8Bit().constData());
+        status = 1;
+    }
+
+    if(opts.useCache)
+    {
+        for(const SoundJob *sound : pending)
+        {
+            MeasurementCache::Entry entry;
+            entry.ms_sound_kon = sound->instrument->ms_sound_kon;
+            entry.ms_sound_koff = sound->instrument->ms_sound_koff;
+            entry.nosound = sound->instrument->is_blank;
+            cache.insert(sound->key, entry);
+        }
+        if(!cache.save())
+            fprintf(stderr, "Could not save the measurement cache.\n");
+    }
+
+    if(opts.shardCount > 1)
+    {
+        fprintf(stderr, "Measured %d sounds of shard %u/%u, %d replayed and %d cached of %d unique sounds, %.3f s with %d threads\n",
+                pending.size(), opts.shardIndex + 1, opts.shardCount, replayed, cached, sounds.size(),
+                elapsedMs * 1e-3, jobs);
+        return status;
+    }
+
+    for(const InstrumentJob &job : instruments)
+    {
+        if(!job.shared)
+            continue;
+        const FmBank::Instrument &first = *sounds[job.sound].instrument;
+        FmBank::Instrument &ins = instrumentOf(banks, job);
+        ins.ms_sound_kon = first.ms_sound_kon;
+        ins.ms_sound_koff = first.ms_sound_koff;
+        ins.is_blank = first.is_blank;
     }
 
-    return 0;
+    for(BankJob &job : banks)
+    {
+        if(!job.loaded)
+            continue;
+        if(format.saveFile(job.output, job.bank) != FfmtErrCode::ERR_OK)
+        {
+            fprintf(stderr, "Could not save the WOPN file %s\n", job.output.toLocal8Bit().constData());
+            status = 1;
+        }
+    }
+
+    if(!opts.report.isEmpty() &&
+       !writeReport(opts.report, banks, instruments, sounds, replayed, cached, jobs, elapsedMs))
+    {
+        fprintf(stderr, "Could not write the report %s\n", opts.report.toLocal8Bit().constData());
+        status = 1;
+    }
+
+    fprintf(stderr, "Measured %d unique sounds of %d instruments in %d banks, %d replayed and %d cached, %.3f s with %d threads\n",
+            sounds.size(), instruments.size(), banks.size(), replayed, cached, elapsedMs * 1e-3, jobs);
+
+    return status;
 }
@@ -0,0 +1,109 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2018-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "measurer_journal.h"
+#include <QMutexLocker>
+#include <cstdio>
+
+/*
+ * One line per sound: the key in 16 hex digits, the durations on and off
+ * in milliseconds, and 1 if the sound is silent. Lines starting with '#'
+ * are comments. The line is taken only when its newline is written, the
+ * rest of a line cut by a killed process is ignored.
+ */
+
+MeasurementJournal::MeasurementJournal()
+{}
+
+MeasurementJournal::~MeasurementJournal()
+{}
+
+bool MeasurementJournal::replay(const QString &path, QHash<quint64, Entry> &entries)
+{
+    QFile file(path);
+    if(!file.exists())
+        return true;
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QList<QByteArray> lines = file.readAll().split('\n');
+    // the last piece is empty, or a line which wasn't completed
+    lines.removeLast();
+
+    for(const QByteArray &line : lines)
+    {
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+        QList<QByteArray> fields = line.simplified().split(' ');
+        if(fields.size() != 4)
+            continue;
+
+        bool okKey, okOn, okOff, okSilent;
+        quint64 key = fields[0].toULongLong(&okKey, 16);
+        uint on = fields[1].toUInt(&okOn);
+        uint off = fields[2].toUInt(&okOff);
+        uint silent = fields[3].toUInt(&okSilent);
+        if(!okKey || !okOn || !okOff || !okSilent || on > 0xFFFF || off > 0xFFFF || silent > 1)
+            continue;
+
+        Entry entry;
+        entry.ms_sound_kon = static_cast<uint16_t>(on);
+        entry.ms_sound_koff = static_cast<uint16_t>(off);
+        entry.nosound = (silent != 0);
+        entries.insert(key, entry);
+    }
+    return true;
+}
+
+bool MeasurementJournal::open(const QString &path)
+{
+    // end the line cut by a killed process, not to join the next one to it
+    bool cutLine = false;
+    QFile previous(path);
+    if(previous.open(QIODevice::ReadOnly) && previous.size() > 0)
+    {
+        char last = '\n';
+        previous.seek(previous.size() - 1);
+        previous.getChar(&last);
+        cutLine = (last != '\n');
+    }
+    previous.close();
+
+    m_file.setFileName(path);
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    if(cutLine)
+        m_file.write("\n");
+    if(m_file.size() == 0)
+        m_file.write("# OPN2 measurer journal: key, on ms, off ms, silent\n");
+    return m_file.flush();
+}
+
+bool MeasurementJournal::append(quint64 key, const Entry &entry)
+{
+    char line[64];
+    int size = std::snprintf(line, sizeof(line), "%016llx %u %u %u\n",
+                             static_cast<unsigned long long>(key),
+                             unsigned(entry.ms_sound_kon), unsigned(entry.ms_sound_koff),
+                             entry.nosound ? 1u : 0u);
+
+    QMutexLocker lock(&m_mutex);
+    if(m_file.write(line, size) != size)
+        return false;
+    return m_file.flush();
+}
@@ -0,0 +1,63 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2018-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEASURER_JOURNAL_H
+#define MEASURER_JOURNAL_H
+
+#include <opl/measurer_cache.h>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/**
+ * @brief Append-only journal of the measured sounds
+ *
+ * Each measured sound is appended as a line of text as soon as it's done,
+ * so a killed run loses nothing but the sounds being measured. The entries
+ * are addressed by Measurer::soundKey(), which changes with the measurer,
+ * so the journals of the shards of one collection can be merged in any
+ * order, and the entries of an outdated measurer are never matched.
+ */
+class MeasurementJournal
+{
+public:
+    typedef MeasurementCache::Entry Entry;
+
+    MeasurementJournal();
+    ~MeasurementJournal();
+
+    /**
+     * @brief Read the entries of the journal, the later ones replace the earlier
+     * @param path Journal file, a missing file has no entries
+     * @param entries Entries to complete
+     * @return false if the file exists and can't be read
+     */
+    static bool replay(const QString &path, QHash<quint64, Entry> &entries);
+
+    //! Open the journal to append the new entries, creating the file
+    bool open(const QString &path);
+    //! Append the entry and flush it to the file, callable from any thread
+    bool append(quint64 key, const Entry &entry);
+
+private:
+    QMutex m_mutex;
+    QFile m_file;
+};
+
+#endif // MEASURER_JOURNAL_H
@@ -0,0 +1,286 @@
+/*
+ * OPN2 Bank Editor by Wohlstand, a free tool for music bank editing
+ * Copyright (c) 2017-2021 Vitaly Novichkov <admin@wohlnet.ru>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Headless synthesizer: plays a bank from the MIDI input, without the editor.
+ *
+ * The load statistics are printed to the standard error on SIGUSR1,
+ * SIGINT and SIGTERM stop the synthesizer.
+ */
+
+#include <FileFormats/ffmt_factory.h>
+#include <opl/generator_realtime.h>
+#include <audio/ao_base.h>
+#ifdef ENABLE_MIDI
+#include <midi/midi_rtmidi.h>
+#endif
+#include <QCoreApplication>
+#include <QStringList>
+#include <cstdio>
+#include <memory>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <unistd.h>
+#include <thread>
+#define SYNTH_HAS_SIGNALS
+#endif
+
+struct Options
+{
+    QString bankPath;
+    Generator::OPN_Chips chip = Generator::CHIP_Nuked;
+    unsigned chipsCount = 1;
+    std::string audioDriver;
+    std::string audioDevice;
+    double latency = 0.02;
+    bool nativeRate = false;
+    bool lowLatency = false;
+    //! Port of MIDI input, or -1 to open a virtual port
+    int midiPort = -1;
+};
+
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <bank-file>\n"
+            "  --chip <index>          Emulator: 0 Nuked, 1 GENS, 2 MAME, 3 GX,\n"
+            "                          4 NP2, 5 MAME OPNA, 6 PMDWin (default 0)\n"
+            "  --chips <count>         Count of emulated chips (default 1)\n"
+            "  --audio-driver <name>   Audio driver, \"null\" plays without sound card\n"
+            "  --audio-device <name>   Audio device, or the file of the \"wav\" driver\n"
+            "  --latency <ms>          Audio latency (default 20)\n"
+            "  --native-rate           Open the audio output at the rate of the chip\n"
+            "  --low-latency           Real-time scheduling and locked memory\n"
+            "  --midi-port <index>     MIDI input port, a virtual port by default\n"
+            "  --list-midi-ports       Print the MIDI input ports and exit\n"
+            "Send SIGUSR1 to print the load statistics.\n",
+            program);
+}
+
+static bool parseOptions(const QStringList &args, Options &opts, bool &listPorts)
+{
+    for(int i = 1; i < args.size(); ++i)
+    {
+        const QString &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        bool ok = true;
+        if(arg == "--chip" && hasValue)
+        {
+            int chip = args[++i].toInt(&ok);
+            ok = ok && chip >= Generator::CHIP_BEGIN && chip < Generator::CHIP_END;
+            opts.chip = static_cast<Generator::OPN_Chips>(chip);
+        }
+        else if(arg == "--chips" && hasValue)
+        {
+            opts.chipsCount = args[++i].toUInt(&ok);
+            ok = ok && opts.chipsCount > 0;
+        }
+        else if(arg == "--audio-driver" && hasValue)
+            opts.audioDriver = args[++i].toStdString();
+        else if(arg == "--audio-device" && hasValue)
+            opts.audioDevice = args[++i].toStdString();
+        else if(arg == "--latency" && hasValue)
+        {
+            opts.latency = args[++i].toDouble(&ok) * 1e-3;
+            ok = ok && opts.latency > 0;
+        }
+        else if(arg == "--native-rate")
+            opts.nativeRate = true;
+        else if(arg == "--low-latency")
+            opts.lowLatency = true;
+        else if(arg == "--midi-port" && hasValue)
+        {
+            opts.midiPort = args[++i].toInt(&ok);
+            ok = ok && opts.midiPort >= 0;
+        }
+        else if(arg == "--list-midi-ports")
+            listPorts = true;
+        else if(!arg.startsWith("--") && opts.bankPath.isEmpty())
+            opts.bankPath = arg;
+        else
+            ok = false;
+
+        if(!ok)
+        {
+            fprintf(stderr, "Invalid argument: %s\n", arg.toLocal8Bit().constData());
+            return false;
+        }
+    }
+    return listPorts || !opts.bankPath.isEmpty();
+}
+
+
+//! Callable from any thread, the statistics are atomic
+static void printStatistics(AudioOutBase &audioOut)
+{
+    AudioCallbackStats::Snapshot snapshot;
+    audioOut.stats().snapshot(snapshot);
+    fprintf(stderr, "%s\n", snapshot.toText().c_str());
+    if(audioOut.isLowLatency())
+        fprintf(stderr, "%s\n", audioOut.lowLatencyStatus().toText().c_str());
+}
+
+#ifdef SYNTH_HAS_SIGNALS
+static void handledSignals(sigset_t &set)
+{
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+}
+
+/**
+ * @brief Wait for the signals in a thread of its own, until stopped
+ * The signals must be blocked in all the threads of the process.
+ */
+static void signalLoop(QCoreApplication *app, AudioOutBase *audioOut, IRealtimeControl *control)
+{
+    sigset_t set;
+    handledSignals(set);
+    for(;;)
+    {
+        int signum = 0;
+        if(sigwait(&set, &signum) != 0)
+            continue;
+        if(signum == SIGUSR1)
+        {
+            printStatistics(*audioOut);
+            QMetaObject::invokeMethod(control, "requestDebugInfo", Qt::QueuedConnection);
+        }
+        else
+        {
+            QMetaObject::invokeMethod(app, "quit", Qt::QueuedConnection);
+            break;
+        }
+    }
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+#ifdef SYNTH_HAS_SIGNALS
+    // before any thread is created, they inherit the mask
+    sigset_t blocked;
+    handledSignals(blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, nullptr);
+#endif
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("OPN2 Synth");
+
+    Options opts;
+    bool listPorts = false;
+    if(!parseOptions(app.arguments(), opts, listPorts))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FmBank bank;
+    if(!listPorts)
+    {
+        FfmtErrCode err = FmBankFormatFactory::OpenBankFile(opts.bankPath, bank);
+        if(err != FfmtErrCode::ERR_OK)
+        {
+            fprintf(stderr, "Could not load the bank: %s\n",
+                    FileFormats::getErrorText(err).toLocal8Bit().constData());
+            return 1;
+        }
+    }
+
+    OPNFamily family = bank.opna_mode ? OPNChip_OPNA : OPNChip_OPN2;
+    unsigned preferredRate = opts.nativeRate ? opn2_getNativeRate(family) : 0;
+    std::unique_ptr<AudioOutBase> audioOut(
+        AudioOutBase::create(opts.latency, opts.audioDevice, opts.audioDriver,
+                             preferredRate, opts.lowLatency));
+    if(!audioOut->errorText().empty())
+        fprintf(stderr, "%s\nPlaying without sound.\n", audioOut->errorText().c_str());
+
+    std::shared_ptr<Generator> generator(
+        new Generator(audioOut->sampleRate(), opts.chip, opts.chipsCount));
+    RealtimeGenerator rtgenerator(generator);
+    // only report on request, the synthesizer has nothing to show all the time
+    rtgenerator.setDebugInfoEnabled(false);
+    QObject::connect(&rtgenerator, &IRealtimeControl::debugInfo,
+                     [](const QString &info) {
+                         fprintf(stderr, "%s\n", info.toLocal8Bit().constData());
+                     });
+
+#ifdef ENABLE_MIDI
+    MidiInRt midiIn(rtgenerator);
+    if(listPorts)
+    {
+        QVector<QString> ports;
+        midiIn.getPortList(ports);
+        for(int i = 0; i < ports.size(); ++i)
+            printf("%d: %s\n", i, ports[i].toLocal8Bit().constData());
+        return 0;
+    }
+#else
+    if(listPorts)
+    {
+        fprintf(stderr, "Built without MIDI input.\n");
+        return 1;
+    }
+#endif
+
+    rtgenerator.ctl_switchChip(opts.chip, static_cast<int>(family));
+    rtgenerator.ctl_changeLFO(bank.lfo_enabled);
+    rtgenerator.ctl_changeLFOfreq(bank.lfo_frequency);
+    rtgenerator.ctl_changeBank(bank);
+    // channels play the first instrument until their program change
+    if(!bank.Ins_Melodic_box.isEmpty())
+        rtgenerator.ctl_changePatch(bank.Ins_Melodic_box[0], false);
+
+    audioOut->start(rtgenerator);
+
+#ifdef ENABLE_MIDI
+    bool midiOpened = (opts.midiPort < 0) ? midiIn.openVirtual() : midiIn.open(opts.midiPort);
+    if(!midiOpened)
+    {
+        fprintf(stderr, "Could not open the MIDI input: %s\n",
+                midiIn.getErrorText().toLocal8Bit().constData());
+        audioOut->stop();
+        return 1;
+    }
+    if(opts.midiPort < 0)
+        fprintf(stderr, "Listening on the virtual MIDI port \"%s\"\n",
+                MidiInRt::defaultPortName().toLocal8Bit().constData());
+#else
+    fprintf(stderr, "Built without MIDI input, nothing will be played.\n");
+#endif
+
+#ifdef SYNTH_HAS_SIGNALS
+    std::thread signalThread(&signalLoop, &app, audioOut.get(), &rtgenerator);
+    fprintf(stderr, "Running as process %ld\n", static_cast<long>(getpid()));
+#endif
+
+    int ret = app.exec();
+
+#ifdef SYNTH_HAS_SIGNALS
+    signalThread.join();
+#endif
+
+#ifdef ENABLE_MIDI
+    midiIn.close();
+#endif
+    audioOut->stop();
+    printStatistics(*audioOut);
+    return ret;
+}